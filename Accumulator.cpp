@@ -1,6 +1,7 @@
 #include "Accumulator.hpp"
 #include "MarketData.hpp"
 #include "Result.hpp"
+#include "MonteCarlo.hpp"
 
 template<class T> bool ascending (const T& a, const T& b) { return a <= b; }
 template<class T> bool descending(const T& a, const T& b) { return a >= b; }
@@ -100,8 +101,12 @@ struct AccumDeliveries
     }
 };
 
-class AccumulatorMCEngine : public PathPricer<Path>
+class AccumulatorAnalyticEngine; // forward declaration
+
+class AccumulatorMCEngine : public GridPathPricer, public ExposurePathPricer
 {
+	// The analytic engine re-uses the date, period and discount factor tables set up here.
+	friend class AccumulatorAnalyticEngine;
 private:
 	std::vector<Real>             m_sharesDeliveredDueToHistoricalAccumulation;
 	std::vector<Real>             m_cashDeliveredDueToHistoricalAccumulation;
@@ -131,6 +136,15 @@ private:
 	boost::shared_ptr<Calendar>   m_underlyingHolCal;
     boost::shared_ptr<Schedule>   m_busDaySchedule;
 
+	// When simulating on a coarse grid (e.g. weekly) the path only has values on m_gridPathIndices,
+	// the days in between are dealt with using the Brownian bridge, see valueOnGrid(..).
+	// m_gridPathIndices is empty when we simulate every business day.
+	std::vector<Size>             m_gridPathIndices;         // the daily path indices that are on the grid
+	Real                          m_varianceOfOneDay;        // vol^2 * dt
+	Real                          m_logShiftedKOPrice;       // includes the Broadie-Glasserman shift
+	Real                          m_logGearingStrike;
+	CumulativeNormalDistribution  m_cumNormal;
+
 	void checkAccumContract(); // throws on failure
     void generateDates ();     // initialized the data information.
 
@@ -146,6 +160,25 @@ public:
     // returns the present value for given path.
 	Real operator()(const Path& path) const;
 
+	// Goes along the (daily) path until the knock-out, setting the deliveries.
+	void simulateDeliveries(const Path& path,                                        // input
+		                    AccumDeliveries& deliveries, bool& knockedOut, Size& indexOfKO) const; // outputs
+
+	// For the exposure profile, see ExposurePathPricer
+	void              getCashflowPVs(const Path& path, std::vector<Real>& cashflowPVs) const;
+	std::vector<Date> getSettlementDates() const;
+	Size              getPathIndexOfDate(const Date& date) const;
+	void              getRegressors(const Path& path, Size pathIndex, std::vector<Real>& regressors) const;
+
+	// gridType can be 'daily', 'weekly' or 'period_end'. The period end dates are always on the grid.
+	// The vol and dt are also needed by valueOnGrid(..) when used by the multilevel MC.
+	void                     setMCGrid(const std::string& gridType, Volatility vol, Time dt); 
+	const std::vector<Size>& getMCGridPathIndices() const;
+
+	// returns the present value for a path that only has values on the (coarse) grid.
+	Real valueOnGrid(const Path& path, const std::vector<Size>& gridPathIndices) const;
+	void getMandatoryPathIndices(std::vector<Size>& mandatoryPathIndices) const; // the period ends
+
     // oneDaysAccumulation(..) returns true if the KO is triggered, otherwise false.
     // It assumes there is no KO before this.
     // Will amend the cashDelivered and sharesDelivered output parameters adding the 
@@ -201,8 +234,11 @@ Real AccumulatorMCEngine::getRemainingNotional() const
 AccumulatorMCEngine::AccumulatorMCEngine(AccumulatorContract* pContract, 
 										 MarketCaches*        pMarket) 
 {
-	m_accumContract   = pContract;
-	m_marketCaches    = pMarket;
+	m_accumContract     = pContract;
+	m_marketCaches      = pMarket;
+	m_varianceOfOneDay  = 0.0;
+	m_logShiftedKOPrice = 0.0;
+	m_logGearingStrike  = 0.0;
    
 	initialize();
 }
@@ -421,6 +457,50 @@ Real AccumulatorMCEngine::getPeriodEndSharePrice(Size period, const Path& path)
     return path.value(getPathIndexFromDateIndex(m_indexOfPeriodEnd[period]));	
 }
 
+void AccumulatorMCEngine::setMCGrid(const std::string& gridType, Volatility vol, Time dt)
+{
+	m_varianceOfOneDay  = vol * vol * dt;
+	// Broadie-Glasserman-Kou continuity correction: the continuous barrier used by the Brownian bridge
+	// is shifted up by exp(0.5826 * vol * sqrt(dt)) to account for the daily monitoring.
+	m_logShiftedKOPrice = std::log(m_accumContract->m_KOPrice) + 0.5826 * vol * std::sqrt(dt);
+	m_logGearingStrike  = (m_accumContract->m_hasGearing ? std::log(m_accumContract->m_gearingStrike) : 0.0);
+
+	m_gridPathIndices.clear();
+	if(gridType == "daily")
+		return; // every business day is simulated, so there's no need for a grid.
+
+	Size numPathIndices = getNumMCTimeSteps() + 1;
+	Size daysBetweenGridPoints;
+	if(gridType == "weekly")
+		daysBetweenGridPoints = 5;
+	else if(gridType == "period_end")
+		daysBetweenGridPoints = numPathIndices; // i.e. only the period ends and the final date
+	else
+		QL_FAIL("AccumulatorMCEngine::setMCGrid(..): Unrecognised accumulator_mc_grid: " << gridType
+		        << ".\nCould try 'daily', 'weekly' or 'period_end'.");
+
+	std::vector<Size> mandatoryPathIndices;
+	getMandatoryPathIndices(mandatoryPathIndices);
+	buildGridPathIndices(numPathIndices, daysBetweenGridPoints, mandatoryPathIndices, // inputs
+		                 m_gridPathIndices);                                         // output
+
+	writeDiagnostics("Using a " + gridType + " grid with " + toString(m_gridPathIndices.size()) 
+		             + " points, instead of " + toString(numPathIndices) + " daily points.",
+					 mid, "AccumulatorMCEngine::setMCGrid");
+}
+
+void AccumulatorMCEngine::getMandatoryPathIndices(std::vector<Size>& mandatoryPathIndices) const
+{   // The period end prices are needed to value the shares.
+	mandatoryPathIndices.clear();
+	for(Size period = m_currentPeriod; period < m_accumContract->m_numPeriods; period++)
+		mandatoryPathIndices.push_back(getPathIndexFromDateIndex(m_indexOfPeriodEnd[period]));
+}
+
+const std::vector<Size>& AccumulatorMCEngine::getMCGridPathIndices() const
+{
+	return m_gridPathIndices;
+}
+
 Real AccumulatorMCEngine::sumPeriodEndContibutions(bool knockedOut, Size indexOfKO, 
 												   const Path& path, const AccumDeliveries& deliveries) const
 {   // for now this method assumes that the KO settlements will be at period end.
@@ -444,11 +524,24 @@ Real AccumulatorMCEngine::sumPeriodEndContibutions(bool knockedOut, Size indexOf
 // calculate the actual value of the trade given one path
 Real AccumulatorMCEngine::operator ()(const Path& path) const
 {
+	if( !m_gridPathIndices.empty())
+		return valueOnGrid(path, m_gridPathIndices);
+
 	AccumDeliveries deliveries;
+	bool knockedOut;
+	Size indexOfKO;
+	simulateDeliveries(path, deliveries, knockedOut, indexOfKO);
+
+	return sumPeriodEndContibutions(knockedOut, indexOfKO, path, deliveries);
+}
+
+void AccumulatorMCEngine::simulateDeliveries(const Path& path,                                        // input
+											 AccumDeliveries& deliveries, bool& knockedOut, Size& indexOfKO) const // outputs
+{
 	deliveries.reset(m_sharesDeliveredDueToHistoricalAccumulation, m_cashDeliveredDueToHistoricalAccumulation);
 
-	bool knockedOut = false;
-	Size indexOfKO  = m_totNumAccumDays; // Knocked out after end of trade, i.e. not knocked out.
+	knockedOut      = false;
+	indexOfKO       = m_totNumAccumDays; // Knocked out after end of trade, i.e. not knocked out.
 	Size pathIndex  = 1;                 // Today's accumulation is deal with in the historical part. 
 	while( (pathIndex < path.length()) && !knockedOut)
 	{
@@ -463,7 +556,184 @@ Real AccumulatorMCEngine::operator ()(const Path& path) const
 		}
 		pathIndex++;
 	}
-	return sumPeriodEndContibutions(knockedOut, indexOfKO, path, deliveries);
+}
+
+void AccumulatorMCEngine::getCashflowPVs(const Path& path, std::vector<Real>& cashflowPVs) const
+{   // one cashflow for each period, as in sumPeriodEndContibutions(..)
+	AccumDeliveries deliveries;
+	bool knockedOut;
+	Size indexOfKO;
+	simulateDeliveries(path, deliveries, knockedOut, indexOfKO);
+
+	cashflowPVs.assign(m_accumContract->m_numPeriods, 0.0);
+	for(Size period = m_currentPeriod; period < m_accumContract->m_numPeriods; period++)
+	   cashflowPVs[period] = m_discFactors[period] * 
+		                     ( deliveries.m_sharesDelivered[period] * getPeriodEndSharePrice(period, path) 
+		                       + deliveries.m_cashDelivered[period] );
+
+	if(knockedOut && (m_accumContract->m_subCategory == accumulator_swap)) 
+		cashflowPVs[m_periodIndexOfDate[indexOfKO]] += (m_totNumAccumDays - 1 - indexOfKO) 
+		                                               * m_accumContract->m_maxGearingTimesStrike 
+		                                               * m_discFactors[m_periodIndexOfDate[indexOfKO]];
+}
+
+std::vector<Date> AccumulatorMCEngine::getSettlementDates() const
+{
+	return m_periodSettleDates;
+}
+
+Size AccumulatorMCEngine::getPathIndexOfDate(const Date& date) const
+{
+	// the index of the accum date on or before the date
+	Integer dateIndex = (date >= m_accumDates[m_totNumAccumDays - 1] ? (Integer) m_totNumAccumDays - 1
+		                                                              : findIndexOfEvalDate(date, m_accumDates));
+	return (Size) std::max(0, dateIndex - m_indexOnOrBeforeEval);
+}
+
+// The state is the spot, whether the trade has knocked out and the shares accrued so far in the period,
+// which are only delivered at the period end. So the regressors are {1, x, x^2, a, a x} for the paths still 
+// alive and the same in separate columns for those that have knocked out, with x the spot divided by 
+// today's spot and a the shares accrued in the period divided by the most that could be accrued in it.
+void AccumulatorMCEngine::getRegressors(const Path& path, Size pathIndex, std::vector<Real>& regressors) const
+{
+	// As in simulateDeliveries(..), but only up to the path index.
+	Size period = (pathIndex > 0 ? m_periodIndexOfDate[getDateIndexFromPathIndex(pathIndex)] : m_currentPeriod);
+	Real sharesAccrued = m_sharesDeliveredDueToHistoricalAccumulation[period];
+	Real cashDelivered = 0.0; // not needed
+	bool knockedOut = false;
+	for(Size i = 1; i <= pathIndex && !knockedOut; i++)
+	{
+		Real sharesDelivered = 0.0;
+		knockedOut = oneDaysAccumulation(path.value(i), sharesDelivered, cashDelivered);
+		if(m_periodIndexOfDate[getDateIndexFromPathIndex(i)] == period)
+			sharesAccrued += sharesDelivered;
+	}
+	Real maxSharesInPeriod = m_accumContract->m_sharesPerDay * m_accumContract->m_maxGearingMultiplier
+		                     * (Real)(m_indexOfPeriodEnd[period] + 1 - getIndexOfPeriodStart(period));
+
+	Real x = path.value(pathIndex) / path.value(0);
+	Real a = sharesAccrued / maxSharesInPeriod;
+	regressors.assign(10, 0.0);
+	Size offset = (knockedOut ? 5 : 0);
+	regressors[offset]     = 1.0;
+	regressors[offset + 1] = x;
+	regressors[offset + 2] = x * x;
+	regressors[offset + 3] = a;
+	regressors[offset + 4] = a * x;
+}
+
+// The path only has values on the grid points. Between two grid points the log spot is a Brownian bridge,
+// which we use to get the expected accumulation on the days in between:
+//  (i)  the probability of knocking out on one of the days in between is 
+//       exp( -2 ln(H/S_a) ln(H/S_b) / (vol^2 (t_b - t_a)) ), with H the shifted KO price.
+//       The survival probability on the days in between is interpolated linearly in time.
+//       The grid points themselves are checked against the KO price, as in the daily simulation,
+//       so when the grid points are consecutive days there's no bridge correction and we get operator()(..).
+//  (ii) the probability of gearing on a day in between uses the bridge mean and variance for that day.
+// Rather than stopping the path at the knock-out, we carry a survival weight along the path.
+// The KO and gearing events between grid points are taken to be independent, 
+// so there is a bias compared to the daily simulation. It can be measured with the test rig, 
+// comparing a leg with accumulator_mc_grid set to 'daily' to one with a coarse grid.
+// The grid must include the period ends, see getMandatoryPathIndices(..).
+Real AccumulatorMCEngine::valueOnGrid(const Path& path, const std::vector<Size>& gridPathIndices) const
+{
+	AccumDeliveries deliveries;
+	deliveries.reset(m_sharesDeliveredDueToHistoricalAccumulation, m_cashDeliveredDueToHistoricalAccumulation);
+
+	// The period end prices are picked up as we go along the grid.
+	std::vector<Real> periodEndPrices(m_accumContract->m_numPeriods, 0.0);
+	if( (m_indexOnOrBeforeEval >= 0) 
+		&& ((Size)m_indexOnOrBeforeEval == m_indexOfPeriodEnd[m_currentPeriod]))
+		periodEndPrices[m_currentPeriod] = path.value(0);
+
+	Real extraGearing   = m_accumContract->m_gearingMultiplier - 1.0;
+	Real survivalWeight = 1.0; // probability of no knock-out so far, conditional on the grid values 
+	Real KONotionalPV   = 0.0; // the notional returned on knock-out, see sumPeriodEndContibutions(..)
+
+	for(Size gridIndex = 1; gridIndex < path.length(); gridIndex++)
+	{
+		Size startPathIndex = gridPathIndices[gridIndex - 1];
+		Size endPathIndex   = gridPathIndices[gridIndex];
+		Size endDateIndex   = getDateIndexFromPathIndex(endPathIndex);
+		if(endDateIndex == m_indexOfPeriodEnd[m_periodIndexOfDate[endDateIndex]])
+			periodEndPrices[m_periodIndexOfDate[endDateIndex]] = path.value(gridIndex);
+
+		if(survivalWeight <= 0.0)
+			continue; // knocked out, but we still need the later period end prices.
+
+		Real numDays        = (Real)(endPathIndex - startPathIndex);
+		Real numInnerDays   = numDays - 1.0; // the days strictly between the grid points
+		Real logStart       = std::log(path.value(gridIndex - 1));
+		Real logEnd         = std::log(path.value(gridIndex));
+		Real startWeight    = survivalWeight;
+
+		// The probability of knocking out on one of the inner days, conditional on the grid values.
+		Real crossingProb = 0.0;
+		if(numInnerDays > 0.0)
+		{
+			if(logStart >= m_logShiftedKOPrice)
+				crossingProb = 1.0;
+			else if(logEnd >= m_logShiftedKOPrice) // the bridge crosses, we take the day it does so to be uniform
+				crossingProb = numInnerDays / numDays;
+			else
+				crossingProb = std::exp(-2.0 * (m_logShiftedKOPrice - logStart) * (m_logShiftedKOPrice - logEnd)
+				                        / (m_varianceOfOneDay * numDays));
+		}
+
+		for(Size pathIndex = startPathIndex + 1; pathIndex <= endPathIndex; pathIndex++)
+		{
+			Size dateIndex  = getDateIndexFromPathIndex(pathIndex);
+			Size period     = m_periodIndexOfDate[dateIndex];
+			Real newWeight;
+
+			// As in oneDaysAccumulation(..) the day's accumulation happens before the knock-out check.
+			if(pathIndex == endPathIndex) // the grid point itself, where we know the spot
+			{
+				Real sharesDelivered = 0.0, cashDelivered = 0.0;
+				bool knockedOut = oneDaysAccumulation(path.value(gridIndex), sharesDelivered, cashDelivered);
+				deliveries.m_sharesDelivered[period] += survivalWeight * sharesDelivered;
+				deliveries.m_cashDelivered  [period] += survivalWeight * cashDelivered;
+				newWeight = (knockedOut ? 0.0 : survivalWeight); // the inner days are already in survivalWeight
+			}
+			else
+			{
+				Real fraction    = (Real)(pathIndex - startPathIndex) / numDays;
+				Real probGeared  = 0.0;
+				if(m_accumContract->m_hasGearing)
+				{
+					Real bridgeMean   = logStart + fraction * (logEnd - logStart);
+					Real bridgeStdDev = std::sqrt(m_varianceOfOneDay * numDays * fraction * (1.0 - fraction));
+					probGeared = m_cumNormal((m_logGearingStrike - bridgeMean) / bridgeStdDev);
+				}
+				Real expectedGearing = survivalWeight * (1.0 + extraGearing * probGeared);
+
+				deliveries.m_sharesDelivered[period] += m_accumContract->m_sharesPerDay * expectedGearing;
+				if(m_accumContract->m_subCategory == accumulator_note)
+					deliveries.m_cashDelivered[period] += 
+						  (m_accumContract->m_maxGearingMultiplier * survivalWeight - expectedGearing) 
+						* m_accumContract->m_sharesPerDayTimesStrike;
+				else // is swap form
+					deliveries.m_cashDelivered[period] += - expectedGearing * m_accumContract->m_sharesPerDayTimesStrike;
+
+				newWeight = startWeight * (1.0 - crossingProb * (Real)(pathIndex - startPathIndex) / numInnerDays);
+			}
+
+			if(m_accumContract->m_subCategory == accumulator_swap)
+				KONotionalPV += (survivalWeight - newWeight) * (m_totNumAccumDays - 1 - dateIndex) 
+				                * m_accumContract->m_maxGearingTimesStrike * m_discFactors[period];
+
+			survivalWeight = newWeight;
+		}
+	}
+	// The knock-out notional has already been dealt with via the survival weight.
+	Real pv = KONotionalPV;
+	for(Size period = m_currentPeriod; period < m_accumContract->m_numPeriods; period++)
+	{
+	   pv += m_discFactors[period] * 
+		     ( deliveries.m_sharesDelivered[period] * periodEndPrices[period] 
+		       + deliveries.m_cashDelivered[period] );
+	}
+	return pv;
 }
 
 Real AccumulatorMCEngine::getGearingMultiplier(Real spot) const
@@ -495,6 +765,232 @@ bool AccumulatorMCEngine::oneDaysAccumulation(Real spot,
    return (spot >= m_accumContract->m_KOPrice);
 }
 
+// When the KO price is far above spot, nearly every path survives and the variance comes from the 
+// rare knock-outs. With importance sampling we simulate with the drift shifted up, so that the 
+// knock-outs are sampled more often, and reweight each path with the likelihood ratio:
+//    dQ/dQ' = exp( - lambda * W'(T) - 0.5 * lambda^2 * T )
+// where lambda is the drift shift in units of vol and W' is the Brownian motion of the shifted measure.
+// Since the process is GBM, W'(T) can be recovered from the terminal spot of the path.
+class AccumulatorISPathPricer : public PathPricer<Path>
+{
+private:
+	boost::shared_ptr<AccumulatorMCEngine> m_MCEngine;
+	Real                                   m_lambda;
+	Real                                   m_logSpot;
+	Real                                   m_meanLogReturn; // from now to maturity, under the shifted measure
+	Volatility                             m_vol;
+	Time                                   m_maturity;
+
+	AccumulatorISPathPricer() {}; // don't want this constructor to be used.
+public:
+	AccumulatorISPathPricer(boost::shared_ptr<AccumulatorMCEngine> pMCEngine, Real lambda, Real spot,
+		                    Real meanLogReturn, Volatility vol, Time maturity);
+
+	// returns the present value for given path, times the likelihood ratio.
+	Real operator()(const Path& path) const;
+};
+
+AccumulatorISPathPricer::AccumulatorISPathPricer(boost::shared_ptr<AccumulatorMCEngine> pMCEngine, 
+												 Real lambda, Real spot, Real meanLogReturn, 
+												 Volatility vol, Time maturity)
+{
+	QL_REQUIRE(vol > 0.0, "AccumulatorISPathPricer: vol must be strictly positive, here it is: " << vol);
+
+	m_MCEngine      = pMCEngine;
+	m_lambda        = lambda;
+	m_logSpot       = std::log(spot);
+	m_meanLogReturn = meanLogReturn;
+	m_vol           = vol;
+	m_maturity      = maturity;
+}
+
+Real AccumulatorISPathPricer::operator()(const Path& path) const
+{
+	Real brownianAtMaturity = (std::log(path.back()) - m_logSpot - m_meanLogReturn) / m_vol;
+	Real likelihoodRatio    = std::exp(- m_lambda * brownianAtMaturity - 0.5 * m_lambda * m_lambda * m_maturity);
+
+	return (*m_MCEngine)(path) * likelihoodRatio;
+}
+
+// For importance sampling with the drift shifted by lambda times vol: the process to simulate and the
+// path pricer, which reweights the paths with the likelihood ratio.
+void makeAccumulatorIS(Real                                               lambda, 
+					   const boost::shared_ptr<AccumulatorMCEngine>&      accumMCEngine,
+					   const Handle<Quote>&                               underlyingH,
+					   const Handle<YieldTermStructure>&                  yieldTS,
+					   const Handle<BlackVolTermStructure>&               flatVolTS,
+					   const Date&                                        evalDate,
+					   Rate                                               riskFreeRate,
+					   Rate                                               dividendYield,
+					   Volatility                                         vol,
+					   Time                                               years,
+					   boost::shared_ptr<GeneralizedBlackScholesProcess>& simulationPro,  // output
+					   boost::shared_ptr<PathPricer<Path> >&              pathPricer)     // output
+{
+	Rate shiftedDividendYield = dividendYield - vol * lambda;
+	Handle<YieldTermStructure> shiftedDividendYieldTS(boost::shared_ptr<YieldTermStructure>(
+		 new FlatForward(evalDate, shiftedDividendYield, Actual365Fixed())));
+
+	simulationPro.reset(new BlackScholesMertonProcess(underlyingH, shiftedDividendYieldTS, yieldTS, flatVolTS));
+
+	Real meanLogReturn = (riskFreeRate - shiftedDividendYield - 0.5 * vol * vol) * years;
+	pathPricer.reset(new AccumulatorISPathPricer(accumMCEngine, lambda, underlyingH->value(), meanLogReturn, vol, years));
+}
+
+// The analytic engine gives a fast (semi-analytic) estimate of the accumulator value.
+// It is intended for intraday risk, when running the full MC for every trade is too slow.
+// It uses the same time grid as the MC, i.e. one step of length m_dt per business day,
+// and the same flat-vol BSM inputs.
+// For each future accumulation day we need:
+//   (i)  the probability of not having knocked out on any of the earlier days,
+//        here we use the continuous barrier survival probability with the barrier shifted 
+//        up by exp(0.5826 * vol * sqrt(dt)) (Broadie-Glasserman) to account for the daily monitoring.
+//   (ii) the gearing digitals, i.e. the probability that spot closes below the gearing price.
+// The shares are valued at the period end spot, so for the share leg we use the share measure
+// ( drift: r - q + vol^2/2 ), for the cash leg the risk neutral measure ( drift: r - q - vol^2/2 ).
+// The knock-out and the gearing events are taken to be independent, so the result is an approximation.
+class AccumulatorAnalyticEngine
+{
+private:
+	const AccumulatorMCEngine*    m_MCEngine;  // provides the date, period and discount factor tables
+	AccumulatorContract*          m_accumContract;
+
+	Real                          m_spot;
+	Rate                          m_riskFreeRate;
+	Rate                          m_dividendYield;
+	Volatility                    m_vol;
+	Time                          m_dt;        // the length of one (daily) step
+	Real                          m_shiftedKOPrice;
+
+	CumulativeNormalDistribution  m_cumNormal;
+
+	AccumulatorAnalyticEngine() {}; // don't want this constructor to be used.
+public:
+	AccumulatorAnalyticEngine(const AccumulatorMCEngine* pMCEngine,
+		                      Real spot, Rate riskFreeRate, Rate dividendYield, Volatility vol, Time dt);
+
+	// The probability that there is no knock-out on any of the path indices 1,..,pathIndex.
+	// The logDrift determines the measure, see the comments above the class.
+	Real getSurvivalProbability(Size pathIndex, Real logDrift) const;
+
+	// The probability that the spot at the given path index closes below the strike.
+	Real getProbBelowStrike    (Size pathIndex, Real strike, Real logDrift) const;
+
+	Real getForward            (Size pathIndex) const;
+	Real getPresentValue       ()               const;
+};
+
+AccumulatorAnalyticEngine::AccumulatorAnalyticEngine(const AccumulatorMCEngine* pMCEngine,
+													 Real spot, Rate riskFreeRate, Rate dividendYield, 
+													 Volatility vol, Time dt)
+{
+	QL_REQUIRE(vol > 0.0, "AccumulatorAnalyticEngine: vol must be strictly positive, here it is: " << vol);
+	QL_REQUIRE(dt  > 0.0, "AccumulatorAnalyticEngine: time step must be strictly positive, here it is: " << dt);
+
+	m_MCEngine       = pMCEngine;
+	m_accumContract  = pMCEngine->m_accumContract;
+	m_spot           = spot;
+	m_riskFreeRate   = riskFreeRate;
+	m_dividendYield  = dividendYield;
+	m_vol            = vol;
+	m_dt             = dt;
+
+	// Broadie-Glasserman-Kou continuity correction: beta = - zeta(1/2) / sqrt(2 pi) = 0.5826
+	m_shiftedKOPrice = m_accumContract->m_KOPrice * std::exp(0.5826 * m_vol * std::sqrt(m_dt));
+}
+
+Real AccumulatorAnalyticEngine::getForward(Size pathIndex) const
+{
+	return m_spot * std::exp((m_riskFreeRate - m_dividendYield) * m_dt * (Real) pathIndex);
+}
+
+Real AccumulatorAnalyticEngine::getSurvivalProbability(Size pathIndex, Real logDrift) const
+{
+	if(pathIndex == 0) // no monitoring has yet taken place
+		return 1.0;
+
+	Real logBarrier = std::log(m_shiftedKOPrice / m_spot);
+	if(logBarrier <= 0.0)
+		return 0.0;
+
+	Time t          = m_dt * (Real) pathIndex;
+	Real stdDev     = m_vol * std::sqrt(t);
+	Real prob       = m_cumNormal(( logBarrier - logDrift * t) / stdDev)
+		              - std::exp(2.0 * logDrift * logBarrier / (m_vol * m_vol)) 
+		                * m_cumNormal((-logBarrier - logDrift * t) / stdDev);
+
+	return std::max(0.0, std::min(1.0, prob));
+}
+
+Real AccumulatorAnalyticEngine::getProbBelowStrike(Size pathIndex, Real strike, Real logDrift) const
+{
+	if(strike <= 0.0)
+		return 0.0;
+
+	Time t = m_dt * (Real) pathIndex;
+	if(t <= 0.0)
+		return (m_spot < strike ? 1.0 : 0.0);
+
+	return m_cumNormal((std::log(strike / m_spot) - logDrift * t) / (m_vol * std::sqrt(t)));
+}
+
+Real AccumulatorAnalyticEngine::getPresentValue() const
+{
+	const AccumulatorMCEngine& mc = *m_MCEngine;
+	Real riskNeutralDrift  = m_riskFreeRate - m_dividendYield - 0.5 * m_vol * m_vol;
+	Real shareMeasureDrift = m_riskFreeRate - m_dividendYield + 0.5 * m_vol * m_vol;
+	Real extraGearing      = m_accumContract->m_gearingMultiplier - 1.0;
+
+	// The historical contribution in the current period, the shares are valued at the period end.
+	Real pv = 0;
+	for(Size period = mc.m_currentPeriod; period < m_accumContract->m_numPeriods; period++)
+	{
+		Size periodEndPathIndex = mc.getPathIndexFromDateIndex(mc.m_indexOfPeriodEnd[period]);
+		pv += mc.m_discFactors[period] 
+		      * (  mc.m_sharesDeliveredDueToHistoricalAccumulation[period] * getForward(periodEndPathIndex)
+		         + mc.m_cashDeliveredDueToHistoricalAccumulation[period]);
+	}
+
+	Size numPathIndices = (Size)((Integer)mc.m_totNumAccumDays - mc.m_indexOnOrBeforeEval);
+	Real prevSurvivalRN = getSurvivalProbability(0, riskNeutralDrift);
+	Real prevSurvivalSM = getSurvivalProbability(0, shareMeasureDrift);
+
+	// As in the MC, today's accumulation is dealt with in the historical part, so start at 1.
+	for(Size pathIndex = 1; pathIndex < numPathIndices; pathIndex++)
+	{
+		Size dateIndex          = mc.getDateIndexFromPathIndex(pathIndex);
+		Size period             = mc.m_periodIndexOfDate[dateIndex];
+		Size periodEndPathIndex = mc.getPathIndexFromDateIndex(mc.m_indexOfPeriodEnd[period]);
+
+		// Shares delivered today are valued at the period end spot.
+		Real sharesValue =   m_accumContract->m_sharesPerDay * getForward(periodEndPathIndex) * prevSurvivalSM
+			               * (1.0 + extraGearing * getProbBelowStrike(pathIndex, m_accumContract->m_gearingStrike,
+						                                              shareMeasureDrift));
+
+		Real expectedGearing = prevSurvivalRN 
+			                   * (1.0 + extraGearing * getProbBelowStrike(pathIndex, m_accumContract->m_gearingStrike,
+							                                              riskNeutralDrift));
+		Real cashValue;
+		if(m_accumContract->m_subCategory == accumulator_note)
+			cashValue = (m_accumContract->m_maxGearingMultiplier * prevSurvivalRN - expectedGearing) 
+			            * m_accumContract->m_sharesPerDayTimesStrike;
+		else // is swap form
+			cashValue = - expectedGearing * m_accumContract->m_sharesPerDayTimesStrike;
+
+		pv += mc.m_discFactors[period] * (sharesValue + cashValue);
+
+		// The notional that is returned on knock-out, as in AccumulatorMCEngine::sumPeriodEndContibutions(..)
+		Real survivalRN = getSurvivalProbability(pathIndex, riskNeutralDrift);
+		if(m_accumContract->m_subCategory == accumulator_swap)
+			pv += (prevSurvivalRN - survivalRN) * (mc.m_totNumAccumDays - 1 - dateIndex)
+			      * m_accumContract->m_maxGearingTimesStrike * mc.m_discFactors[period];
+
+		prevSurvivalRN = survivalRN;
+		prevSurvivalSM = getSurvivalProbability(pathIndex, shareMeasureDrift);
+	}
+	return pv;
+}
+
 // The constructor does the work to generate the results.
 AccumulatorCalculator::AccumulatorCalculator(
 	         AccumulatorContract* pAccumContract, MarketCaches* pMarketCaches,
@@ -525,35 +1021,147 @@ AccumulatorCalculator::AccumulatorCalculator(
             new BlackConstantVol(finalAccumDate, *(accumMCEngine->getUndlHolCal()) , stockData->getFlatVol(), Actual365Fixed())));
 
 	//////////////////////////////////////////////////////////////////////
-    boost::shared_ptr<StochasticProcess1D> stochasticPro(new BlackScholesMertonProcess
+    boost::shared_ptr<GeneralizedBlackScholesProcess> stochasticPro(new BlackScholesMertonProcess
 		(underlyingH, dividendYieldTS, yieldTS, flatVolTS));
 
     Size nTimeSteps = accumMCEngine->getNumMCTimeSteps();
-	PseudoRandom::rsg_type rsg = PseudoRandom::make_sequence_generator(
-		                           nTimeSteps, 
-				                   getConfig()->getRandomGeneratorSeed());
-
-    bool brownianBridge = false;
     Time years = (finalAccumDate - pMarketCaches->getEvalDate())/ 365.0;
-    typedef SingleVariate<PseudoRandom>::path_generator_type generator_type;
-
-	boost::shared_ptr<generator_type> myPathGenerator(new
-        generator_type(stochasticPro, years, nTimeSteps, rsg, brownianBridge));
-
-    // a statistics accumulator for the path-dependant Profit&Loss values
-    Statistics statisticsAccumulator;
-    bool antithetic = true;
-    // The Monte Carlo model generates paths using myPathGenerator
-    // each path is priced using myPathPricer
-    // prices will be accumulated into statisticsAccumulator
-    MonteCarloModel<SingleVariate,PseudoRandom> MCSimulation(myPathGenerator, accumMCEngine,
-                                                             statisticsAccumulator, antithetic );
-    
-    MCSimulation.addSamples(atoi(getConfig()->get("accumulator_num_mc_samples").c_str()));
-    
-    Real cashValue     = MCSimulation.sampleAccumulator().mean();
-	Real errorEstimate = MCSimulation.sampleAccumulator().errorEstimate() / accumMCEngine->getRemainingNotional(); 
-	writeDiagnostics("Error estimate is " + toString(errorEstimate), mid, "Accum");
+
+	// The config can choose between the Monte Carlo engine ('mc'), the multilevel Monte Carlo ('mlmc') 
+	// and the semi-analytic engine ('fast').
+	// When the accumulator_engine is not set in the config we use the Monte Carlo.
+	std::string engineType = "mc";
+	getConfig()->find("accumulator_engine", engineType);
+	QL_REQUIRE((engineType == "mc") || !isExposureModeOn(), "AccumulatorCalculator: The exposure profile is "
+		       "regressed on the MC paths, so exposure_mode 'on' needs the accumulator_engine 'mc'.");
+
+	// When exposure_mode is 'on', it keeps the exposure data of the MC paths as they are priced.
+	boost::shared_ptr<ExposureCollector> exposureCollector;
+
+	Real cashValue;
+	Real errorEstimate = Null<Real>(); // of the price per unit notional, from the 'mc' engine
+	if(engineType == "fast")
+	{
+		Rate riskFreeRate = yieldTS->zeroRate(finalAccumDate, Actual365Fixed(), Continuous, NoFrequency);
+
+		AccumulatorAnalyticEngine analyticEngine(&(*accumMCEngine), prices->getCurrentPrice(), riskFreeRate,
+			                                     stockData->getDividendYield(), stockData->getFlatVol(),
+												 years / (Real) nTimeSteps);
+		cashValue = analyticEngine.getPresentValue();
+	}
+	else if(engineType == "mlmc")
+	{
+		accumMCEngine->setMCGrid("daily", stockData->getFlatVol(), years / (Real) nTimeSteps);
+		cashValue = getMultilevelMCValue(accumMCEngine, stochasticPro, years, nTimeSteps, 
+			                             accumMCEngine->getRemainingNotional(), pAccumContract->getID());
+	}
+	else if(engineType == "mc")
+	{
+		// The MC can simulate every business day ('daily', the default) or on a coarser grid, 
+		// i.e. 'weekly' or 'period_end', with the days in between dealt with by the Brownian bridge.
+		std::string gridType = "daily";
+		getConfig()->find("accumulator_mc_grid", gridType);
+		accumMCEngine->setMCGrid(gridType, stockData->getFlatVol(), years / (Real) nTimeSteps);
+		const std::vector<Size>& gridPathIndices = accumMCEngine->getMCGridPathIndices();
+
+		// The path generator uses drift and diffusion tables precomputed for the time grid,
+		// rather than going through the term structures at each step, see FrozenGBMPathGenerator.
+		TimeGrid timeGrid(years, nTimeSteps);
+		if( !gridPathIndices.empty())
+		{
+			std::vector<Time> gridTimes; // the TimeGrid will add on time zero
+			for(Size gridIndex = 1; gridIndex < gridPathIndices.size(); gridIndex++)
+				gridTimes.push_back(years * (Real) gridPathIndices[gridIndex] / (Real) nTimeSteps);
+
+			timeGrid = TimeGrid(gridTimes.begin(), gridTimes.end());
+		}
+
+		// With accumulator_importance_sampling set to 'auto', we consider importance sampling when the KO price
+		// is more than accumulator_is_threshold standard deviations above spot, see AccumulatorISPathPricer.
+		boost::shared_ptr<GeneralizedBlackScholesProcess> simulationPro = stochasticPro;
+		boost::shared_ptr<PathPricer<Path> >   pathPricer    = accumMCEngine;
+
+		std::string importanceSampling = "off";
+		getConfig()->find("accumulator_importance_sampling", importanceSampling);
+		if(importanceSampling == "auto")
+		{
+			std::string thresholdStr = "2.0", pilotSamplesStr = "1000";
+			getConfig()->find("accumulator_is_threshold",     thresholdStr);
+			getConfig()->find("accumulator_is_pilot_samples", pilotSamplesStr);
+
+			Real       spot          = prices->getCurrentPrice();
+			Volatility vol           = stockData->getFlatVol();
+			Rate       dividendYield = stockData->getDividendYield();
+			Real       logDistToKO   = std::log(pAccumContract->m_KOPrice / spot);
+			Rate       riskFreeRate  = - std::log(yieldTS->discount(years)) / years;
+
+			// the shift under which the expected log spot reaches the KO at maturity
+			Real lambdaToKO = (logDistToKO / years - (riskFreeRate - dividendYield - 0.5 * vol * vol)) / vol;
+
+			if( (logDistToKO > atof(thresholdStr.c_str()) * vol * std::sqrt(years)) && (lambdaToKO > 0.0))
+			{
+				// The KO is monitored daily, so the shift moves the whole path, not just the knock-out, and when 
+				// most of the variance comes from the share leg the likelihood ratio can add to it. So lambda is
+				// chosen by the variance of short pilot runs, on their own random stream: of no shift and 
+				// a quarter, half, three quarters and all of lambdaToKO, the one with the smallest error.
+				Size numPilotSamples = atoi(pilotSamplesStr.c_str());
+				const Size numFractions = 4;
+				Real lambda = 0.0;
+				Real smallestError = getMonteCarloStatistics(stochasticPro, timeGrid, accumMCEngine, numPilotSamples,
+					                                         pAccumContract->getID() + "_is_pilot").errorEstimate();
+				for(Size fraction = 1; fraction <= numFractions; fraction++)
+				{
+					Real pilotLambda = lambdaToKO * (Real) fraction / (Real) numFractions;
+					boost::shared_ptr<GeneralizedBlackScholesProcess> pilotPro;
+					boost::shared_ptr<PathPricer<Path> >              pilotPricer;
+					makeAccumulatorIS(pilotLambda, accumMCEngine, underlyingH, yieldTS, flatVolTS, pMarketCaches->getEvalDate(),
+						              riskFreeRate, dividendYield, vol, years, pilotPro, pilotPricer);
+					Real pilotError = getMonteCarloStatistics(pilotPro, timeGrid, pilotPricer, numPilotSamples,
+						                                      pAccumContract->getID() + "_is_pilot").errorEstimate();
+					writeDiagnostics("Importance sampling pilot with the drift shifted by " + toString(pilotLambda) 
+						             + " times vol has error " + toString(pilotError), high, "Accum");
+					if(pilotError < smallestError)
+					{
+						smallestError = pilotError;
+						lambda        = pilotLambda;
+					}
+				}
+
+				if(lambda > 0.0)
+				{
+					makeAccumulatorIS(lambda, accumMCEngine, underlyingH, yieldTS, flatVolTS, pMarketCaches->getEvalDate(),
+						              riskFreeRate, dividendYield, vol, years, simulationPro, pathPricer);
+					writeDiagnostics("Using importance sampling with the drift shifted by " + toString(lambda)
+						             + " times vol.", mid, "Accum");
+				}
+				else
+					writeDiagnostics("Not using importance sampling, no drift shift lowered the pilot's error.", mid, "Accum");
+			}
+		}
+		else if(importanceSampling != "off")
+			QL_FAIL("AccumulatorCalculator: Unrecognised accumulator_importance_sampling in the config: " 
+			        << importanceSampling << ".\nCould try 'off' or 'auto'.");
+
+		if(isExposureModeOn())
+		{
+			QL_REQUIRE(gridPathIndices.empty() && (simulationPro == stochasticPro), "AccumulatorCalculator: The "
+				       "exposure profile is regressed on the daily MC paths, so exposure_mode 'on' needs the "
+					   "accumulator_mc_grid 'daily' and no importance sampling.");
+			exposureCollector.reset(new ExposureCollector(pathPricer, accumMCEngine, pMarketCaches->getEvalDate(), 
+				                                          nTimeSteps));
+			pathPricer = exposureCollector;
+		}
+		Statistics statistics = getMonteCarloStatistics(simulationPro, timeGrid, pathPricer, 
+			                          atoi(getConfig()->get("accumulator_num_mc_samples").c_str()),
+									  pAccumContract->getID());
+	    
+		cashValue     = statistics.mean();
+		errorEstimate = statistics.errorEstimate() / accumMCEngine->getRemainingNotional(); 
+		writeDiagnostics("Error estimate is " + toString(errorEstimate), mid, "Accum");
+	}
+	else
+		QL_FAIL("AccumulatorCalculator: Unrecognised accumulator_engine in the config: " << engineType
+		        << ".\nCould try 'mc', 'mlmc' or 'fast'.");
     
 	/////////////////////////////////////////////////////////////////////////////
 	// populate results
@@ -570,5 +1178,16 @@ AccumulatorCalculator::AccumulatorCalculator(
 	cashValRes->setAttribute(currency, accumMCEngine->getCurrency(), true);
 	cashValRes->setValueAndCategory(cash_price, cashValue);
     pResultSet->addNewResult(cashValRes);
+
+	if(errorEstimate != Null<Real>())
+	{
+		boost::shared_ptr<Result> errorRes = (boost::shared_ptr<Result>) new Result(*perUnitValRes);
+		errorRes->setValueAndCategory(mc_error_estimate, errorEstimate);
+		pResultSet->addNewResult(errorRes);
+	}
+
+	// When the exposure_mode is 'on' in the config, adds the exposure profile results.
+	if(exposureCollector)
+		exposureCollector->addExposureResults(stochasticPro, 1.0, pAccumContract->getID(), *cashValRes, pResultSet);
 }
 
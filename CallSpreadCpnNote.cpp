@@ -1,6 +1,7 @@
 #include "CallSpreadCpnNote.hpp"
 #include "MarketData.hpp"
 #include "Result.hpp"
+#include "TreeEngines.hpp"
 
 CallSpreadCoupon::CallSpreadCoupon()
 {
@@ -60,6 +61,62 @@ Real CallSpreadCoupon::getCouponRate(Real spot) const // will throw if uninitial
 	return cpnRate;
 }
 
+void CallSpreadCoupon::addCouponPayments(const Array& spots, Real accrualFraction, Array& values) const
+{   // Same coupon as getCouponRate(.), but the initialization check and the cap/floor decisions
+	// are made once. An inactive cap or floor becomes an unreachable bound, so each node is a
+	// plain clamp which the compiler can turn into min/max instructions and vectorize.
+	QL_REQUIRE(m_initialized, "CallSpreadCoupon::addCouponPayments(...):"
+		                      << "\nCan't get coupon rate when CallSpreadCoupon has not been initialized.");
+	QL_REQUIRE(spots.size() == values.size(), "CallSpreadCoupon::addCouponPayments(...): have "
+		       << spots.size() << " spots but " << values.size() << " values.");
+
+	const Real  lower  = m_floorIsActive ? m_floor : -QL_MAX_REAL;
+	const Real  upper  = m_capIsActive   ? m_cap   :  QL_MAX_REAL;
+	const Real  factor = m_factor;
+	const Real  strike = m_strike;
+	const Real* spot   = spots.begin();
+	Real*       value  = values.begin();
+	const Size  size   = values.size();
+
+	for(Size j = 0; j < size; j++)
+	{
+		Real cpnRate = spot[j] * factor - strike;
+		cpnRate   = cpnRate < lower ? lower : cpnRate;
+		cpnRate   = cpnRate > upper ? upper : cpnRate;
+		value[j] += cpnRate * accrualFraction;
+	}
+}
+
+void CallSpreadCoupon::getCouponSlopes(const Array& spots, Real accrualFraction, Array& slopes) const
+{
+	QL_REQUIRE(m_initialized, "CallSpreadCoupon::getCouponSlopes(...):"
+		                      << "\nCan't get coupon slopes when CallSpreadCoupon has not been initialized.");
+
+	const Real lower = m_floorIsActive ? m_floor : -QL_MAX_REAL;
+	const Real upper = m_capIsActive   ? m_cap   :  QL_MAX_REAL;
+	const Real slope = m_factor * accrualFraction;
+	slopes = Array(spots.size());
+	for(Size j = 0; j < spots.size(); j++)
+	{
+		Real cpnRate = spots[j] * m_factor - m_strike;
+		slopes[j] = (cpnRate > lower && cpnRate < upper) ? slope : 0.0;
+	}
+}
+
+void CallSpreadCoupon::getCriticalSpots(std::vector<Real>& criticalSpots) const
+{
+	QL_REQUIRE(m_initialized, "CallSpreadCoupon::getCriticalSpots(.):"
+		                      << "\nCan't get critical spots when CallSpreadCoupon has not been initialized.");
+	if(m_factor == 0.0)
+		return; // fixed coupon, no kinks
+
+	// spot * factor - strike == floor (or cap)
+	if(m_floorIsActive && (m_floor + m_strike) / m_factor > 0.0)
+		criticalSpots.push_back((m_floor + m_strike) / m_factor);
+	if(m_capIsActive   && (m_cap   + m_strike) / m_factor > 0.0)
+		criticalSpots.push_back((m_cap   + m_strike) / m_factor);
+}
+
 CallSpreadCpnNoteContract::CallSpreadCpnNoteContract(const boost::property_tree::ptree &parentTree)
     : Contract( call_spread_cpn_note, pt_get<std::string>(parentTree, "contract_id"))
 {
@@ -68,6 +125,7 @@ CallSpreadCpnNoteContract::CallSpreadCpnNoteContract(const boost::property_tree:
 	m_startDate          = pt_getDate         (pTree, "start_date");
 	m_finalObsDate       = pt_getDate         (pTree, "final_obs_date");
 	m_rebate             = pt_get<Real>       (pTree, "rebate_per_unit_notional");
+	m_notional           = pt_get_optional<Real>(pTree, "notional", 1.0);
 	m_monthsPerPeriod    = pt_get<Size>       (pTree, "months_per_period");
 	m_underlyingType     = pt_get<std::string>(pTree, "underlying_type"); 
 	m_accCcy             = pt_get<std::string>(pTree, "accounting_currency"); // aka payout currency
@@ -77,6 +135,14 @@ CallSpreadCpnNoteContract::CallSpreadCpnNoteContract(const boost::property_tree:
 	m_issuerID           = pt_get<std::string>(pTree, "issuer_id");       // will use issuer's credit spread
 	m_issuerIDType       = pt_get<std::string>(pTree, "issuer_id_type");
 
+	// The engine can be chosen per contract, otherwise we use the config's choice, otherwise the tree.
+	std::string defaultEngine = "tree";
+	getConfig()->find("call_spread_cpn_note_engine", defaultEngine);
+	m_pricingEngine      = pt_get_optional<std::string>(pTree, "pricing_engine", defaultEngine);
+	QL_REQUIRE(m_pricingEngine == "tree" || m_pricingEngine == "pde",
+		       "CallSpreadCpnNoteContract: unrecognised pricing_engine: " << m_pricingEngine
+			   << " for contract " << getID() << ".\nCould try 'tree' or 'pde'.");
+
 	if(m_isCallable)
 	{   // In the xml there is a counting base of 1, in the calculator we use base 0, hence the '- 1'
 		m_firstPeriodIssuersCallIsActive = pt_get<Integer>(pTree, "first_period_issuers_call_active");
@@ -194,6 +260,19 @@ public:
 	void setCurrentSpot();
 	Size getIndexOfRawCouponSpec(Size period);
 
+	// The market data used by both the tree and the PDE, see getMarketInputs().
+	struct MarketInputs
+	{
+		Handle<YieldTermStructure>    yieldTSAccCcy;
+		Handle<YieldTermStructure>    yieldTSUndlCcy;
+		Handle<BlackVolTermStructure> fxVolTS;
+		Real                          creditSpread; // the issuer's
+		Volatility                    vol;          // to the final period end, at the current spot
+		Rate                          riskFreeRate; // continuous zero rate to the final period end
+		Rate                          q;            // the same for the underlying currency
+	};
+	MarketInputs getMarketInputs() const;
+
 public:
 	std::vector<Date>              m_periodEndDates;
 	Size                           m_numPeriods;
@@ -204,13 +283,33 @@ public:
 	
 	boost::optional<Real>          m_npv;  // net present value
 
+	boost::optional<Real>          m_delta; // dV/dS per unit notional
+	boost::optional<Real>          m_gamma; // d2V/dS2 per unit notional
+
+	// per unit notional, only set by the tree with call_spread_cpn_note_sensitivities 'on'
+	boost::optional<Real>          m_vega;
+	boost::optional<Real>          m_rho;             // to the accounting currency's rate
+	boost::optional<Real>          m_dividendRho;     // to the underlying currency's rate
+	boost::optional<Real>          m_creditSpreadRho; // to the issuer's credit spread
+
+	boost::optional<Size>          m_treeTimeStepsUsed; // only set with call_spread_cpn_note_adaptive_steps 'on'
+
 	CallSpreadCpnNoteInstrument(CallSpreadCpnNoteContract* pCSCNC, MarketCaches* pMarketCaches);
 
 	Real getPayoffAtMaturity()                    const;
 	Real getPaymentIfCalled()                     const;
 	Real getCouponPayment(Size period, Real spot) const;
+	void addCouponPayments(Size period, const Array& spots, Array& values) const;
+	void getCouponSlopes(Size period, const Array& spots, Array& slopes) const;
+
+	// For each step of the time grid, the range [first, second) of future periods (i.e. counting from
+	// m_currentPeriod) that end on that step. The grid's time is timeShift ahead of the real time.
+	void getFuturePeriodsOfSteps(const TimeGrid& timeGrid, Time timeShift,
+		                         std::vector<std::pair<Size, Size> >& futurePeriodsOfStep) const;
 	Real getNPV()                                 const;
 	void Calculate(); // will calc the NPV
+	void CalculateOnTree(); 
+	void CalculateByPDE(); // also sets m_delta and m_gamma
 };
 
 class DiscretizedCSCN : public DiscretizedAsset
@@ -219,10 +318,14 @@ private:
 	CallSpreadCpnNoteInstrument *m_CSCNI;
     boost::shared_ptr<GeneralizedBlackScholesProcess> m_process;
 	std::vector<Time> m_adjustedPeriodEndTimes; // future only, on the grid
+	// for each step of the time grid, the range [first, second) of future periods ending on that step
+	std::vector<std::pair<Size, Size> > m_futurePeriodsOfStep;
 public:
+	// The lattice's time is timeShift ahead of the real time, i.e. the lattice starts timeShift before today.
 	DiscretizedCSCN(CallSpreadCpnNoteInstrument*                       pCSCNI, 
                     boost::shared_ptr<GeneralizedBlackScholesProcess>  process,
-				    const TimeGrid&                                    timeGrid);
+				    const TimeGrid&                                    timeGrid,
+					Time                                               timeShift = 0.0);
 
 	void reset(Size size); // set the payments at maturity
 
@@ -232,13 +335,11 @@ public:
 };
 
 void DiscretizedCSCN::postAdjustValuesImpl()
-{
-    for (Size futurePeriod = 0; futurePeriod < m_adjustedPeriodEndTimes.size(); futurePeriod++) 
-	{
-        if (isOnTime(m_adjustedPeriodEndTimes[futurePeriod]))
-           dealWithPeriodEndDate(futurePeriod);
-    }
-
+{   // direct lookup of the periods ending on this step, rather than testing every period with isOnTime(.)
+	Size step = method()->timeGrid().closestIndex(time());
+	for (Size futurePeriod  = m_futurePeriodsOfStep[step].first; 
+		      futurePeriod  < m_futurePeriodsOfStep[step].second; futurePeriod++) 
+        dealWithPeriodEndDate(futurePeriod);
 }	
 
 void DiscretizedCSCN::dealWithPeriodEndDate(Size futurePeriod)
@@ -248,22 +349,25 @@ void DiscretizedCSCN::dealWithPeriodEndDate(Size futurePeriod)
 
     Array underlyingPrices = method()->grid(time());
 	Size period = futurePeriod + m_CSCNI->m_currentPeriod;
-    for (Size j=0; j<values_.size(); j++) 
-	{
-		// we make the decision whether or not to call the instrument 
-		// before we add the coupon payment to the continuation value.
-		// i.e. here time is going backwards.
-		// In the real world when time goes forward,
-		// we pay the coupon first, then make the decision about whether
-		// or not to call.
 
-		if(m_CSCNI->m_CSCNC->isCallable(period)) // we have an issuer's call
-		   values_[j] = std::min(m_CSCNI->m_CSCNC->m_rebate, values_[j]); 
-		// else  don't have issuer's call so leave values as it is
+	// we make the decision whether or not to call the instrument 
+	// before we add the coupon payment to the continuation value.
+	// i.e. here time is going backwards.
+	// In the real world when time goes forward,
+	// we pay the coupon first, then make the decision about whether
+	// or not to call.
+	// Both decisions are per period, so they are made once here, outside the node loops.
+
+	if(m_CSCNI->m_CSCNC->isCallable(period)) // we have an issuer's call
+	{
+		const Real rebate = m_CSCNI->m_CSCNC->m_rebate;
+		Real*      value  = values_.begin();
+		for (Size j=0; j<values_.size(); j++) 
+		    value[j] = value[j] > rebate ? rebate : value[j]; 
+	}
+	// else  don't have issuer's call so leave values as it is
 
-	    Real couponPayment = m_CSCNI->getCouponPayment(period, underlyingPrices[j]);
-		values_[j] = couponPayment + values_[j]; // pay the coupon
-	}	 
+	m_CSCNI->addCouponPayments(period, underlyingPrices, values_); // pay the coupon
 }
 
 std::vector<Time> DiscretizedCSCN::mandatoryTimes() const 
@@ -280,18 +384,497 @@ void DiscretizedCSCN::reset(Size size)
 
 DiscretizedCSCN::DiscretizedCSCN(CallSpreadCpnNoteInstrument*                       pCSCNI, 
                                  boost::shared_ptr<GeneralizedBlackScholesProcess>  process,
-								 const TimeGrid&                                    timeGrid) 
+								 const TimeGrid&                                    timeGrid,
+								 Time                                               timeShift) 
 {
 	m_CSCNI   = pCSCNI;
 	m_process = process;
 
 	for(Size period = m_CSCNI->m_currentPeriod; period < m_CSCNI->m_numPeriods; period++)
 	{
-		Time unadjustedPeriodEnd = (m_CSCNI->m_periodEndDates[period] - m_CSCNI->m_evalDate)/365.0;
+		Time unadjustedPeriodEnd = (m_CSCNI->m_periodEndDates[period] - m_CSCNI->m_evalDate)/365.0 + timeShift;
 		m_adjustedPeriodEndTimes.push_back( timeGrid.closestTime(unadjustedPeriodEnd));
 	}
+	m_CSCNI->getFuturePeriodsOfSteps(timeGrid, timeShift, m_futurePeriodsOfStep);
+}
+
+void CallSpreadCpnNoteInstrument::getFuturePeriodsOfSteps(const TimeGrid& timeGrid, Time timeShift,
+														  std::vector<std::pair<Size, Size> >& futurePeriodsOfStep) const
+{
+	// no periods end on a step unless set below
+	futurePeriodsOfStep.assign(timeGrid.size(), std::pair<Size, Size>(0, 0));
+
+	for(Size period = m_currentPeriod; period < m_numPeriods; period++)
+	{
+		// period end dates are increasing, so the periods on any one step are contiguous
+		Time periodEnd    = (m_periodEndDates[period] - m_evalDate)/365.0 + timeShift;
+		Size futurePeriod = period - m_currentPeriod;
+		Size step         = timeGrid.closestIndex(periodEnd);
+		if(futurePeriodsOfStep[step].first == futurePeriodsOfStep[step].second)
+			futurePeriodsOfStep[step].first = futurePeriod;
+		futurePeriodsOfStep[step].second    = futurePeriod + 1;
+	}
+}
+
+// Crank-Nicolson solution of the Black-Scholes PDE in x = ln(spot), with constant coefficients 
+// matching the tree (i.e. discounting at the risk free rate plus the issuer's credit spread).
+// The space grid is non-uniform, concentrated around the spot and the coupons' caps and floors.
+// Each coupon date is a discontinuity in the payoff's derivatives, so the first
+// m_rannacherSteps steps after each one are replaced by two fully implicit half steps.
+class CallSpreadCpnNotePDEEngine
+{
+private:
+	CallSpreadCpnNoteInstrument*         m_CSCNI;
+	Real                                 m_spot;
+	Volatility                           m_vol;
+	Rate                                 m_drift;        // r - q, of the underlying
+	Rate                                 m_discountRate; // r + credit spread
+	Size                                 m_timeSteps;
+	Size                                 m_spaceSteps;
+	Size                                 m_rannacherSteps;
+
+	std::vector<Real>                    m_x;            // ln(spot) grid
+	Array                                m_spots;        // exp(m_x)
+	std::vector<Real>                    m_lower, m_diag, m_upper; // the operator L on the interior nodes
+	Size                                 m_spotIndex;    // m_x[m_spotIndex] == ln(m_spot)
+
+	Real                                 m_value;
+	Real                                 m_delta;
+	Real                                 m_gamma;
+
+	void buildSpaceGrid(const std::vector<Real>& criticalSpots);
+	void buildOperator();
+	void takeStep(Array& values, Time dt, Real theta) const; // from t to t - dt
+	void dealWithPeriodEndDate(Size period, Array& values) const;
+public:
+	CallSpreadCpnNotePDEEngine(CallSpreadCpnNoteInstrument* pCSCNI,   Real spot, 
+		                       Volatility vol, Rate drift, Rate discountRate,
+							   Size timeSteps, Size spaceSteps, Size rannacherSteps);
+	void calculate();
+
+	Real getValue() const { return m_value; }
+	Real getDelta() const { return m_delta; }
+	Real getGamma() const { return m_gamma; }
+};
+
+CallSpreadCpnNotePDEEngine::CallSpreadCpnNotePDEEngine(CallSpreadCpnNoteInstrument* pCSCNI,   Real spot, 
+													   Volatility vol, Rate drift, Rate discountRate,
+													   Size timeSteps, Size spaceSteps, Size rannacherSteps)
+{
+	m_CSCNI          = pCSCNI;
+	m_spot           = spot;
+	m_vol            = vol;
+	m_drift          = drift;
+	m_discountRate   = discountRate;
+	m_timeSteps      = timeSteps;
+	m_spaceSteps     = spaceSteps;
+	m_rannacherSteps = rannacherSteps;
+
+	QL_REQUIRE(m_spaceSteps >= 10, "CallSpreadCpnNotePDEEngine: need at least 10 space steps, have " << m_spaceSteps);
+	QL_REQUIRE(m_vol > 0.0,        "CallSpreadCpnNotePDEEngine: need a positive volatility, have " << m_vol);
+}
+
+namespace
+{
+	inline Real arcSinh(Real z) { return std::log(z + std::sqrt(z * z + 1.0)); }
+}
+
+void CallSpreadCpnNotePDEEngine::buildSpaceGrid(const std::vector<Real>& criticalSpots)
+{
+	// The node density is proportional to 1 + sum_k c / sqrt(1 + ((x - x_k)/w)^2), where the x_k are
+	// the log critical spots. Its integral, F(x), is known in closed form so the nodes are placed
+	// where F takes equally spaced values.
+	const Real numStdDevs  = 6.0;
+	const Real intensity   = 4.0;  // c, how much denser the grid is at a critical spot
+	const Real widthRatio  = 0.05; // w as a fraction of the width of the grid
+
+	Time maturity   = (m_CSCNI->m_periodEndDates[m_CSCNI->m_numPeriods-1] - m_CSCNI->m_evalDate)/365.0;
+	Real halfWidth  = numStdDevs * m_vol * std::sqrt(std::max(maturity, 1.0/365.0));
+	Real x0         = std::log(m_spot);
+	Real xMin       = x0 - halfWidth;
+	Real xMax       = x0 + halfWidth;
+	Real w          = widthRatio * (xMax - xMin);
+
+	std::vector<Real> centres(1, x0);
+	for(Size i = 0; i < criticalSpots.size(); i++)
+	{
+		Real xc = std::log(criticalSpots[i]);
+		if(xc > xMin && xc < xMax)
+			centres.push_back(xc);
+	}
+	// many periods share the same caps and floors, we only want to concentrate once per point
+	std::sort(centres.begin(), centres.end());
+	std::vector<Real> uniqueCentres;
+	for(Size i = 0; i < centres.size(); i++)
+		if(uniqueCentres.empty() || centres[i] - uniqueCentres.back() > 0.1 * w)
+			uniqueCentres.push_back(centres[i]);
+
+	Size numNodes = m_spaceSteps + 1;
+	m_x.resize(numNodes);
+	Real FMax = 0.0;
+	for(Size k = 0; k < uniqueCentres.size(); k++)
+		FMax += intensity * w * (arcSinh((xMax - uniqueCentres[k])/w) - arcSinh((xMin - uniqueCentres[k])/w));
+	FMax += xMax - xMin;
+
+	m_x[0]          = xMin;
+	m_x[numNodes-1] = xMax;
+	for(Size i = 1; i < numNodes-1; i++)
+	{   // F is increasing, so bisect for F(x) == target
+		Real target = FMax * (Real) i / (Real) (numNodes-1);
+		Real lo = m_x[i-1], hi = xMax;
+		for(Size iter = 0; iter < 100 && hi - lo > 1e-12; iter++)
+		{
+			Real mid = 0.5 * (lo + hi);
+			Real F   = mid - xMin;
+			for(Size k = 0; k < uniqueCentres.size(); k++)
+				F += intensity * w * (arcSinh((mid - uniqueCentres[k])/w) - arcSinh((xMin - uniqueCentres[k])/w));
+			if(F < target)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		m_x[i] = 0.5 * (lo + hi);
+	}
+
+	// shift the grid so that the current spot is exactly on a node, that is where we read the results
+	m_spotIndex = 1;
+	for(Size i = 1; i < numNodes-1; i++)
+		if(std::fabs(m_x[i] - x0) < std::fabs(m_x[m_spotIndex] - x0))
+			m_spotIndex = i;
+	Real shift = x0 - m_x[m_spotIndex];
+	m_spots = Array(numNodes);
+	for(Size i = 0; i < numNodes; i++)
+	{
+		m_x[i]    += shift;
+		m_spots[i] = std::exp(m_x[i]);
+	}
+}
+
+void CallSpreadCpnNotePDEEngine::buildOperator()
+{   // L V = mu V_x + 0.5 sigma^2 V_xx - R V,  with three point differences on the non-uniform grid
+	Real mu        = m_drift - 0.5 * m_vol * m_vol;
+	Real halfSigSq = 0.5 * m_vol * m_vol;
+	Size numNodes  = m_x.size();
+	m_lower.assign(numNodes, 0.0);
+	m_diag .assign(numNodes, 0.0);
+	m_upper.assign(numNodes, 0.0);
+	for(Size i = 1; i < numNodes-1; i++)
+	{
+		Real hm = m_x[i]   - m_x[i-1];
+		Real hp = m_x[i+1] - m_x[i];
+		m_lower[i] = mu * (-hp / (hm * (hm + hp)))     + halfSigSq * 2.0 / (hm * (hm + hp));
+		m_diag [i] = mu * ((hp - hm) / (hm * hp))      - halfSigSq * 2.0 / (hm * hp)         - m_discountRate;
+		m_upper[i] = mu * (hm / (hp * (hm + hp)))      + halfSigSq * 2.0 / (hp * (hm + hp));
+	}
+}
+
+void CallSpreadCpnNotePDEEngine::takeStep(Array& values, Time dt, Real theta) const
+{   // (I - theta dt L) V(t - dt) = (I + (1 - theta) dt L) V(t)
+	// with V linear in x at both ends of the grid, which keeps the system tridiagonal.
+	Size n = values.size();
+	std::vector<Real> rhs(n), a(n), b(n), c(n);
+	for(Size i = 1; i < n-1; i++)
+	{
+		rhs[i] = values[i] + (1.0 - theta) * dt * 
+			     (m_lower[i] * values[i-1] + m_diag[i] * values[i] + m_upper[i] * values[i+1]);
+		a[i]   =     - theta * dt * m_lower[i];
+		b[i]   = 1.0 - theta * dt * m_diag[i];
+		c[i]   =     - theta * dt * m_upper[i];
+	}
+	// V_0 = (1 - e0) V_1 + e0 V_2  and  V_n-1 = (1 - eN) V_n-2 + eN V_n-3
+	Real e0 = (m_x[0]   - m_x[1])   / (m_x[2]   - m_x[1]);
+	Real eN = (m_x[n-1] - m_x[n-2]) / (m_x[n-3] - m_x[n-2]);
+	b[1]   += a[1]   * (1.0 - e0);
+	c[1]   += a[1]   * e0;
+	b[n-2] += c[n-2] * (1.0 - eN);
+	a[n-2] += c[n-2] * eN;
+
+	// Thomas algorithm over the interior nodes
+	for(Size i = 2; i < n-1; i++)
+	{
+		Real m  = a[i] / b[i-1];
+		b[i]   -= m * c[i-1];
+		rhs[i] -= m * rhs[i-1];
+	}
+	values[n-2] = rhs[n-2] / b[n-2];
+	for(Size i = n-3; i >= 1; i--)
+		values[i] = (rhs[i] - c[i] * values[i+1]) / b[i];
+
+	values[0]   = (1.0 - e0) * values[1]   + e0 * values[2];
+	values[n-1] = (1.0 - eN) * values[n-2] + eN * values[n-3];
+}
+
+void CallSpreadCpnNotePDEEngine::dealWithPeriodEndDate(Size period, Array& values) const
+{   // as in DiscretizedCSCN, time is going backwards so we make the call decision before paying the coupon
+	if(m_CSCNI->m_CSCNC->isCallable(period))
+	{
+		const Real rebate = m_CSCNI->m_CSCNC->m_rebate;
+		for(Size j = 0; j < values.size(); j++)
+			values[j] = values[j] > rebate ? rebate : values[j];
+	}
+	m_CSCNI->addCouponPayments(period, m_spots, values);
+}
+
+void CallSpreadCpnNotePDEEngine::calculate()
+{
+	std::vector<Time> periodEndTimes;
+	std::vector<Real> criticalSpots;
+	for(Size period = m_CSCNI->m_currentPeriod; period < m_CSCNI->m_numPeriods; period++)
+	{
+		periodEndTimes.push_back((m_CSCNI->m_periodEndDates[period] - m_CSCNI->m_evalDate)/365.0);
+		m_CSCNI->m_coupons[period].getCriticalSpots(criticalSpots);
+	}
+
+	TimeGrid timeGrid(periodEndTimes.begin(), periodEndTimes.end(), m_timeSteps);
+	std::vector<std::pair<Size, Size> > periodsOfStep;
+	m_CSCNI->getFuturePeriodsOfSteps(timeGrid, 0.0, periodsOfStep);
+
+	buildSpaceGrid(criticalSpots);
+	buildOperator();
+
+	Size lastStep = timeGrid.size() - 1;
+	Array values(m_x.size(), m_CSCNI->m_CSCNC->m_rebate);
+	for(Size futurePeriod = periodsOfStep[lastStep].first; futurePeriod < periodsOfStep[lastStep].second; futurePeriod++)
+		dealWithPeriodEndDate(futurePeriod + m_CSCNI->m_currentPeriod, values);
+
+	Size smoothingStepsLeft = m_rannacherSteps;
+	for(Size step = lastStep; step > 0; step--)
+	{
+		Time dt = timeGrid.dt(step-1);
+		if(smoothingStepsLeft > 0)
+		{
+			takeStep(values, 0.5 * dt, 1.0);
+			takeStep(values, 0.5 * dt, 1.0);
+			smoothingStepsLeft--;
+		}
+		else
+			takeStep(values, dt, 0.5);
+
+		if(periodsOfStep[step-1].first != periodsOfStep[step-1].second)
+		{
+			for(Size futurePeriod = periodsOfStep[step-1].first; futurePeriod < periodsOfStep[step-1].second; futurePeriod++)
+				dealWithPeriodEndDate(futurePeriod + m_CSCNI->m_currentPeriod, values);
+			smoothingStepsLeft = m_rannacherSteps;
+		}
+	}
+
+	// read the value and the derivatives at the spot node
+	Size i     = m_spotIndex;
+	Real hm    = m_x[i]   - m_x[i-1];
+	Real hp    = m_x[i+1] - m_x[i];
+	Real dVdx  = (-hp / (hm * (hm + hp))) * values[i-1] + ((hp - hm) / (hm * hp)) * values[i] 
+		         + (hm / (hp * (hm + hp))) * values[i+1];
+	Real d2Vdx2= 2.0 * (values[i-1] / (hm * (hm + hp)) - values[i] / (hm * hp) + values[i+1] / (hp * (hm + hp)));
+
+	m_value = values[i];
+	m_delta = dVdx / m_spot;
+	m_gamma = (d2Vdx2 - dVdx) / (m_spot * m_spot);
 }
 
+// Rolls the note back on a BlackScholesLattice of the given tree, for priceOnTree(..).
+class CallSpreadCpnNoteTreePricer
+{
+private:
+	CallSpreadCpnNoteInstrument*                        m_CSCNI;
+	boost::shared_ptr<GeneralizedBlackScholesProcess>   m_process;
+	Time                                                m_maturity;
+	Rate                                                m_discountRate;
+
+	// only used when the lattice is shared through the lattice cache
+	MarketCaches*                                       m_marketCaches;
+	std::string                                         m_latticeKey;
+
+	// only used for the sensitivities
+	bool                                                m_withSensitivities;
+	Volatility                                          m_vol;
+	Rate                                                m_riskFreeRate;
+	Rate                                                m_dividendRate;  // the underlying currency's rate
+public:
+	CallSpreadCpnNoteTreePricer(CallSpreadCpnNoteInstrument*                              pCSCNI,
+		                        const boost::shared_ptr<GeneralizedBlackScholesProcess>&  process,
+								Time maturity, Rate discountRate)
+		: m_CSCNI(pCSCNI), m_process(process), m_maturity(maturity), m_discountRate(discountRate),
+		  m_marketCaches(NULL), m_withSensitivities(false), m_vol(0.0), m_riskFreeRate(0.0), m_dividendRate(0.0) {}
+
+	// the rates are the zero rates to maturity, the discount rate is the riskFreeRate plus the credit spread
+	void setSensitivityInputs(Volatility vol, Rate riskFreeRate, Rate dividendRate)
+	{
+		m_withSensitivities = true;
+		m_vol               = vol;
+		m_riskFreeRate      = riskFreeRate;
+		m_dividendRate      = dividendRate;
+	}
+
+	// The key must identify the tree type and the process, i.e. the currency pair and the spot. 
+	// The maturity, steps and discount rate are added by price(..).
+	void setLatticeCache(MarketCaches* marketCaches, const std::string& latticeKey)
+	{
+		m_marketCaches = marketCaches;
+		m_latticeKey   = latticeKey;
+	}
+
+	template <class T>
+	TreeValuation price(Size timeSteps) const
+	{
+		if(m_withSensitivities)
+			return priceWithSensitivities<T>(timeSteps);
+
+		// The tree is extended to start two steps before today, so that today there are three nodes
+		// around the spot, from which we read the value, delta and gamma of the same rollback.
+		// The 'strike' only matters to the Leisen-Reimer and Joshi trees, which are centred on it.
+		Time dt            = m_maturity / timeSteps;
+		Size extendedSteps = timeSteps  + 2;
+		Time extendedEnd   = m_maturity + 2.0 * dt;
+		boost::shared_ptr<Lattice> lattice;
+		std::string latticeKey;
+		if(m_marketCaches)
+		{
+			std::ostringstream stream;
+			stream << std::setprecision(17) << m_latticeKey << CONST_STR_divider << extendedEnd 
+				   << CONST_STR_divider << extendedSteps << CONST_STR_divider << m_discountRate;
+			latticeKey = stream.str();
+			lattice    = m_marketCaches->findLattice(latticeKey);
+		}
+		if(!lattice)
+		{
+			boost::shared_ptr<T> tree(new T(m_process, extendedEnd, extendedSteps, m_process->x0()));
+			lattice = boost::shared_ptr<Lattice>(new BlackScholesLattice<T>
+				(tree, m_discountRate, extendedEnd, extendedSteps));
+			if(m_marketCaches)
+				m_marketCaches->addLattice(latticeKey, lattice);
+		}
+	    
+		DiscretizedCSCN discretizedCSCN(m_CSCNI, m_process, lattice->timeGrid(), 2.0 * dt);
+
+		// a cached lattice was built for the same tree type, which is part of the key
+		boost::shared_ptr<BlackScholesLattice<T> > bsLattice = boost::dynamic_pointer_cast<BlackScholesLattice<T> >(lattice);
+		QL_REQUIRE(bsLattice, "CallSpreadCpnNoteTreePricer::price(..): the lattice is not built on the expected tree");
+
+		Time today = lattice->timeGrid()[2];
+		discretizedCSCN.initialize(lattice, extendedEnd);
+		rollbackOnLattice(discretizedCSCN, *bsLattice, today);
+		return getValuationFromNodes(lattice->grid(today), discretizedCSCN.values(), m_process->x0());
+	}
+
+	// The same rollback as price(..), on the same extended tree, but done here rather than by the 
+	// BlackScholesLattice so that the tangents (forward mode derivatives) of the node values with respect 
+	// to the vol, the risk free rate, the underlying currency's rate and the credit spread are carried 
+	// back along with the values. With only four inputs this gives all the sensitivities in the one pass,
+	// without having to store the tree for a reverse (adjoint) sweep.
+	template <class T>
+	TreeValuation priceWithSensitivities(Size timeSteps) const
+	{
+		Time dt            = m_maturity / timeSteps;
+		Size extendedSteps = timeSteps  + 2;
+		Time extendedEnd   = m_maturity + 2.0 * dt;
+		Real spot          = m_process->x0();
+		Real rebate        = m_CSCNI->m_CSCNC->m_rebate;
+
+		T tree(m_process, extendedEnd, extendedSteps, spot);
+		BinomialTreeParameters params = getBinomialTreeParameters(tree, spot);
+
+		// The tangents of the tree's parameters, by bumping the inputs of trees built on flat processes.
+		// Building a tree is cheap, it is the rollback that is expensive.
+		enum { vol_input = 0, rate_input, dividend_input, credit_spread_input, num_inputs };
+		BinomialTreeParameters paramTangents[num_inputs];
+		Real discountRateTangents[num_inputs] = { 0.0, 1.0, 0.0, 1.0 }; // discounting at r + credit spread
+		const Real bump = 1.0e-4;
+		for(Size k = 0; k < num_inputs; k++)
+		{
+			paramTangents[k].driftPerStep = paramTangents[k].dx = paramTangents[k].pu = 0.0;
+			if(k == credit_spread_input) // only changes the discounting
+				continue;
+
+			Real volBump  = (k == vol_input      ? bump : 0.0);
+			Real rateBump = (k == rate_input     ? bump : 0.0);
+			Real divBump  = (k == dividend_input ? bump : 0.0);
+			T upTree  (makeFlatBlackScholesProcess(spot, m_riskFreeRate + rateBump, m_dividendRate + divBump,
+				                                   m_vol + volBump, m_CSCNI->m_evalDate), extendedEnd, extendedSteps, spot);
+			T downTree(makeFlatBlackScholesProcess(spot, m_riskFreeRate - rateBump, m_dividendRate - divBump,
+				                                   m_vol - volBump, m_CSCNI->m_evalDate), extendedEnd, extendedSteps, spot);
+			BinomialTreeParameters up   = getBinomialTreeParameters(upTree,   spot);
+			BinomialTreeParameters down = getBinomialTreeParameters(downTree, spot);
+			paramTangents[k].driftPerStep = (up.driftPerStep - down.driftPerStep) / (2.0 * bump);
+			paramTangents[k].dx           = (up.dx           - down.dx)           / (2.0 * bump);
+			paramTangents[k].pu           = (up.pu           - down.pu)           / (2.0 * bump);
+		}
+
+		TimeGrid timeGrid(extendedEnd, extendedSteps);
+		std::vector<std::pair<Size, Size> > futurePeriodsOfStep;
+		m_CSCNI->getFuturePeriodsOfSteps(timeGrid, 2.0 * dt, futurePeriodsOfStep);
+
+		const Real discount = std::exp(-m_discountRate * dt);
+		const Real pu = params.pu, pd = 1.0 - params.pu;
+
+		Array              values(extendedSteps + 1, rebate);
+		std::vector<Array> valueTangents(num_inputs, Array(extendedSteps + 1, 0.0));
+		Array              spots, slopes;
+		std::vector<Array> spotTangents(num_inputs);
+
+		for(Size level = extendedSteps; level >= 2; level--)
+		{
+			if(level < extendedSteps) // step back from level + 1
+			{
+				Array newValues(level + 1);
+				std::vector<Array> newValueTangents(num_inputs, Array(level + 1));
+				for(Size j = 0; j <= level; j++)
+				{
+					newValues[j] = discount * (pd * values[j] + pu * values[j+1]);
+					for(Size k = 0; k < num_inputs; k++)
+						newValueTangents[k][j] = discount * (pd * valueTangents[k][j] + pu * valueTangents[k][j+1]
+							                                 + paramTangents[k].pu * (values[j+1] - values[j]))
+											     - dt * discountRateTangents[k] * newValues[j];
+				}
+				values        = newValues;
+				valueTangents = newValueTangents;
+			}
+
+			spots = Array(level + 1);
+			for(Size k = 0; k < num_inputs; k++)
+				spotTangents[k] = Array(level + 1);
+			for(Size j = 0; j <= level; j++)
+			{
+				Real jumps = 2.0 * j - (Real) level;
+				spots[j]   = spot * std::exp(level * params.driftPerStep + jumps * params.dx);
+				for(Size k = 0; k < num_inputs; k++)
+					spotTangents[k][j] = spots[j] * (level * paramTangents[k].driftPerStep + jumps * paramTangents[k].dx);
+			}
+
+			for(Size futurePeriod  = futurePeriodsOfStep[level].first; 
+				     futurePeriod  < futurePeriodsOfStep[level].second; futurePeriod++) 
+			{   // as in DiscretizedCSCN::dealWithPeriodEndDate(.), the call decision before the coupon
+				Size period = futurePeriod + m_CSCNI->m_currentPeriod;
+				if(m_CSCNI->m_CSCNC->isCallable(period))
+				{
+					for(Size j = 0; j <= level; j++)
+						if(values[j] > rebate)
+						{
+							values[j] = rebate;
+							for(Size k = 0; k < num_inputs; k++)
+								valueTangents[k][j] = 0.0;
+						}
+				}
+				m_CSCNI->getCouponSlopes  (period, spots, slopes);
+				m_CSCNI->addCouponPayments(period, spots, values);
+				for(Size k = 0; k < num_inputs; k++)
+					for(Size j = 0; j <= level; j++)
+						valueTangents[k][j] += slopes[j] * spotTangents[k][j];
+			}
+		}
+
+		TreeValuation valuation   = getValuationFromNodes(spots, values, spot);
+		valuation.vega            = getValueTangentFromNodes(spots, values, spotTangents[vol_input],
+			                                                 valueTangents[vol_input],           spot);
+		valuation.rho             = getValueTangentFromNodes(spots, values, spotTangents[rate_input],
+			                                                 valueTangents[rate_input],          spot);
+		valuation.dividendRho     = getValueTangentFromNodes(spots, values, spotTangents[dividend_input],
+			                                                 valueTangents[dividend_input],      spot);
+		valuation.creditSpreadRho = getValueTangentFromNodes(spots, values, spotTangents[credit_spread_input],
+			                                                 valueTangents[credit_spread_input], spot);
+		return valuation;
+	}
+};
+
 Real CallSpreadCpnNoteInstrument::getNPV() const
 {
 	QL_REQUIRE( m_npv, "CallSpreadCpnNoteInstrument::getNPV(): Have not yet calculated npv.");
@@ -300,45 +883,117 @@ Real CallSpreadCpnNoteInstrument::getNPV() const
 
 void CallSpreadCpnNoteInstrument::Calculate()
 {
-	// stoch process
-    Handle<Quote> underlyingH(boost::shared_ptr<Quote>(new SimpleQuote(m_currentSpot)));
-	Handle<YieldTermStructure> yieldTSAccCcy (m_marketCaches->getYieldTSCache()->
-		                  get( CONST_STR_risk_free_rate, m_CSCNC->m_accCcy));
-	Handle<YieldTermStructure> yieldTSUndlCcy (m_marketCaches->getYieldTSCache()->
-		                  get( CONST_STR_risk_free_rate, m_CSCNC->m_undlCcy));
+	if(m_CSCNC->m_pricingEngine == "pde")
+		CalculateByPDE();
+	else
+		CalculateOnTree();
+}
 
-	Handle<BlackVolTermStructure> fxVolTS(m_marketCaches->getFXVolCache()
-		                                  ->get(m_CSCNC->m_accCcy, m_CSCNC->m_undlCcy));
+CallSpreadCpnNoteInstrument::MarketInputs CallSpreadCpnNoteInstrument::getMarketInputs() const
+{
+	MarketInputs inputs;
+	inputs.yieldTSAccCcy  = Handle<YieldTermStructure>(m_marketCaches->getYieldTSCache()->
+		                        get( CONST_STR_risk_free_rate, m_CSCNC->m_accCcy));
+	inputs.yieldTSUndlCcy = Handle<YieldTermStructure>(m_marketCaches->getYieldTSCache()->
+		                        get( CONST_STR_risk_free_rate, m_CSCNC->m_undlCcy));
 
-    boost::shared_ptr<StochasticProcess1D> stochasticPro(new BlackScholesMertonProcess
-		(underlyingH, yieldTSUndlCcy, yieldTSAccCcy, fxVolTS));
-       
-    Time maturity = yieldTSAccCcy->dayCounter().yearFraction(m_evalDate, m_periodEndDates[m_numPeriods-1]);
+	inputs.fxVolTS = Handle<BlackVolTermStructure>(m_marketCaches->getFXVolCache()
+		                                           ->get(m_CSCNC->m_accCcy, m_CSCNC->m_undlCcy));
 
-    boost::shared_ptr<GeneralizedBlackScholesProcess> bs(
-         new GeneralizedBlackScholesProcess(underlyingH, yieldTSUndlCcy, yieldTSAccCcy, fxVolTS));
+	// issuer's credit spread:
+    inputs.creditSpread = m_marketCaches->getStockDataCache()->get(m_CSCNC->m_issuerID, m_CSCNC->m_issuerIDType)
+		                    ->getCreditSpread();
 
-	boost::shared_ptr<JarrowRudd> tree(new JarrowRudd(bs, maturity, m_treeTimeSteps, 0));
+    inputs.vol = inputs.fxVolTS->blackVol(m_periodEndDates[m_numPeriods-1], m_currentSpot);
 
-	// issuer's credit spread:
-    Real creditSpread = m_marketCaches->getStockDataCache()->get(m_CSCNC->m_issuerID, m_CSCNC->m_issuerIDType)
-		                  ->getCreditSpread();
+	DayCounter rfdc = inputs.yieldTSAccCcy->dayCounter();
+
+	inputs.riskFreeRate = inputs.yieldTSAccCcy->zeroRate(m_periodEndDates[m_numPeriods-1], rfdc, Continuous, NoFrequency);
+    inputs.q            = inputs.yieldTSUndlCcy->zeroRate(m_periodEndDates[m_numPeriods-1], rfdc, Continuous, NoFrequency);
+	return inputs;
+}
 
-    Volatility vol = fxVolTS->blackVol(m_periodEndDates[m_numPeriods-1], m_currentSpot);
+void CallSpreadCpnNoteInstrument::CalculateByPDE()
+{
+	MarketInputs inputs = getMarketInputs();
 
-	DayCounter rfdc  = yieldTSAccCcy->dayCounter();
+	std::string timeSteps = "200", spaceSteps = "200", rannacherSteps = "2";
+	getConfig()->find("call_spread_cpn_note_pde_time_steps",  timeSteps);
+	getConfig()->find("call_spread_cpn_note_pde_space_steps", spaceSteps);
+	getConfig()->find("call_spread_cpn_note_rannacher_steps", rannacherSteps);
 
-	Rate riskFreeRate = yieldTSAccCcy->zeroRate(m_periodEndDates[m_numPeriods-1], rfdc, Continuous, NoFrequency);
-    Rate q = yieldTSUndlCcy->zeroRate(m_periodEndDates[m_numPeriods-1], rfdc, Continuous, NoFrequency);
+	CallSpreadCpnNotePDEEngine pdeEngine(this, m_currentSpot, inputs.vol, inputs.riskFreeRate - inputs.q, 
+		                                 inputs.riskFreeRate + inputs.creditSpread,
+		                                 atoi(timeSteps.c_str()), atoi(spaceSteps.c_str()), atoi(rannacherSteps.c_str()));
+	pdeEngine.calculate();
 
-    boost::shared_ptr<Lattice> lattice(new BlackScholesLattice<JarrowRudd>
-		(tree,riskFreeRate + creditSpread, maturity, m_treeTimeSteps));
-    
-    DiscretizedCSCN discretizedCSCN(this, bs, lattice->timeGrid()); //, TimeGrid(maturity, m_treeTimeSteps));
+	m_npv   = pdeEngine.getValue();
+	m_delta = pdeEngine.getDelta();
+	m_gamma = pdeEngine.getGamma();
+}
+
+void CallSpreadCpnNoteInstrument::CalculateOnTree()
+{
+	MarketInputs inputs = getMarketInputs();
+
+	// stoch process
+    Handle<Quote> underlyingH(boost::shared_ptr<Quote>(new SimpleQuote(m_currentSpot)));
+       
+    Time maturity = inputs.yieldTSAccCcy->dayCounter().yearFraction(m_evalDate, m_periodEndDates[m_numPeriods-1]);
+
+    boost::shared_ptr<GeneralizedBlackScholesProcess> bs(new GeneralizedBlackScholesProcess(underlyingH, 
+		                                  inputs.yieldTSUndlCcy, inputs.yieldTSAccCcy, inputs.fxVolTS));
+
+	// The tree defaults to Jarrow-Rudd, with call_spread_cpn_note_richardson 'on' we also price 
+	// with twice the steps and extrapolate.
+	TreeType treeType = getConfigTreeType("call_spread_cpn_note_tree_type");
+	std::string richardson = "off";
+	getConfig()->find("call_spread_cpn_note_richardson", richardson);
+
+	CallSpreadCpnNoteTreePricer treePricer(this, bs, maturity, inputs.riskFreeRate + inputs.creditSpread);
+
+	// Notes on the same currency pair, with the same final date and issuer, share the lattice.
+	std::string latticeCache = "on";
+	getConfig()->find("call_spread_cpn_note_lattice_cache", latticeCache);
+	if(latticeCache == "on")
+	{
+		std::ostringstream latticeKey;
+		latticeKey << std::setprecision(17) << toString(treeType) << CONST_STR_divider << m_CSCNC->m_accCcy 
+			       << CONST_STR_divider << m_CSCNC->m_undlCcy << CONST_STR_divider << m_currentSpot;
+		treePricer.setLatticeCache(m_marketCaches, latticeKey.str());
+	}
+
+	// With call_spread_cpn_note_sensitivities 'on' the rollback also gives the vega, rho, dividend rho
+	// (i.e. to the underlying currency's rate) and the credit spread sensitivity.
+	std::string sensitivities = "off";
+	getConfig()->find("call_spread_cpn_note_sensitivities", sensitivities);
+	if(sensitivities == "on")
+		treePricer.setSensitivityInputs(inputs.vol, inputs.riskFreeRate, inputs.q);
+
+	// With call_spread_cpn_note_adaptive_steps 'on' the call_spread_cpn_note_tree_time_steps is ignored, 
+	// the steps are doubled until the price converges (see getConfigAdaptiveTreeSettings()).
+	std::string adaptiveSteps = "off";
+	getConfig()->find("call_spread_cpn_note_adaptive_steps", adaptiveSteps);
 
-    discretizedCSCN.initialize(lattice, maturity);
-    discretizedCSCN.rollback(0.0);
-    m_npv = discretizedCSCN.presentValue();
+	TreeValuation valuation;
+	if(adaptiveSteps == "on")
+	{
+		Size stepsUsed;
+		valuation = priceOnTreeAdaptive(treeType, treePricer, getConfigAdaptiveTreeSettings(), richardson == "on", stepsUsed);
+		m_treeTimeStepsUsed = stepsUsed;
+	}
+	else
+		valuation = priceOnTree(treeType, treePricer, m_treeTimeSteps, richardson == "on");
+    m_npv   = valuation.value;
+	m_delta = valuation.delta;
+	m_gamma = valuation.gamma;
+	if(valuation.vega != Null<Real>())
+	{
+		m_vega            = valuation.vega;
+		m_rho             = valuation.rho;
+		m_dividendRho     = valuation.dividendRho;
+		m_creditSpreadRho = valuation.creditSpreadRho;
+	}
 }
 
 void CallSpreadCpnNoteInstrument::setCurrentSpot()
@@ -362,6 +1017,16 @@ Real CallSpreadCpnNoteInstrument::getCouponPayment(Size period, Real spot) const
 	return m_coupons[period].getCouponRate(spot) * (Real) m_CSCNC->m_monthsPerPeriod / 12.0;
 }
 
+void CallSpreadCpnNoteInstrument::addCouponPayments(Size period, const Array& spots, Array& values) const
+{   
+	m_coupons[period].addCouponPayments(spots, (Real) m_CSCNC->m_monthsPerPeriod / 12.0, values);
+}
+
+void CallSpreadCpnNoteInstrument::getCouponSlopes(Size period, const Array& spots, Array& slopes) const
+{   
+	m_coupons[period].getCouponSlopes(spots, (Real) m_CSCNC->m_monthsPerPeriod / 12.0, slopes);
+}
+
 Size CallSpreadCpnNoteInstrument::getIndexOfRawCouponSpec(Size period)
 {
 	QL_REQUIRE(m_vRawCouponSpecs.size() > 0, "CallSpreadCpnNoteInstrument::getIndexOfRawCouponSpec: " 
@@ -503,6 +1168,46 @@ CallSpreadCpnNoteCalculator::CallSpreadCpnNoteCalculator(CallSpreadCpnNoteContra
 	perUnitValRes->setAttribute ( contract_category, "call_spread_cpn_note",                true);
 	perUnitValRes->setAttribute ( contract_id,       pCSCNC->getID(),                       true);
 	perUnitValRes->setAttribute ( underlying_id,     pCSCNC->m_undlCcy + pCSCNC->m_accCcy , true);
+	if(CSCNI->m_treeTimeStepsUsed)
+		perUnitValRes->setAttribute ( time_steps,    toString(CSCNI->m_treeTimeStepsUsed.get()), true);
 	perUnitValRes->setValueAndCategory ( price_per_unit_notional, CSCNI->getNPV());
 	pResultSet->addNewResult           ( perUnitValRes);		
+
+	// Both engines give the delta and gamma from the nodes around today's spot.
+	// The note's value per unit notional is in the accounting currency, as is the spot (per unit of the
+	// underlying currency), so the delta_pc is unitless and the delta_1 and gamma_1 are in the accounting currency.
+	Real spot = CSCNI->m_currentSpot;
+
+	boost::shared_ptr<Result> deltaPCRes = (boost::shared_ptr<Result>) new Result(*perUnitValRes);
+	deltaPCRes->setValueAndCategory ( delta_pc, CSCNI->m_delta.get() * spot);
+	pResultSet->addNewResult        ( deltaPCRes);
+
+	boost::shared_ptr<Result> delta1Res = (boost::shared_ptr<Result>) new Result(*perUnitValRes);
+	delta1Res->setValueAndCategory  ( delta_1,  CSCNI->m_delta.get() * spot / 100.0 * pCSCNC->m_notional);
+	delta1Res->setAttribute         ( currency, pCSCNC->m_accCcy, true);
+	pResultSet->addNewResult        ( delta1Res);
+
+	boost::shared_ptr<Result> gamma1Res = (boost::shared_ptr<Result>) new Result(*perUnitValRes);
+	gamma1Res->setValueAndCategory  ( gamma_1,  CSCNI->m_gamma.get() * spot * spot / 10000.0 * pCSCNC->m_notional);
+	gamma1Res->setAttribute         ( currency, pCSCNC->m_accCcy, true);
+	pResultSet->addNewResult        ( gamma1Res);
+
+	if(CSCNI->m_vega)
+	{
+		boost::shared_ptr<Result> vega1Res = (boost::shared_ptr<Result>) new Result(*delta1Res);
+		vega1Res->setValueAndCategory   ( vega_1,          CSCNI->m_vega.get()            / 100.0 * pCSCNC->m_notional);
+		pResultSet->addNewResult        ( vega1Res);
+
+		boost::shared_ptr<Result> rho1Res = (boost::shared_ptr<Result>) new Result(*delta1Res);
+		rho1Res->setValueAndCategory    ( rho_1,           CSCNI->m_rho.get()             / 100.0 * pCSCNC->m_notional);
+		pResultSet->addNewResult        ( rho1Res);
+
+		boost::shared_ptr<Result> divRho1Res = (boost::shared_ptr<Result>) new Result(*delta1Res);
+		divRho1Res->setValueAndCategory ( dividend_rho_1,  CSCNI->m_dividendRho.get()     / 100.0 * pCSCNC->m_notional);
+		pResultSet->addNewResult        ( divRho1Res);
+
+		boost::shared_ptr<Result> spread1Res = (boost::shared_ptr<Result>) new Result(*delta1Res);
+		spread1Res->setValueAndCategory ( credit_spread_1, CSCNI->m_creditSpreadRho.get() / 100.0 * pCSCNC->m_notional);
+		pResultSet->addNewResult        ( spread1Res);
+	}
 }
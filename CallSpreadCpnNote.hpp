@@ -32,6 +32,15 @@ public:
                boost::optional<Real> cap,    boost::optional<Real> floor);
 
 	Real getCouponRate(Real spot) const;     // will throw if uninitialized
+
+	// values[j] += accrualFraction * couponRate(spots[j]) over all nodes, without per node branching
+	void addCouponPayments(const Array& spots, Real accrualFraction, Array& values) const;
+
+	// slopes[j] = accrualFraction * d(couponRate)/d(spot) at spots[j], i.e. zero where the cap or floor bites
+	void getCouponSlopes(const Array& spots, Real accrualFraction, Array& slopes) const;
+
+	// appends the spots at which the coupon has a kink, i.e. where the cap or floor starts to bite
+	void getCriticalSpots(std::vector<Real>& criticalSpots) const;
 };
 
 class CallSpreadCpnNoteContract : public Contract
@@ -42,6 +51,7 @@ public:
 	bool                          m_isCallable;
 	Integer                       m_firstPeriodIssuersCallIsActive; 
 	Real                          m_rebate;                      // the rebate per unit notional when called or at maturity
+	Real                          m_notional;                    // optional, defaults to 1, used for the cash Greeks
 	Size                          m_monthsPerPeriod;
 	
 	std::string                   m_underlyingType;
@@ -55,6 +65,8 @@ public:
 	std::string                   m_issuerID;     // will use issuer's credit spread
 	std::string                   m_issuerIDType;
 
+	std::string                   m_pricingEngine; // 'tree' or 'pde', defaults to call_spread_cpn_note_engine in the config
+
 	bool isCallable(Size period) const;
     CallSpreadCpnNoteContract(const boost::property_tree::ptree &parentTree); 
 };
@@ -1,6 +1,7 @@
 #include "ConvertibleBond.hpp"
 #include "MarketData.hpp"
 #include "Result.hpp"
+#include "TreeEngines.hpp"
 
 ConvertibleBondContract::ConvertibleBondContract(const boost::property_tree::ptree &pt)
 		: Contract( convertible_bond, pt_get<std::string>(pt, "contract_id"))
@@ -24,6 +25,335 @@ ConvertibleBondContract::ConvertibleBondContract(const boost::property_tree::ptr
 }
 
 
+// The tangents (forward mode derivatives) of the convertible's node values, conversion probabilities and 
+// spread adjusted rates, with respect to each of the inputs of the ConvertibleBondTreeEngine, for 
+// rollbackConvertible(..) to carry back along with the values.
+struct ConvertibleTangents
+{
+	enum Input { vol_input = 0, rate_input, dividend_input, credit_spread_input, num_inputs };
+
+	Real                    conversionRatio;
+	BinomialTreeParameters  treeParameterTangents[num_inputs];
+	Real                    riskFreeRateTangents[num_inputs];   // of the lattice's risk free rate
+	Real                    creditSpreadTangents[num_inputs];
+
+	std::vector<Array>      valueTangents;
+	std::vector<Array>      conversionProbabilityTangents;
+	std::vector<Array>      spreadAdjustedRateTangents;
+
+	// Differentiates stepBackConvertibleLevel(..), from the arrays of level + 1 and the new conversion
+	// probabilities of level. Must be called before the convertible's arrays are swapped.
+	void stepBack(const Array& values, const Array& conversionProbability, const Array& spreadAdjustedRate,
+		          const Array& newConversionProbability, Real pu, Time dt, Spread creditSpread);
+
+	// After the convertible's adjustValues() at a level of the tree. The coupons don't depend on the inputs,
+	// where the bond was converted its value is the conversion ratio times the spot.
+	void adjust(const Array& valuesBefore, const Array& values, const Array& grid, Size level);
+};
+
+void ConvertibleTangents::stepBack(const Array& values, const Array& conversionProbability, 
+								   const Array& spreadAdjustedRate, const Array& newConversionProbability, 
+								   Real pu, Time dt, Spread creditSpread)
+{
+	Size size = newConversionProbability.size();
+	Real pd   = 1.0 - pu;
+	Array discounts(size + 1);
+	for(Size j = 0; j <= size; j++)
+		discounts[j] = 1.0 / (1.0 + spreadAdjustedRate[j] * dt);
+
+	for(Size k = 0; k < num_inputs; k++)
+	{
+		const Array& vt   = valueTangents[k];
+		const Array& cpt  = conversionProbabilityTangents[k];
+		const Array& sart = spreadAdjustedRateTangents[k];
+		Real dpu          = treeParameterTangents[k].pu;
+
+		Array newValueTangents(size), newConversionProbabilityTangents(size), newSpreadAdjustedRateTangents(size);
+		for(Size j = 0; j < size; j++)
+		{
+			// the tangents of value / (1 + spreadAdjustedRate * dt) at the down and up nodes
+			Real downTangent = (vt[j]   - values[j]   * dt * sart[j]   * discounts[j])   * discounts[j];
+			Real upTangent   = (vt[j+1] - values[j+1] * dt * sart[j+1] * discounts[j+1]) * discounts[j+1];
+			newValueTangents[j] = pd * downTangent + pu * upTangent 
+				                  + dpu * (values[j+1] * discounts[j+1] - values[j] * discounts[j]);
+			newConversionProbabilityTangents[j] = pd * cpt[j] + pu * cpt[j+1] 
+				                                  + dpu * (conversionProbability[j+1] - conversionProbability[j]);
+			newSpreadAdjustedRateTangents[j]    = riskFreeRateTangents[k] 
+				                                  - newConversionProbabilityTangents[j] * creditSpread
+												  + (1.0 - newConversionProbability[j]) * creditSpreadTangents[k];
+		}
+		valueTangents[k].swap(newValueTangents);
+		conversionProbabilityTangents[k].swap(newConversionProbabilityTangents);
+		spreadAdjustedRateTangents[k].swap(newSpreadAdjustedRateTangents);
+	}
+}
+
+void ConvertibleTangents::adjust(const Array& valuesBefore, const Array& values, const Array& grid, Size level)
+{
+	for(Size j = 0; j < values.size(); j++)
+	{
+		// DiscretizedConvertible::applyConvertibility() sets the value to exactly the conversion 
+		// ratio times the grid's spot, any other change is a coupon
+		if(values[j] == valuesBefore[j] || values[j] != conversionRatio * grid[j])
+			continue;
+
+		Real jumps = 2.0 * j - (Real) level;
+		for(Size k = 0; k < num_inputs; k++)
+		{
+			Real spotTangent = grid[j] * (level * treeParameterTangents[k].driftPerStep + jumps * treeParameterTangents[k].dx);
+			valueTangents[k][j]                 = conversionRatio * spotTangent;
+			conversionProbabilityTangents[k][j] = 0.0;
+		}
+	}
+}
+
+// convertible.adjustValues(), and when there are tangents their adjustment for the conversions
+template <class T>
+void adjustConvertible(DiscretizedConvertible&                  convertible, 
+					   const TsiveriotisFernandesLattice<T>&    lattice, 
+					   ConvertibleTangents*                     tangents)
+{
+	if(!tangents)
+	{
+		convertible.adjustValues();
+		return;
+	}
+	Array valuesBefore = convertible.values();
+	convertible.adjustValues();
+	Time t = convertible.time();
+	tangents->adjust(valuesBefore, convertible.values(), lattice.grid(t), lattice.timeGrid().index(t));
+}
+
+// Replaces convertible.rollback(to), the same as TsiveriotisFernandesLattice::rollback(..) but using 
+// the rollback kernel from TreeEngines. The lattice doesn't expose its credit spread, so it's passed in.
+// With tangents they're rolled back along with the values.
+template <class T>
+void rollbackConvertible(DiscretizedConvertible&                  convertible, 
+						 const TsiveriotisFernandesLattice<T>&    lattice, 
+						 Spread                                   creditSpread, 
+						 Time                                     to,
+						 ConvertibleTangents*                     tangents = 0)
+{
+	Time from = convertible.time();
+	if(!close(from, to))
+	{
+		QL_REQUIRE(from > to, "rollbackConvertible(..): cannot roll the convertible back to " << to 
+			       << " (it is already at t = " << from << ")");
+
+		const TimeGrid& timeGrid  = lattice.timeGrid();
+		Integer iFrom             = (Integer) timeGrid.index(from);
+		Integer iTo               = (Integer) timeGrid.index(to);
+		Real pd                   = lattice.tree()->probability(0, 0, 0);
+		Real pu                   = lattice.tree()->probability(0, 0, 1);
+		Size parallelThreshold    = getRollbackParallelThreshold();
+
+		for(Integer i = iFrom - 1; i >= iTo; i--)
+		{
+			Size size = lattice.size(i);
+			Array newValues(size), newConversionProbability(size), newSpreadAdjustedRate(size);
+			stepBackConvertibleLevel(convertible.values().begin(), 
+				                     convertible.conversionProbability().begin(),
+									 convertible.spreadAdjustedRate().begin(),
+									 newValues.begin(), newConversionProbability.begin(), newSpreadAdjustedRate.begin(),
+									 size, pd, pu, lattice.dt(), lattice.riskFreeRate(), creditSpread, 
+									 parallelThreshold);
+			if(tangents)
+				tangents->stepBack(convertible.values(), convertible.conversionProbability(), 
+				                   convertible.spreadAdjustedRate(), newConversionProbability, 
+								   pu, lattice.dt(), creditSpread);
+			convertible.time() = timeGrid[i];
+			convertible.values().swap(newValues);
+			convertible.conversionProbability().swap(newConversionProbability);
+			convertible.spreadAdjustedRate().swap(newSpreadAdjustedRate);
+			if(i != iTo)                   // the adjustment at 'to' is done below
+				adjustConvertible(convertible, lattice, tangents);
+		}
+	}
+	adjustConvertible(convertible, lattice, tangents);
+}
+
+// The same as QuantLib's BinomialConvertibleEngine, except that the rollback stops at the second level 
+// of the tree, where there are three nodes around the spot, to read off the delta and gamma, 
+// before carrying on to today for the value. 
+// Unlike the call spread coupon note we can't extend the tree to start before today, because 
+// DiscretizedConvertible fixes its coupon, call and conversion times relative to the settlement date.
+// With sensitivities the rollback also carries the tangents with respect to the vol, the risk free rate,
+// the dividend yield and the credit spread, which give the vega and rhos at today's node. 
+template <class T>
+class ConvertibleBondTreeEngine : public ConvertibleBond::option::engine
+{
+private:
+	boost::shared_ptr<GeneralizedBlackScholesProcess>   m_process;
+	Size                                                m_timeSteps;
+	bool                                                m_withSensitivities;
+	mutable TreeValuation                               m_sensitivities;
+public:
+	ConvertibleBondTreeEngine(const boost::shared_ptr<GeneralizedBlackScholesProcess>&  process,
+		                      Size                                                      timeSteps,
+							  bool                                                      withSensitivities = false)
+		: m_process(process), m_timeSteps(timeSteps), m_withSensitivities(withSensitivities)
+	{
+		QL_REQUIRE(m_timeSteps > 2, "ConvertibleBondTreeEngine: need more than 2 time steps, have " << m_timeSteps);
+		registerWith(m_process);
+	}
+	void calculate() const;
+
+	// The vega, rho, dividend rho and credit spread rho of the last calculate(), Null without sensitivities.
+	const TreeValuation& getSensitivities() const { return m_sensitivities; }
+};
+
+template <class T>
+void ConvertibleBondTreeEngine<T>::calculate() const
+{
+	DayCounter rfdc  = m_process->riskFreeRate()->dayCounter();
+	DayCounter divdc = m_process->dividendYield()->dayCounter();
+	DayCounter voldc = m_process->blackVolatility()->dayCounter();
+	Calendar volcal  = m_process->blackVolatility()->calendar();
+
+	Real s0 = m_process->x0();
+	QL_REQUIRE(s0 > 0.0, "ConvertibleBondTreeEngine: negative or null underlying");
+	Date maturityDate = arguments_.exercise->lastDate();
+	Volatility v      = m_process->blackVolatility()->blackVol(maturityDate, s0);
+	Rate riskFreeRate = m_process->riskFreeRate()->zeroRate(maturityDate, rfdc, Continuous, NoFrequency);
+	Rate q            = m_process->dividendYield()->zeroRate(maturityDate, divdc, Continuous, NoFrequency);
+	Date referenceDate = m_process->riskFreeRate()->referenceDate();
+
+	// subtract the dividends
+	for(Size i = 0; i < arguments_.dividends.size(); i++)
+	{
+		if(arguments_.dividends[i]->date() >= referenceDate)
+			s0 -= arguments_.dividends[i]->amount() * m_process->riskFreeRate()->discount(arguments_.dividends[i]->date());
+	}
+	QL_REQUIRE(s0 > 0.0, "ConvertibleBondTreeEngine: negative value after subtracting dividends");
+
+	// binomial trees with constant coefficients
+	Handle<Quote> underlying(boost::shared_ptr<Quote>(new SimpleQuote(s0)));
+	Handle<YieldTermStructure> flatRiskFree(boost::shared_ptr<YieldTermStructure>(
+		                                    new FlatForward(referenceDate, riskFreeRate, rfdc)));
+	Handle<YieldTermStructure> flatDividends(boost::shared_ptr<YieldTermStructure>(
+		                                     new FlatForward(referenceDate, q, divdc)));
+	Handle<BlackVolTermStructure> flatVol(boost::shared_ptr<BlackVolTermStructure>(
+		                                  new BlackConstantVol(referenceDate, volcal, v, voldc)));
+
+	boost::shared_ptr<PlainVanillaPayoff> payoff = boost::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+	QL_REQUIRE(payoff, "ConvertibleBondTreeEngine: non-plain payoff given");
+
+	Time maturity = rfdc.yearFraction(arguments_.settlementDate, maturityDate);
+
+	boost::shared_ptr<GeneralizedBlackScholesProcess> bs(
+		new GeneralizedBlackScholesProcess(underlying, flatDividends, flatRiskFree, flatVol));
+	boost::shared_ptr<T> tree(new T(bs, maturity, m_timeSteps, payoff->strike()));
+
+	Real creditSpread = arguments_.creditSpread->value();
+
+	boost::shared_ptr<TsiveriotisFernandesLattice<T> > lattice(new TsiveriotisFernandesLattice<T>
+		(tree, riskFreeRate, maturity, m_timeSteps, creditSpread, v, q));
+
+	DiscretizedConvertible convertible(arguments_, bs, TimeGrid(maturity, m_timeSteps));
+	convertible.initialize(lattice, maturity);
+
+	boost::shared_ptr<ConvertibleTangents> tangents;
+	m_sensitivities = TreeValuation();
+	if(m_withSensitivities)
+	{
+		// The dividends would move today's spot with the rate, and the calls aren't followed by 
+		// ConvertibleTangents::adjust(..). ConvertibleBondCalculator has neither.
+		QL_REQUIRE(arguments_.dividends.empty() && arguments_.callabilityDates.empty(), 
+			       "ConvertibleBondTreeEngine: the sensitivities are only for bonds without dividends or calls");
+
+		// The tangents of the tree's parameters, by bumping the inputs of trees built on flat processes, 
+		// as for the call spread coupon note.
+		tangents = boost::shared_ptr<ConvertibleTangents>(new ConvertibleTangents());
+		tangents->conversionRatio = arguments_.conversionRatio;
+		const Real bump = 1.0e-4;
+		for(Size k = 0; k < ConvertibleTangents::num_inputs; k++)
+		{
+			BinomialTreeParameters& paramTangents = tangents->treeParameterTangents[k];
+			paramTangents.driftPerStep = paramTangents.dx = paramTangents.pu = 0.0;
+			tangents->riskFreeRateTangents[k] = (k == ConvertibleTangents::rate_input          ? 1.0 : 0.0);
+			tangents->creditSpreadTangents[k] = (k == ConvertibleTangents::credit_spread_input ? 1.0 : 0.0);
+			if(k == ConvertibleTangents::credit_spread_input) // only changes the discounting
+				continue;
+
+			Real volBump  = (k == ConvertibleTangents::vol_input      ? bump : 0.0);
+			Real rateBump = (k == ConvertibleTangents::rate_input     ? bump : 0.0);
+			Real divBump  = (k == ConvertibleTangents::dividend_input ? bump : 0.0);
+			T upTree  (makeFlatBlackScholesProcess(s0, riskFreeRate + rateBump, q + divBump, v + volBump, referenceDate), 
+				       maturity, m_timeSteps, payoff->strike());
+			T downTree(makeFlatBlackScholesProcess(s0, riskFreeRate - rateBump, q - divBump, v - volBump, referenceDate), 
+				       maturity, m_timeSteps, payoff->strike());
+			BinomialTreeParameters up   = getBinomialTreeParameters(upTree,   s0);
+			BinomialTreeParameters down = getBinomialTreeParameters(downTree, s0);
+			paramTangents.driftPerStep  = (up.driftPerStep - down.driftPerStep) / (2.0 * bump);
+			paramTangents.dx            = (up.dx           - down.dx)           / (2.0 * bump);
+			paramTangents.pu            = (up.pu           - down.pu)           / (2.0 * bump);
+		}
+
+		// At maturity DiscretizedConvertible::reset(..) has set the redemption and coupon, converted where 
+		// that's worth more, and blended the discount rate with the conversion probability.
+		const Array& conversionProbability = convertible.conversionProbability();
+		Size size = convertible.values().size();
+		tangents->valueTangents.assign                (ConvertibleTangents::num_inputs, Array(size, 0.0));
+		tangents->conversionProbabilityTangents.assign(ConvertibleTangents::num_inputs, Array(size, 0.0));
+		tangents->spreadAdjustedRateTangents.assign   (ConvertibleTangents::num_inputs, Array(size, 0.0));
+		for(Size k = 0; k < ConvertibleTangents::num_inputs; k++)
+			for(Size j = 0; j < size; j++)
+				tangents->spreadAdjustedRateTangents[k][j] = tangents->riskFreeRateTangents[k] 
+				                                             + (1.0 - conversionProbability[j]) * tangents->creditSpreadTangents[k];
+		tangents->adjust(Array(size, arguments_.redemption), convertible.values(), lattice->grid(maturity), m_timeSteps);
+	}
+
+	Time secondLevel = lattice->timeGrid()[2];
+	rollbackConvertible(convertible, *lattice, creditSpread, secondLevel, tangents.get());
+	TreeValuation nodeValuation = getValuationFromNodes(lattice->grid(secondLevel), convertible.values(), s0);
+
+	rollbackConvertible(convertible, *lattice, creditSpread, 0.0, tangents.get());
+	results_.value = convertible.presentValue();
+	results_.delta = nodeValuation.delta;
+	results_.gamma = nodeValuation.gamma;
+
+	// today's single node is at the spot, which doesn't move with the inputs
+	if(tangents)
+	{
+		m_sensitivities.vega            = tangents->valueTangents[ConvertibleTangents::vol_input][0];
+		m_sensitivities.rho             = tangents->valueTangents[ConvertibleTangents::rate_input][0];
+		m_sensitivities.dividendRho     = tangents->valueTangents[ConvertibleTangents::dividend_input][0];
+		m_sensitivities.creditSpreadRho = tangents->valueTangents[ConvertibleTangents::credit_spread_input][0];
+	}
+}
+
+// Prices the bond with a ConvertibleBondTreeEngine on the given tree, for priceOnTree(..).
+class ConvertibleBondTreePricer
+{
+private:
+	ConvertibleFixedCouponBond&                         m_bond;
+	boost::shared_ptr<GeneralizedBlackScholesProcess>   m_process;
+	bool                                                m_withSensitivities;
+public:
+	ConvertibleBondTreePricer(ConvertibleFixedCouponBond&                               bond,
+		                      const boost::shared_ptr<GeneralizedBlackScholesProcess>&  process,
+							  bool                                                      withSensitivities)
+		: m_bond(bond), m_process(process), m_withSensitivities(withSensitivities) {}
+
+	template <class T>
+	TreeValuation price(Size timeSteps) const
+	{
+		boost::shared_ptr<ConvertibleBondTreeEngine<T> > engine(new ConvertibleBondTreeEngine<T>(m_process, timeSteps, 
+			                                                                                     m_withSensitivities));
+		m_bond.setPricingEngine(engine);
+		Real npv = m_bond.NPV(); // the bond passes the engine's value through as its NPV
+
+		const ConvertibleBond::option::results* results = 
+			dynamic_cast<const ConvertibleBond::option::results*>(engine->getResults());
+		QL_REQUIRE(results, "ConvertibleBondTreePricer: unexpected results type from the engine.");
+		TreeValuation valuation(engine->getSensitivities());
+		valuation.value = npv;
+		valuation.delta = results->delta;
+		valuation.gamma = results->gamma;
+		return valuation;
+	}
+};
+
 // The constructor does the work to generate the results.
 ConvertibleBondCalculator::ConvertibleBondCalculator(
 	         ConvertibleBondContract* pCBondContract, MarketCaches* pMarketCaches,
@@ -120,25 +450,83 @@ ConvertibleBondCalculator::ConvertibleBondCalculator(
                         creditSpread, issueDate, settlementDays,
                         coupons, bondDayCount, schedule, redemption);
 
-	std::string method = "Jarrow-Rudd tree";
-    europeanBond.setPricingEngine(boost::shared_ptr<PricingEngine>(
-              new BinomialConvertibleEngine<JarrowRudd>(stochasticProcess,
-                                                        timeSteps)));
+	// The tree defaults to Jarrow-Rudd, with convertible_bond_richardson 'on' we also price 
+	// with twice the steps and extrapolate.
+	TreeType treeType = getConfigTreeType("convertible_bond_tree_type");
+	std::string richardson = "off";
+	getConfig()->find("convertible_bond_richardson", richardson);
+
+	// With convertible_bond_sensitivities 'on' the rollback also gives the vega, rho, dividend rho 
+	// and the credit spread sensitivity.
+	std::string sensitivities = "off";
+	getConfig()->find("convertible_bond_sensitivities", sensitivities);
+
+	ConvertibleBondTreePricer treePricer(europeanBond, stochasticProcess, sensitivities == "on");
+
+	// With convertible_bond_adaptive_steps 'on' the convertible_bond_time_steps is ignored, the steps
+	// are doubled until the price converges (see getConfigAdaptiveTreeSettings()).
+	std::string adaptiveSteps = "off";
+	getConfig()->find("convertible_bond_adaptive_steps", adaptiveSteps);
+
+	TreeValuation valuation;
+	Size stepsUsed = 0;
+	if(adaptiveSteps == "on")
+		valuation = priceOnTreeAdaptive(treeType, treePricer, getConfigAdaptiveTreeSettings(), richardson == "on", stepsUsed);
+	else
+		valuation = priceOnTree(treeType, treePricer, timeSteps, richardson == "on");
+	Real npv = valuation.value;
 
 	/////////////////////////////////////////////////////////////////////////////
 	boost::shared_ptr<Result> res = (boost::shared_ptr<Result>) new Result();
 		
-	res->setValueAndCategory(price_per_unit_notional, europeanBond.NPV() / m_CBondContract->m_redemption);
+	res->setValueAndCategory(price_per_unit_notional, npv / m_CBondContract->m_redemption);
 
 	res->setAttribute(contract_category, "convertible_bond",                   true);
 	res->setAttribute(contract_id,       m_CBondContract->getID(),             true);
 	res->setAttribute(underlying_id,     m_CBondContract->m_underlyingStockID, true);
 	res->setAttribute(eval_date,         toString(pMarketCaches->getEvalDate(), 
 		                                              getConfig()->getDateFormat()));
+	if(stepsUsed > 0)
+		res->setAttribute(time_steps,    toString(stepsUsed),                  true);
 	pResultSet->addNewResult(res);
 
 	boost::shared_ptr<Result> fullPriceRes = (boost::shared_ptr<Result>) new Result(*res);
-	fullPriceRes->setValueAndCategory(cash_price, europeanBond.NPV() * m_CBondContract->m_numberOfBonds);
+	fullPriceRes->setValueAndCategory(cash_price, npv * m_CBondContract->m_numberOfBonds);
 	fullPriceRes->setAttribute(currency, m_CBondContract->m_currency,  true);
 	pResultSet->addNewResult(fullPriceRes);
+
+	// The delta and gamma are per bond, read from the nodes of the tree.
+	boost::shared_ptr<Result> deltaPCRes = (boost::shared_ptr<Result>) new Result(*res);
+	deltaPCRes->setValueAndCategory(delta_pc, valuation.delta * underlying / m_CBondContract->m_redemption);
+	pResultSet->addNewResult(deltaPCRes);
+
+	boost::shared_ptr<Result> delta1Res = (boost::shared_ptr<Result>) new Result(*res);
+	delta1Res->setValueAndCategory(delta_1, valuation.delta * underlying / 100.0 * m_CBondContract->m_numberOfBonds);
+	delta1Res->setAttribute(currency, m_CBondContract->m_currency,  true);
+	pResultSet->addNewResult(delta1Res);
+
+	boost::shared_ptr<Result> gamma1Res = (boost::shared_ptr<Result>) new Result(*res);
+	gamma1Res->setValueAndCategory(gamma_1, valuation.gamma * underlying * underlying / 10000.0 
+		                                    * m_CBondContract->m_numberOfBonds);
+	gamma1Res->setAttribute(currency, m_CBondContract->m_currency,  true);
+	pResultSet->addNewResult(gamma1Res);
+
+	if(valuation.vega != Null<Real>())
+	{
+		boost::shared_ptr<Result> vega1Res = (boost::shared_ptr<Result>) new Result(*delta1Res);
+		vega1Res->setValueAndCategory(vega_1, valuation.vega / 100.0 * m_CBondContract->m_numberOfBonds);
+		pResultSet->addNewResult(vega1Res);
+
+		boost::shared_ptr<Result> rho1Res = (boost::shared_ptr<Result>) new Result(*delta1Res);
+		rho1Res->setValueAndCategory(rho_1, valuation.rho / 100.0 * m_CBondContract->m_numberOfBonds);
+		pResultSet->addNewResult(rho1Res);
+
+		boost::shared_ptr<Result> divRho1Res = (boost::shared_ptr<Result>) new Result(*delta1Res);
+		divRho1Res->setValueAndCategory(dividend_rho_1, valuation.dividendRho / 100.0 * m_CBondContract->m_numberOfBonds);
+		pResultSet->addNewResult(divRho1Res);
+
+		boost::shared_ptr<Result> spread1Res = (boost::shared_ptr<Result>) new Result(*delta1Res);
+		spread1Res->setValueAndCategory(credit_spread_1, valuation.creditSpreadRho / 100.0 * m_CBondContract->m_numberOfBonds);
+		pResultSet->addNewResult(spread1Res);
+	}
 }
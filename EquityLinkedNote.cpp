@@ -2,21 +2,209 @@
 #include "MarketData.hpp"
 #include "Result.hpp"
 
+namespace
+{
+	boost::shared_ptr<StockData> getELNStockData(EquityLinkedNoteContract* pELNContract, MarketCaches* pMarketCaches)
+	{
+		boost::shared_ptr<StockData> stockData = pMarketCaches->getStockDataCache()->get(
+		                                                         pELNContract->m_underlyingStockID,
+		                                                         pELNContract->m_underlyingStockIDType);
+		
+		QL_REQUIRE(stockData->getCurrency() == pELNContract->m_notionalCurrency,
+		           "EquityLinkedNoteCalculator::EquityLinkedNoteCalculator(..): "
+		           << "Model only deals with case when the stock currency (" << stockData->getCurrency()
+			       << ") is the same as the notional currency (" << pELNContract->m_notionalCurrency
+			       << ")"); // could extend to deal with quanto. Note that physical settlement isn't quanto!
+		return stockData;
+	}
+
+	// The value and Greeks of the put, from the AnalyticEuropeanEngine or from blackScholesPutBatch(..)
+	struct PutGreeks
+	{
+		Real value, delta, gamma, vega, theta, rho, dividendRho;
+	};
+
+	// The results of both calculators. The note is (discFact - put / strike) per unit notional, so its
+	// Greeks are those of the put scaled by -1 / strike, plus the zero coupon bond's rho and theta.
+	void addELNResults(EquityLinkedNoteContract* pELNContract, MarketCaches* pMarketCaches, 
+		               Real spot, DiscountFactor discFact, Time riskFreeTime, const PutGreeks& put,
+					   ResultSet* pResultSet)
+	{
+		boost::shared_ptr<Result> res = (boost::shared_ptr<Result>) new Result();
+		
+		Real strikeDivisor      = 1.0 / ( pELNContract->m_strikePrice == 0.0 ? 1.0 : pELNContract->m_strikePrice);
+		Real valPerUnitNotional = discFact - put.value * strikeDivisor;
+		res->setValueAndCategory(price_per_unit_notional, valPerUnitNotional);
+
+		res->setAttribute(contract_category, "equity_linked_note",              true);
+		res->setAttribute(contract_id,       pELNContract->getID(),             true);
+		res->setAttribute(underlying_id,     pELNContract->m_underlyingStockID, true);
+		res->setAttribute(eval_date,         toString(pMarketCaches->getEvalDate(), 
+		                                              getConfig()->getDateFormat()));
+
+		pResultSet->addNewResult(res);
+
+		boost::shared_ptr<Result> fullPriceRes = (boost::shared_ptr<Result>) new Result(*res);
+		fullPriceRes->setValueAndCategory(cash_price, valPerUnitNotional * pELNContract->m_notional);
+		fullPriceRes->setAttribute(currency, pELNContract->m_notionalCurrency,  true);
+		pResultSet->addNewResult(fullPriceRes);
+
+		// using the copy constructor for Result, saves writing out the code to set the attrs again.
+		boost::shared_ptr<Result> deltaRes = (boost::shared_ptr<Result>) new Result(*res);
+		Real delta = - put.delta * spot * strikeDivisor;
+		deltaRes->setValueAndCategory(delta_pc, delta);
+
+		pResultSet->addNewResult(deltaRes);
+
+		// The rest are cash amounts for the whole notional, so they have a currency
+		Real bondRho   = - riskFreeTime * discFact;
+		Real bondTheta = riskFreeTime > 0.0 ? - std::log(discFact) / riskFreeTime * discFact : 0.0;
+		Real notional  = pELNContract->m_notional;
+
+		boost::shared_ptr<Result> delta1Res = (boost::shared_ptr<Result>) new Result(*fullPriceRes);
+		delta1Res->setValueAndCategory(delta_1, delta / 100.0 * notional);
+		pResultSet->addNewResult(delta1Res);
+
+		boost::shared_ptr<Result> gamma1Res = (boost::shared_ptr<Result>) new Result(*fullPriceRes);
+		gamma1Res->setValueAndCategory(gamma_1, - put.gamma * strikeDivisor * spot * spot / 10000.0 * notional);
+		pResultSet->addNewResult(gamma1Res);
+
+		boost::shared_ptr<Result> vega1Res = (boost::shared_ptr<Result>) new Result(*fullPriceRes);
+		vega1Res->setValueAndCategory(vega_1, - put.vega * strikeDivisor / 100.0 * notional);
+		pResultSet->addNewResult(vega1Res);
+
+		boost::shared_ptr<Result> thetaRes = (boost::shared_ptr<Result>) new Result(*fullPriceRes);
+		thetaRes->setValueAndCategory(theta, (bondTheta - put.theta * strikeDivisor) / 365.0 * notional);
+		pResultSet->addNewResult(thetaRes);
+
+		boost::shared_ptr<Result> rho1Res = (boost::shared_ptr<Result>) new Result(*fullPriceRes);
+		rho1Res->setValueAndCategory(rho_1, (bondRho - put.rho * strikeDivisor) / 100.0 * notional);
+		pResultSet->addNewResult(rho1Res);
+
+		boost::shared_ptr<Result> divRho1Res = (boost::shared_ptr<Result>) new Result(*fullPriceRes);
+		divRho1Res->setValueAndCategory(dividend_rho_1, - put.dividendRho * strikeDivisor / 100.0 * notional);
+		pResultSet->addNewResult(divRho1Res);
+	}
+
+	// As QuantLib's CumulativeNormalDistribution, to within about 1e-16, using the double precision
+	// algorithm of Hart (see G. West, Better approximations to cumulative normal functions, 2005).
+	// Both of Hart's approximations are evaluated and one is selected, so there are no branches.
+	inline Real cumulativeNormal(Real x)
+	{
+		Real xAbs = std::fabs(x);
+		Real e    = std::exp(-0.5 * xAbs * xAbs);
+
+		Real numerator = 3.52624965998911e-02 * xAbs + 0.700383064443688;
+		numerator      = numerator * xAbs + 6.37396220353165;
+		numerator      = numerator * xAbs + 33.912866078383;
+		numerator      = numerator * xAbs + 112.079291497871;
+		numerator      = numerator * xAbs + 221.213596169931;
+		numerator      = numerator * xAbs + 220.206867912376;
+		Real denominator = 8.83883476483184e-02 * xAbs + 1.75566716318264;
+		denominator      = denominator * xAbs + 16.064177579207;
+		denominator      = denominator * xAbs + 86.7807322029461;
+		denominator      = denominator * xAbs + 296.564248779674;
+		denominator      = denominator * xAbs + 637.333633378831;
+		denominator      = denominator * xAbs + 793.826512519948;
+		denominator      = denominator * xAbs + 440.413735824752;
+		Real central     = e * numerator / denominator;
+
+		// the continued fraction for the tails
+		Real fraction = xAbs + 0.65;
+		fraction      = xAbs + 4.0 / fraction;
+		fraction      = xAbs + 3.0 / fraction;
+		fraction      = xAbs + 2.0 / fraction;
+		fraction      = xAbs + 1.0 / fraction;
+		Real tail     = e / fraction / 2.506628274631;
+
+		Real lowerTail = xAbs < 7.07106781186547 ? central : (xAbs < 37.0 ? tail : 0.0);
+		return x > 0.0 ? 1.0 - lowerTail : lowerTail;
+	}
+}
+
+PutBatch::PutBatch(Size n)
+	: spot(n), strike(n), riskFreeDiscount(n), dividendDiscount(n), stdDev(n), 
+	  riskFreeTime(n), dividendTime(n), volTime(n),
+	  value(n), delta(n), gamma(n), vega(n), theta(n), rho(n), dividendRho(n)
+{}
+
+void blackScholesPutBatch(PutBatch& batch)
+{
+	Integer size = (Integer) batch.size(); // signed, for OpenMP / the vectoriser
+	if(size == 0)
+		return;
+
+	// raw pointers, so that the compiler knows the loop is over plain arrays
+	const Real*           spot             = &batch.spot[0];
+	const Real*           strike           = &batch.strike[0];
+	const DiscountFactor* riskFreeDiscount = &batch.riskFreeDiscount[0];
+	const DiscountFactor* dividendDiscount = &batch.dividendDiscount[0];
+	const Real*           stdDev           = &batch.stdDev[0];
+	const Time*           riskFreeTime     = &batch.riskFreeTime[0];
+	const Time*           dividendTime     = &batch.dividendTime[0];
+	const Time*           volTime          = &batch.volTime[0];
+	Real*                 value            = &batch.value[0];
+	Real*                 delta            = &batch.delta[0];
+	Real*                 gamma            = &batch.gamma[0];
+	Real*                 vega             = &batch.vega[0];
+	Real*                 theta            = &batch.theta[0];
+	Real*                 rho              = &batch.rho[0];
+	Real*                 dividendRho      = &batch.dividendRho[0];
+
+	const Real oneOverSqrtTwoPi = 0.398942280401432677939946059934;
+
+	for(Integer i = 0; i < size; i++)
+	{
+		Real forward = spot[i] * dividendDiscount[i] / riskFreeDiscount[i];
+
+		// BlackCalculator's limits: with a zero strike the put is worthless, with zero vol it's the
+		// discounted intrinsic value. At the money, i.e. close(forward, strike), BlackCalculator takes 
+		// d1 = d2 = 0 with zero vol, so N(d1) = 1/2 and n(d1) = 1/sqrt(2 pi), the vega isn't zero and the 
+		// gamma is infinite, its limit as the vol goes to zero. The dummy strike and stdDev keep the log 
+		// and division finite.
+		bool hasVol       = stdDev[i] >= QL_EPSILON && strike[i] > 0.0;
+		Real moneyGap     = std::fabs(forward - strike[i]); // close(..) written out, for positive arguments
+		bool atTheMoney   = !hasVol && strike[i] > 0.0 && moneyGap <= 42.0 * QL_EPSILON * forward 
+		                                               && moneyGap <= 42.0 * QL_EPSILON * strike[i];
+		Real limitCum     = strike[i] <= 0.0 ? 1.0 : (atTheMoney ? 0.5 : (forward > strike[i] ? 1.0 : 0.0));
+		Real limitDensity = atTheMoney ? oneOverSqrtTwoPi : 0.0;
+		Real usedSD       = hasVol ? stdDev[i] : 1.0;
+		Real usedK        = hasVol ? strike[i] : forward;
+
+		Real d1        = std::log(forward / usedK) / usedSD + 0.5 * usedSD;
+		Real d2        = d1 - usedSD;
+		Real cumD1     = hasVol ? cumulativeNormal(d1) : limitCum;
+		Real cumD2     = hasVol ? cumulativeNormal(d2) : limitCum;
+		Real densityD1 = hasVol ? oneOverSqrtTwoPi * std::exp(-0.5 * d1 * d1) : limitDensity;
+
+		// as in BlackCalculator, for a put
+		Real alpha     = cumD1 - 1.0;
+		Real beta      = 1.0 - cumD2;
+		value[i]       = riskFreeDiscount[i] * (forward * alpha + strike[i] * beta);
+		delta[i]       = dividendDiscount[i] * alpha;
+		gamma[i]       = densityD1 > 0.0 ? dividendDiscount[i] * densityD1 / (spot[i] * stdDev[i]) : 0.0;
+		vega[i]        = spot[i] * dividendDiscount[i] * densityD1 * std::sqrt(volTime[i]);
+		rho[i]         = - riskFreeTime[i] * riskFreeDiscount[i] * strike[i] * beta;
+		dividendRho[i] = - dividendTime[i] * spot[i] * dividendDiscount[i] * alpha;
+
+		// BlackCalculator::theta(spot, volTime), from the Black-Scholes equation. The variance times the 
+		// spot squared times the gamma is written out, so that it stays finite with the infinite gamma.
+		bool hasTime   = volTime[i] > 0.0;
+		Real usedTime  = hasTime ? volTime[i] : 1.0;
+		theta[i]       = hasTime ? - (std::log(riskFreeDiscount[i]) * value[i] 
+		                              + std::log(forward / spot[i]) * spot[i] * delta[i]
+									  + 0.5 * stdDev[i] * spot[i] * dividendDiscount[i] * densityD1) / usedTime
+								 : 0.0;
+	}
+}
+
 // The constructor does the work to generate the results.
 EquityLinkedNoteCalculator::EquityLinkedNoteCalculator(
 	         EquityLinkedNoteContract* pELNContract, MarketCaches* pMarketCaches,
 		     ResultSet* pResultSet) // constructor will set the resultSet
 				  : CalculatorBase(pELNContract, pMarketCaches, pResultSet)
 {
-	boost::shared_ptr<StockData> stockData = pMarketCaches->getStockDataCache()->get(
-		                                                         pELNContract->m_underlyingStockID,
-		                                                         pELNContract->m_underlyingStockIDType);
-		
-	QL_REQUIRE(stockData->getCurrency() == pELNContract->m_notionalCurrency,
-		       "EquityLinkedNoteCalculator::EquityLinkedNoteCalculator(..): "
-		       << "Model only deals with case when the stock currency (" << stockData->getCurrency()
-			   << ") is the same as the notional currency (" << pELNContract->m_notionalCurrency
-			   << ")"); // could extend to deal with quanto. Note that physical settlement isn't quanto!
+	boost::shared_ptr<StockData> stockData = getELNStockData(pELNContract, pMarketCaches);
 
 	boost::shared_ptr<Exercise> europeanExercise(new EuropeanExercise(pELNContract->m_finalObservation));
  
@@ -55,32 +243,92 @@ EquityLinkedNoteCalculator::EquityLinkedNoteCalculator(
                                      new AnalyticEuropeanEngine(bsmProcess)));
 
 	/////////////////////////////////////////////////////////////////////////////
-	boost::shared_ptr<Result> res = (boost::shared_ptr<Result>) new Result();
-		
-	Real strikeDivisor      = 1.0 / ( pELNContract->m_strikePrice == 0.0 ? 1.0 : pELNContract->m_strikePrice);
-	Real discFact           = yieldTS->discount( pELNContract->m_finalObservation); 
-	Real valPerUnitNotional = discFact - europeanOption.NPV() * strikeDivisor;
-	res->setValueAndCategory(price_per_unit_notional, valPerUnitNotional);
-
-	res->setAttribute(contract_category, "equity_linked_note",              true);
-	res->setAttribute(contract_id,       pELNContract->getID(),             true);
-	res->setAttribute(underlying_id,     pELNContract->m_underlyingStockID, true);
-	res->setAttribute(eval_date,         toString(pMarketCaches->getEvalDate(), 
-		                                              getConfig()->getDateFormat()));
+	Real discFact     = yieldTS->discount( pELNContract->m_finalObservation); 
+	Time riskFreeTime = yieldTS->dayCounter().yearFraction(yieldTS->referenceDate(), pELNContract->m_finalObservation);
+
+	// all of these come from the one calculation of the engine
+	PutGreeks put;
+	put.value       = europeanOption.NPV();
+	put.delta       = europeanOption.delta();
+	put.gamma       = europeanOption.gamma();
+	put.vega        = europeanOption.vega();
+	put.theta       = europeanOption.theta();
+	put.rho         = europeanOption.rho();
+	put.dividendRho = europeanOption.dividendRho();
+	addELNResults(pELNContract, pMarketCaches, prices->getCurrentPrice(), discFact, riskFreeTime, put, pResultSet);
+}
+
+EquityLinkedNoteBatchCalculator::EquityLinkedNoteBatchCalculator(
+	                    const std::vector<EquityLinkedNoteContract*>& pELNContracts, 
+		                MarketCaches*                                 pMarketCaches,
+						const std::vector<ResultSet*>&                pResultSets)
+{
+	QL_REQUIRE(pELNContracts.size() == pResultSets.size(), 
+		       "EquityLinkedNoteBatchCalculator::EquityLinkedNoteBatchCalculator(..): have " << pELNContracts.size()
+			   << " contracts but " << pResultSets.size() << " result sets.");
+
+	Date       evalDate   = pMarketCaches->getEvalDate();
+	DayCounter dayCounter = Actual365Fixed(); // as the flat dividend and vol term structures of the EquityLinkedNoteCalculator
+
+	std::vector<Size> batchContracts; // the indices of the notes in the batch
+	for(Size i = 0; i < pELNContracts.size(); i++)
+	{
+		QL_REQUIRE(pELNContracts[i] != NULL, 
+			       "EquityLinkedNoteBatchCalculator::EquityLinkedNoteBatchCalculator(..): Have been passed a NULL pointer "
+			       << "as contract number " << i + 1 << ".\nThis may have been caused by a failed dynamic_cast.");
+
+		if(pELNContracts[i]->m_finalObservation <= evalDate) // leaving QuantLib to decide how to value these
+			EquityLinkedNoteCalculator(pELNContracts[i], pMarketCaches, pResultSets[i]);
+		else
+			batchContracts.push_back(i);
+	}
+	if(batchContracts.empty())
+		return;
+
+	// Gathering the inputs
+	PutBatch batch(batchContracts.size());
+	for(Size j = 0; j < batchContracts.size(); j++)
+	{
+		EquityLinkedNoteContract* pELNContract = pELNContracts[batchContracts[j]];
+
+		boost::shared_ptr<StockData> stockData = getELNStockData(pELNContract, pMarketCaches);
+		boost::shared_ptr<Prices>    prices    = pMarketCaches->getStockPricesCache()
+		                                                     ->get(pELNContract->m_underlyingStockID,
+		                                                           pELNContract->m_underlyingStockIDType);
+		boost::shared_ptr<YieldTermStructure> yieldTS = pMarketCaches->getYieldTSCache()
+			                                                 ->get(CONST_STR_risk_free_rate, pELNContract->m_notionalCurrency);
+
+		Time t = dayCounter.yearFraction(evalDate, pELNContract->m_finalObservation);
 
-	pResultSet->addNewResult(res);
+		batch.spot            [j] = prices->getCurrentPrice();
+		batch.strike          [j] = pELNContract->m_strikePrice;
+		batch.riskFreeDiscount[j] = yieldTS->discount(pELNContract->m_finalObservation);
+		batch.dividendDiscount[j] = std::exp(-stockData->getDividendYield() * t);
+		batch.stdDev          [j] = std::sqrt(stockData->getFlatVol() * stockData->getFlatVol() * t);
+		batch.riskFreeTime    [j] = yieldTS->dayCounter().yearFraction(yieldTS->referenceDate(), pELNContract->m_finalObservation);
+		batch.dividendTime    [j] = t;
+		batch.volTime         [j] = t;
+	}
 
-	boost::shared_ptr<Result> fullPriceRes = (boost::shared_ptr<Result>) new Result(*res);
-	fullPriceRes->setValueAndCategory(cash_price, valPerUnitNotional * pELNContract->m_notional);
-	fullPriceRes->setAttribute(currency, pELNContract->m_notionalCurrency,  true);
-	pResultSet->addNewResult(fullPriceRes);
+	blackScholesPutBatch(batch);
 
-	// using the copy constructor for Result, saves writing out the code to set the attrs again.
-	boost::shared_ptr<Result> deltaRes = (boost::shared_ptr<Result>) new Result(*res);
-	Real delta = - europeanOption.delta() * prices->getCurrentPrice() * strikeDivisor;
-	deltaRes->setValueAndCategory(delta_pc, delta);
+	for(Size j = 0; j < batchContracts.size(); j++)
+	{
+		PutGreeks put;
+		put.value       = batch.value[j];
+		put.delta       = batch.delta[j];
+		put.gamma       = batch.gamma[j];
+		put.vega        = batch.vega[j];
+		put.theta       = batch.theta[j];
+		put.rho         = batch.rho[j];
+		put.dividendRho = batch.dividendRho[j];
 
-	pResultSet->addNewResult(deltaRes);
+		Size i = batchContracts[j];
+		addELNResults(pELNContracts[i], pMarketCaches, batch.spot[j], batch.riskFreeDiscount[j], batch.riskFreeTime[j], 
+			          put, pResultSets[i]);
+	}
+	writeDiagnostics("Priced " + toString(batchContracts.size()) + " of " + toString(pELNContracts.size()) 
+		             + " equity linked notes in the batch.", mid, "EquityLinkedNoteBatchCalculator");
 }
 
 EquityLinkedNoteContract::EquityLinkedNoteContract(const boost::property_tree::ptree &pt)
@@ -29,6 +29,53 @@ public:
 		                      ResultSet* pResultSet); // constructor will set the resultSet
 };
 
+// Prices many ELNs together (used when eln_batch is 'on' in the config). The inputs of all the notes
+// are gathered into a PutBatch and the puts are valued in one pass of blackScholesPutBatch(..),
+// rather than building a process, term structures, option and engine for each note.
+// Notes whose final observation is not after the eval date are left to the EquityLinkedNoteCalculator.
+class EquityLinkedNoteBatchCalculator
+{
+public:
+	// The results for pELNContracts[i] are added to pResultSets[i].
+	EquityLinkedNoteBatchCalculator(const std::vector<EquityLinkedNoteContract*>& pELNContracts, 
+		                            MarketCaches*                                 pMarketCaches,
+									const std::vector<ResultSet*>&                pResultSets);
+};
+
+// The inputs and outputs of blackScholesPutBatch(..), one element per put, each in a contiguous array.
+// The times are from the day counters of the risk free curve, the dividend curve and the vol,
+// as in QuantLib's AnalyticEuropeanEngine.
+struct PutBatch
+{
+	// inputs
+	std::vector<Real>           spot;
+	std::vector<Real>           strike;
+	std::vector<DiscountFactor> riskFreeDiscount;
+	std::vector<DiscountFactor> dividendDiscount;
+	std::vector<Real>           stdDev;            // vol * sqrt(volTime)
+	std::vector<Time>           riskFreeTime;
+	std::vector<Time>           dividendTime;
+	std::vector<Time>           volTime;
+
+	// outputs, as the AnalyticEuropeanEngine's results (the theta is per year)
+	std::vector<Real>           value;
+	std::vector<Real>           delta;
+	std::vector<Real>           gamma;
+	std::vector<Real>           vega;
+	std::vector<Real>           theta;
+	std::vector<Real>           rho;
+	std::vector<Real>           dividendRho;
+
+	PutBatch(Size n);
+	Size size() const { return spot.size(); }
+};
+
+// Black-Scholes puts, with their Greeks, as QuantLib's AnalyticEuropeanEngine would value them 
+// (including BlackCalculator's limits of a zero strike or zero vol, where the gamma at the money is
+// infinite). The loop has no branches and uses a branch free normal distribution, so the compiler 
+// can vectorise it.
+void blackScholesPutBatch(PutBatch& batch);
+
 #endif
 
 
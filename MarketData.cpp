@@ -1,4 +1,5 @@
 #include "MarketData.hpp"
+#include "MarketDataSnapshot.hpp"
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -8,12 +9,17 @@ CalendarXMLSource::CalendarXMLSource(MarketCaches* marketCaches)
 		    (marketCaches, "calendars_xml_filename", "market_data.calendars")  // the base class
 {
     m_usingSingleKey = true; // the default is false, which means using dual key.
+
+	boost::property_tree::ptree::const_iterator iter;
+	for(iter = m_PropTree.begin(); iter != m_PropTree.end(); iter++)
+		if(CONST_STR_calendar == iter->first.data())
+			addToIndex(pt_get<std::string>(iter->second, "id"), iter->second, CONST_STR_calendar);
 }
 
 //return type: boost::shared_ptr<CacheSingleKey<boost::shared_ptr<Calendar> > > 
 MarketCaches::CalendarCacheSharedPointer  MarketCaches::getCalendarCache()
 {
-	return getCache<boost::shared_ptr<Calendar>, CalendarXMLSource, CacheSingleKey<boost::shared_ptr<Calendar> > >
+	return getCache<boost::shared_ptr<Calendar>, CalendarXMLSource, CalendarSnapshotSource, CacheSingleKey<boost::shared_ptr<Calendar> > >
 		             ("calendar_source", // the key used in the config to specify the data source 
 	                  &m_calendarCache); // this will be set
 }
@@ -21,7 +27,11 @@ MarketCaches::CalendarCacheSharedPointer  MarketCaches::getCalendarCache()
 //return type: boost::shared_ptr<CacheDualKey<boost::shared_ptr<Prices> > > 
 MarketCaches::StockPricesCacheSharedPointer  MarketCaches::getStockPricesCache()
 {
-	return getCache<boost::shared_ptr<Prices>, StockPricesXMLSource, CacheDualKey<boost::shared_ptr<Prices> > >
+	if( (m_stockPricesCache == NULL) && usingPricesXMLStream() )
+		m_stockPricesCache = (StockPricesCacheSharedPointer) new CacheDualKey<PricesSharedPointer>
+		                         ((boost::shared_ptr<StockPricesXMLStreamSource>) new StockPricesXMLStreamSource(this));
+
+	return getCache<boost::shared_ptr<Prices>, StockPricesXMLSource, StockPricesSnapshotSource, CacheDualKey<boost::shared_ptr<Prices> > >
 		             ("prices_source",      // the key used in the config to specify the data source 
 	                  &m_stockPricesCache); // this will be set
 }
@@ -29,7 +39,11 @@ MarketCaches::StockPricesCacheSharedPointer  MarketCaches::getStockPricesCache()
 //return type: boost::shared_ptr<CacheDualKey<boost::shared_ptr<Prices> > > 
 MarketCaches::FXPricesCacheSharedPointer  MarketCaches::getFXPricesCache()
 {
-	return getCache<boost::shared_ptr<Prices>, FXPricesXMLSource, CacheDualKey<boost::shared_ptr<Prices> > >
+	if( (m_FXPricesCache == NULL) && usingPricesXMLStream() )
+		m_FXPricesCache = (FXPricesCacheSharedPointer) new CacheDualKey<PricesSharedPointer>
+		                      ((boost::shared_ptr<FXPricesXMLStreamSource>) new FXPricesXMLStreamSource(this));
+
+	return getCache<boost::shared_ptr<Prices>, FXPricesXMLSource, FXPricesSnapshotSource, CacheDualKey<boost::shared_ptr<Prices> > >
 		             ("prices_source",      // the key used in the config to specify the data source 
 	                  &m_FXPricesCache); // this will be set
 }
@@ -37,48 +51,43 @@ MarketCaches::FXPricesCacheSharedPointer  MarketCaches::getFXPricesCache()
 // get(..) will throw an error if the Calendar is not found.
 boost::shared_ptr<Calendar> CalendarXMLSource::get_s(const std::string& calID)// , const std::string& ignoredParameter)
 {    
-	boost::shared_ptr<Calendar> cal;
-
-	boost::property_tree::ptree::const_iterator iter = m_PropTree.begin();			
-	bool found = false;
-	while( ( iter != m_PropTree.end() ) && !found)
-	{   
-		if(CONST_STR_calendar == iter->first.data() )
-		{   
-			std::string cal_IDinXML = iter->second.get<std::string>("id");
-            
-			if( cal_IDinXML == calID)
-			{   
-				boost::shared_ptr<BespokeCalendar> bCal = (boost::shared_ptr<BespokeCalendar>) new BespokeCalendar(calID);
-				bCal->addWeekend(Saturday);
-				bCal->addWeekend(Sunday);
-
-				std::vector<Date> holDates;
-                getVectorOfDatesFromBasicPTree(iter->second , "holiday", holDates); 
-				addVectorOfHolidays(&(*bCal), holDates);
-
-				cal = (boost::shared_ptr<Calendar>) bCal;
-
-				found  = true;
-			}
-		}
-		iter++; // keep searching
-	}			// end of while(..)
-	QL_REQUIRE(found, "Was unable to find the holiday calendar " << calID
+	const boost::property_tree::ptree* node = findInIndex(calID);
+	QL_REQUIRE(node, "Was unable to find the holiday calendar " << calID
 		              << " in the xml market data.");
-	return cal;
+
+	boost::shared_ptr<BespokeCalendar> bCal = (boost::shared_ptr<BespokeCalendar>) new BespokeCalendar(calID);
+	bCal->addWeekend(Saturday);
+	bCal->addWeekend(Sunday);
+
+	std::vector<Date> holDates;
+    getVectorOfDatesFromBasicPTree(*node, "holiday", holDates); 
+	addVectorOfHolidays(&(*bCal), holDates);
+
+	return (boost::shared_ptr<Calendar>) bCal;
 }               // end of method          
 
 ////////////////////////////////////////////////////////////////////////////////////////
 FXVolXMLSource::FXVolXMLSource(MarketCaches* marketCaches)
 		: 	MarketObjXMLSource<boost::shared_ptr<BlackVolTermStructure> >      
 		    (marketCaches, "fx_vol_data_xml_filename", "market_data.fx_vols")  
-{}
+{
+	boost::property_tree::ptree::const_iterator iter;
+	for(iter = m_PropTree.begin(); iter != m_PropTree.end(); iter++)
+		if(CONST_STR_fx_vol == iter->first.data())
+			addToIndex(getCurrencyPairKey(pt_get<std::string>(iter->second, "ccy1"), 
+			                              pt_get<std::string>(iter->second, "ccy2")),
+					   iter->second, CONST_STR_fx_vol);
+}
 
 YieldTS_XMLSource::YieldTS_XMLSource(MarketCaches* marketCaches)
 	: 	MarketObjXMLSource<boost::shared_ptr<YieldTermStructure> >
 	    (marketCaches, "risk_free_rate_xml_filename", "market_data.risk_free_rates")
-{}
+{
+	boost::property_tree::ptree::const_iterator iter;
+	for(iter = m_PropTree.begin(); iter != m_PropTree.end(); iter++)
+		if(CONST_STR_risk_free_rate == iter->first.data())
+			addToIndex(pt_get<std::string>(iter->second, "currency"), iter->second, CONST_STR_risk_free_rate);
+}
 
 StockData::StockData()                         
 { 
@@ -115,9 +124,9 @@ std::string  StockData::getHolidayCalendarID()
 }
 
 Real StockData::getFlatVol()              
-{ 
-	QL_REQUIRE( m_flatVol > 0.0, "StockData::getFlatVol(): " << m_ID 
-			<< " The flat vol (" << m_flatVol << ") has not yet been set to a valid vol, i.e. > 0.");
+{   // a zero vol is allowed, the analytic engines take its limit (the unset vol is -1)
+	QL_REQUIRE( m_flatVol >= 0.0, "StockData::getFlatVol(): " << m_ID 
+			<< " The flat vol (" << m_flatVol << ") has not yet been set to a valid vol, i.e. >= 0.");
 
 	return m_flatVol;     
 }
@@ -203,21 +212,32 @@ StockDataXMLSource::StockDataXMLSource(MarketCaches* marketCaches)
 		    (marketCaches, 
 			"stock_data_xml_filename", // tag in config xml used to specify the path to xml data 
 			"market_data.stock_data")  // tag in the market data
-	{}
+{
+	indexByIDAndIDType(CONST_STR_stock);
+}
 
 StockPricesXMLSource::StockPricesXMLSource(MarketCaches* marketCaches)
 		: 	MarketObjXMLSource<boost::shared_ptr<Prices> >
 		    (marketCaches,
 			"prices_xml_path",     // tag in config xml used to specify the path to xml data 
 			"market_data.prices")  // tag in the market data
-	{}
+{
+	indexByIDAndIDType(CONST_STR_item);
+}
 
 FXPricesXMLSource::FXPricesXMLSource(MarketCaches* marketCaches)
 		: 	MarketObjXMLSource<boost::shared_ptr<Prices> >
 		    (marketCaches,
 			"prices_xml_path",       // tag in config xml used to specify the path to xml data 
 			"market_data.fx_spots")  // tag in the market data
-	{}
+{
+	boost::property_tree::ptree::const_iterator iter;
+	for(iter = m_PropTree.begin(); iter != m_PropTree.end(); iter++)
+		if(CONST_STR_item == iter->first.data())
+			addToIndex(getCurrencyPairKey(pt_get<std::string>(iter->second, "id1"), 
+			                              pt_get<std::string>(iter->second, "id2")),
+					   iter->second, CONST_STR_item);
+}
 
 MarketCaches::MarketCaches()  // Constructor.
 {   // The caches will be initialized only when they are requested.
@@ -234,6 +254,8 @@ void MarketCaches::initialize()
 		m_evalDate = Date::todaysDate();
 	else
 		m_evalDate = stringToDate(evalDateStr, getConfig()->getDateFormat());
+
+	m_latticeCache.clear(); // the lattices depend on the eval date
 }
 
 MarketCaches::MarketCaches(const std::string& pathToXMLMarketData)
@@ -245,7 +267,7 @@ MarketCaches::MarketCaches(const std::string& pathToXMLMarketData)
 //return type: boost::shared_ptr<CacheDualKey<boost::shared_ptr<YieldTermStructure> > > 
 MarketCaches::YieldTSCacheSmartPointer MarketCaches::getYieldTSCache()
 {
-	return getCache<boost::shared_ptr <YieldTermStructure>, YieldTS_XMLSource, CacheDualKey<boost::shared_ptr<YieldTermStructure> > >
+	return getCache<boost::shared_ptr <YieldTermStructure>, YieldTS_XMLSource, YieldTS_SnapshotSource, CacheDualKey<boost::shared_ptr<YieldTermStructure> > >
 	              ("yield_term_structure", // the key used in the config to specify the data source 
 				  &m_YieldTSCache);        // this will be set
 }
@@ -253,7 +275,7 @@ MarketCaches::YieldTSCacheSmartPointer MarketCaches::getYieldTSCache()
 /////////////////////////////////////////////////////////////////////////////
 MarketCaches::FXVolCacheSmartPointer  MarketCaches::getFXVolCache()
 {
-	return getCache<boost::shared_ptr<BlackVolTermStructure>, FXVolXMLSource, CacheDualKey<boost::shared_ptr<BlackVolTermStructure> > >
+	return getCache<boost::shared_ptr<BlackVolTermStructure>, FXVolXMLSource, FXVolSnapshotSource, CacheDualKey<boost::shared_ptr<BlackVolTermStructure> > >
 		           ("fx_vol_source",                // the key used in the config to specify the data source 
 	               &m_FXVolCache);                  // this will be set
 }
@@ -277,9 +299,22 @@ Date MarketCaches::getEvalDate()
 	return m_evalDate; 
 }
 
+MarketCaches::LatticeSharedPointer MarketCaches::findLattice(const std::string& key)
+{
+	std::map<std::string, LatticeSharedPointer>::const_iterator iter = m_latticeCache.find(key);
+	if(iter == m_latticeCache.end())
+		return LatticeSharedPointer();
+	return iter->second;
+}
+
+void MarketCaches::addLattice(const std::string& key, const LatticeSharedPointer& lattice)
+{
+	m_latticeCache[key] = lattice;
+}
+
 MarketCaches::StockDataCacheSharedPointer  MarketCaches::getStockDataCache()
 {
-	return getCache<boost::shared_ptr<StockData>, StockDataXMLSource, CacheDualKey<boost::shared_ptr<StockData> > >
+	return getCache<boost::shared_ptr<StockData>, StockDataXMLSource, StockDataSnapshotSource, CacheDualKey<boost::shared_ptr<StockData> > >
 		           ("stock_data",                 // the key used in the config to specify the data source 
 				   &m_stockDataCache);
 }
@@ -297,40 +332,20 @@ boost::shared_ptr<BlackVolTermStructure> FXVolXMLSource::get(const std::string&
 	QL_REQUIRE( currency1 != currency2, "FXVolXMLSource::get(..): There's no FX vol between currency: '"
 		                                << currency1 << "' and itself.");
 
-	boost::shared_ptr<BlackVolTermStructure> volObj;
-	bool found = false;
+	const boost::property_tree::ptree* node = findInIndex(getCurrencyPairKey(currency1, currency2));
+	QL_REQUIRE(node, "Was unable to find volatility in the xml market data for: " 
+		              << currency1 << "-" << currency2);
 
-	using boost::property_tree::ptree;
-    ptree::const_iterator iter = m_PropTree.begin();
-			
-	while( ( iter != m_PropTree.end() ) && !found)
-	{
-		if( CONST_STR_fx_vol == iter->first.data() )
-		{   
-			std::string dataCcy1 = iter->second.get<std::string>("ccy1");
-			std::string dataCcy2 = iter->second.get<std::string>("ccy2");
+    Real FXVol = node->get<Real>("vol");
+    QL_REQUIRE(FXVol > 0, "FXVolXMLSource::get(..): Found FX vol for " 
+		                   << currency1 << " " << currency2  << " to be " << FXVol 
+						   << ", but it should be strictly greater than zero."); 
 
-			if(   ( (dataCcy1 == currency1) && (dataCcy2 == currency2) )
-			   || ( (dataCcy1 == currency2) && (dataCcy2 == currency1) ) )
-			{
-                 Real FXVol = iter->second.get<Real>("vol");
-			     QL_REQUIRE(FXVol > 0, "FXVolXMLSource::get(..): Found FX vol for " 
-					                    << dataCcy1 << " " << dataCcy2  << " to be " << FXVol 
-									    << ", but it should be strictly greater than zero."); 
-
-				 volObj = (boost::shared_ptr<BlackVolTermStructure>)
-					             new BlackConstantVol(m_marketCaches->getEvalDate(), 
-				                                      TARGET(),       // for now will use the target calendar 
-				                                      FXVol,
-                                                      Actual365Fixed() );
-				 found  = true;
-			}
-		}		// end of if( tag == v.first.data() ) ...
-		iter++; // keep searching
-	}			// end of while(..)
-	QL_REQUIRE(found, "Was unable to find volatility in the xml market data for: " 
-		              << currency1 << "-" << currency2);
-	return volObj;
+	return (boost::shared_ptr<BlackVolTermStructure>)
+		             new BlackConstantVol(m_marketCaches->getEvalDate(), 
+		                                  TARGET(),       // for now will use the target calendar 
+				                          FXVol,
+                                          Actual365Fixed() );
 }               // end of method          
 
 // get(..) will throw an error if the Yield Term Structure is not found.
@@ -346,118 +361,65 @@ boost::shared_ptr<YieldTermStructure> YieldTS_XMLSource::get(const std::string&
 	QL_REQUIRE( currency.size() > 0,  
 		        "YieldTS_XMLSource::get(..): currency identifier can't be empty string.");
     
-	boost::shared_ptr<YieldTermStructure> yieldTS;
-	bool found = false;
+	const boost::property_tree::ptree* node = findInIndex(currency);
+	QL_REQUIRE(node, "YieldTS_XMLSource::get(..): Was unable to find risk_free_rate in the xml market data for: " 
+		              << currency);
 
-	using boost::property_tree::ptree;
-    ptree::const_iterator iter = m_PropTree.begin();
-			
-	while( ( iter != m_PropTree.end() ) && !found)
-	{
-		if( iter->first.data() == CONST_STR_risk_free_rate ) // i.e. found the 'risk_free_rate' tag
-		{   
-			std::string dataCcy = iter->second.get<std::string>("currency");
+    Real flatRate = node->get<Real>("flat_rate");
+    QL_REQUIRE(flatRate >= 0, "YieldTS_XMLSource::get(..): Found flat_rate for " 
+		                      << currency << " to be " << flatRate * 100.0
+						      << "%, but it should be greater than or equal to zero."); 
 
-			if(dataCcy == currency)
-			{
-                 Real flatRate = iter->second.get<Real>("flat_rate");
-			     QL_REQUIRE(flatRate >= 0, "YieldTS_XMLSource::get(..): Found flat_rate for " 
-					                       << currency << " to be " << flatRate * 100.0
-									       << "%, but it should be greater than or equal to zero."); 
+    QL_REQUIRE(flatRate < 1,  "YieldTS_XMLSource::get(..): Found flat_rate for " 
+		                      << currency << " to be " << flatRate * 100.0 
+						      << "%, but it should be less than 100%."); 
 
-			     QL_REQUIRE(flatRate < 1,  "YieldTS_XMLSource::get(..): Found flat_rate for " 
-					                       << currency << " to be " << flatRate * 100.0 
-									       << "%, but it should be less than 100%."); 
+	writeDiagnostics("Found YieldTS in xml source, with flat rate: " + toString(flatRate),
+		              high, "YieldTS_XMLSource::get");
 
-                 yieldTS = (boost::shared_ptr<YieldTermStructure>) 
-					       new FlatForward(m_marketCaches->getEvalDate(), flatRate, Actual365Fixed() );
-
-				 writeDiagnostics("Found YieldTS in xml source, with flat rate: " + toString(flatRate),
-					              high, "YieldTS_XMLSource::get");
-				 found  = true;
-			}
-		}		// end of if( CONST_STR_risk_free_rate == iter->first.data() ) ...
-		iter++; // keep searching
-	}			// end of while(..)
-	QL_REQUIRE(found, "YieldTS_XMLSource::get(..): Was unable to find risk_free_rate in the xml market data for: " 
-		              << currency);
-	return yieldTS;
+    return (boost::shared_ptr<YieldTermStructure>) 
+		       new FlatForward(m_marketCaches->getEvalDate(), flatRate, Actual365Fixed() );
 }               // end of method          
 
 boost::shared_ptr<Prices> StockPricesXMLSource::get(const std::string& ID, const std::string& IDType)
 {
 	QL_REQUIRE(ID.length(), "StockPricesXMLSource::get(..): can't get the price with ID an empty string");
 
-	boost::shared_ptr<Prices> prices;
-	bool found = false;
+	const boost::property_tree::ptree* node = findByIDAndIDType(ID, IDType);
+	QL_REQUIRE(node, "StockPricesXMLSource::get(..):\n"
+		<< "Was unable to find the stock prices for: "  
+		<< (IDType.length() > 0 ? toString("") : IDType + toString(": "))
+		<< ID);
 
-	using boost::property_tree::ptree;
-    ptree::const_iterator iter = m_PropTree.begin();
-			
-	while( ( iter != m_PropTree.end() ) && !found)
+	boost::shared_ptr<Prices> prices = (boost::shared_ptr<Prices>) new Prices(m_marketCaches->getEvalDate(), ID);
+
+	boost::optional<Real> currentPrice;
+	if( currentPrice = node->get_optional<Real>("current_price")) // was able to obtain the object from the ptree
+		prices->setCurrentPrice(*currentPrice);
+
+	boost::property_tree::basic_ptree<std::string, std::string>::const_iterator innerIterator = node->begin();
+	while( innerIterator != node->end())
 	{
-		if( iter->first.data() == CONST_STR_item)
-		{   
-			std::string IDinData      = iter->second.get<std::string>("id");
-			
-			boost::optional<std::string> ID_typeInData;
+		if(!strcmp(innerIterator->first.c_str(),"price"))
+		{
+			Date date  = pt_getDateOptional   (innerIterator->second, "date",  Date());
+			Real price = pt_get_optional<Real>(innerIterator->second, "value", -99999.0);
 
-			bool matchingIDTypes = true; 
-			// We have two values for ID type, one is passed into this method (IDType), 
-			// the other (IDTypeInData) is obtained from the xml data. 
-			// If either is an empyt string then matchingIDTypes is set to true
-			// otherwise mathcingIDTypes = ( IDType == IDTypeInData)
-			
-			if( ID_typeInData = iter->second.get_optional<std::string>("id_type"))
-			{   // have been able to retrieve ID_type from xml data 
-				if(IDType.size() != 0)
-					matchingIDTypes = ( (*ID_typeInData) == IDType);
-			}   // otherwise leave matchingIDTypes at true.
-		
-			// matchingIDTypes(..) will return true if either string is empty.
-			if((IDinData == ID) && matchingIDTypes)
+			if((date != Date()) && (price != -99999.0))
 			{
-				prices = (boost::shared_ptr<Prices>) new Prices(m_marketCaches->getEvalDate(), ID);
-
-				boost::optional<Real> currentPrice;
-				if( currentPrice = iter->second.get_optional<Real>("current_price")) // was able to obtain the object from the ptree
-					prices->setCurrentPrice(*currentPrice);
-
-				boost::property_tree::basic_ptree<std::string, std::string>::const_iterator innerIterator = iter->second.begin();
-				while( innerIterator != iter->second.end())
-				{
-					if(!strcmp(innerIterator->first.c_str(),"price"))
-					{
-						Date date  = pt_getDateOptional   (innerIterator->second, "date",  Date());
-						Real price = pt_get_optional<Real>(innerIterator->second, "value", -99999.0);
-
-						if((date != Date()) && (price != -99999.0))
-						{
-							prices->addPrice(date, price);
-							writeDiagnostics("For " + ID + ", added date " + toString(date) + " with price " + toString(price),
-							                 high, "StockPricesXMLSource::get");
-						}
-						else
-						{
-							std::string msg =  "For " + ID + " was unable to get a valid price and date from the node:\n"
-							                 + toString(innerIterator->second); 
-							writeDiagnostics(msg, low, "StockPricesXMLSource::get");
-						}
-					}
- 
-					innerIterator++;
-				}
-
-				found = true;
+				prices->addPrice(date, price);
+				writeDiagnostics("For " + ID + ", added date " + toString(date) + " with price " + toString(price),
+				                 high, "StockPricesXMLSource::get");
+			}
+			else
+			{
+				std::string msg =  "For " + ID + " was unable to get a valid price and date from the node:\n"
+				                 + toString(innerIterator->second); 
+				writeDiagnostics(msg, low, "StockPricesXMLSource::get");
 			}
-			iter++;
 		}
+		innerIterator++;
 	}
-	QL_REQUIRE(found, "StockPricesXMLSource::get(..):\n"
-		<< "Was unable to find the stock prices for: "  
-		<< (IDType.length() > 0 ? toString("") : IDType + toString(": "))
-		<< ID);
-
 	return prices;
 }
 
@@ -467,67 +429,47 @@ boost::shared_ptr<Prices> FXPricesXMLSource::get(const std::string& ID1, const s
 	QL_REQUIRE( ID1.length() == 3, "FXPricesXMLSource::get(..): FX ID1 must be 3 letters here it is: " << ID1 << ".");
 	QL_REQUIRE( ID2.length() == 3, "FXPricesXMLSource::get(..): FX ID2 must be 3 letters here it is: " << ID2 << ".");
 
-	boost::shared_ptr<Prices> prices;
-	bool found = false;
-	boost::property_tree::ptree::const_iterator iter = m_PropTree.begin();
-			
-	while( ( iter != m_PropTree.end() ) && !found)
+	const boost::property_tree::ptree* node = findInIndex(getCurrencyPairKey(ID1, ID2));
+	QL_REQUIRE(node, "FXPricesXMLSource::get(..):\n"
+		<< "Was unable to find the FX Prices for: " << ID1 << " - " << ID2);  
+
+	// the data may be quoted the other way round
+	bool isReciprocal = (pt_get<std::string>(*node, "id1") != ID1);
+	boost::shared_ptr<Prices> prices = (boost::shared_ptr<Prices>) new Prices(m_marketCaches->getEvalDate(), ID1, ID2);
+
+	Real currentPrice = pt_get_optional<Real>(*node, "current_price", 0.0); 
+	if( currentPrice > 0.0)
+		prices->setCurrentPrice(isReciprocal ? 1.0/currentPrice : currentPrice);
+
+	boost::property_tree::basic_ptree<std::string, std::string>::const_iterator innerIterator = node->begin();
+	while( innerIterator != node->end())
 	{
-		if( iter->first.data() == CONST_STR_item)
-		{   
-			std::string ID1inData      = pt_get<std::string>( iter->second, "id1");
-			std::string ID2inData      = pt_get<std::string>( iter->second, "id2");
-
-			if(    ((ID1inData == ID1) && (ID2inData == ID2))
-				|| ((ID1inData == ID2) && (ID2inData == ID1)))
-			{  
-  		        bool isReciprocal = ((ID1inData == ID2) && (ID2inData == ID1));
-				prices = (boost::shared_ptr<Prices>) new Prices(m_marketCaches->getEvalDate(), ID1, ID2);
-
-				Real currentPrice = pt_get_optional<Real>(iter->second, "current_price", 0.0); 
-				if( currentPrice > 0.0)
-					prices->setCurrentPrice(isReciprocal ? 1.0/currentPrice : currentPrice);
-
-				boost::property_tree::basic_ptree<std::string, std::string>::const_iterator 
-					innerIterator = iter->second.begin();
-				while( innerIterator != iter->second.end())
-				{
-					if(!strcmp(innerIterator->first.c_str(),"price"))
-					{
-						Date date  = pt_getDateOptional   (innerIterator->second, "date",  Date());
-						Real price = pt_get_optional<Real>(innerIterator->second, "value", 0.0);
+		if(!strcmp(innerIterator->first.c_str(),"price"))
+		{
+			Date date  = pt_getDateOptional   (innerIterator->second, "date",  Date());
+			Real price = pt_get_optional<Real>(innerIterator->second, "value", 0.0);
 						
-						if((date != Date()) && (price != 0.0))
-						{
-							if( isReciprocal ) 
-								price = 1.0 / price;
-
-							writeDiagnostics("For " + ID1 + "-" + ID2 + ", added date " + toString(date) 
-								             + " with price " + toString(price),
-							                 high, "StockPricesXMLSource::get");
-
-							prices->addPrice(date, price);
-
-						}
-						else
-						{
-							std::string msg =  "For " + ID1 + "-" + ID2 
-								             + " was unable to get a valid price and date from the node:\n"
-							                 + toString(innerIterator->second); 
-							writeDiagnostics(msg, low, "StockPricesXMLSource::get");
-						}
-					}
-					innerIterator++;
-				}
-				found = true;
-			}
-		}                // end of 'if( iter->first.data() == CONST_STR_item)'
-		iter++;
-	}                    // end of 'while( ( iter != m_PropTree.end() ) && !found)'
+			if((date != Date()) && (price != 0.0))
+			{
+				if( isReciprocal ) 
+					price = 1.0 / price;
 
-	QL_REQUIRE(found, "FXPricesXMLSource::get(..):\n"
-		<< "Was unable to find the FX Prices for: " << ID1 << " - " << ID2);  
+				writeDiagnostics("For " + ID1 + "-" + ID2 + ", added date " + toString(date) 
+					             + " with price " + toString(price),
+				                 high, "StockPricesXMLSource::get");
 
+				prices->addPrice(date, price);
+			}
+			else
+			{
+				std::string msg =  "For " + ID1 + "-" + ID2 
+					             + " was unable to get a valid price and date from the node:\n"
+				                 + toString(innerIterator->second); 
+				writeDiagnostics(msg, low, "StockPricesXMLSource::get");
+			}
+		}
+		innerIterator++;
+	}
 	return prices;
 }
 
@@ -535,79 +477,487 @@ boost::shared_ptr<StockData> StockDataXMLSource::get(const std::string& stockID,
 {
 	QL_REQUIRE( stockID.size() > 0, "StockDataXMLSource::get(..): stockID can't be an empty string.");
 
-	boost::shared_ptr<StockData> stockData;
-	bool found = false;
+	const boost::property_tree::ptree* node = findByIDAndIDType(stockID, stockIDType);
+	QL_REQUIRE(node, "StockDataXMLSource::get(..): Was unable to find the stock, " 
+		              << stockIDType << " : " << stockID );
 
-	using boost::property_tree::ptree;
-    ptree::const_iterator iter = m_PropTree.begin();
-			
-	while( ( iter != m_PropTree.end() ) && !found)
-	{
-		if( iter->first.data() == CONST_STR_stock)
-		{   
-			std::string IDinData      = iter->second.get<std::string>("id");
-			
-			boost::optional<std::string> ID_typeInData;
+	boost::shared_ptr<StockData> stockData = (boost::shared_ptr<StockData>) new StockData();
+	stockData->setID(node->get<std::string>("id"));
 
-			bool matchingIDTypes = true; 
-			// We have two values for ID type, one is passed into this method (stockIDType), 
-			// the other (IDTypeInData) is obtained from the xml data. 
-			// If either is an empyt string then matchingIDTypes is set to true
-			// otherwise mathcingIDTypes = ( IDType == IDTypeInData)
-			
-			if( ID_typeInData = iter->second.get_optional<std::string>("id_type"))
-			{   // have been able to retrieve ID_type from xml data 
-				if(stockIDType.size() != 0)
-					matchingIDTypes = ( (*ID_typeInData) == stockIDType);
-			}   // otherwise leave matchingIDTypes at true.
+	boost::optional<std::string> ID_typeInData;
+	if( ID_typeInData = node->get_optional<std::string>("id_type"))
+		stockData->setIDType(*ID_typeInData);
 		
-			// matchingIDTypes(..) will return true if either string is empty.
-			if((IDinData == stockID) && matchingIDTypes)
+	boost::optional<std::string> ccyInData;
+	if(ccyInData = node->get_optional<std::string>("currency"))
+		stockData->setCurrency(*ccyInData);
+	
+	boost::optional<std::string> name;
+	if(name = node->get_optional<std::string>("name"))
+		stockData->setName(*name);
+
+	boost::optional<std::string> holCal;
+	if(holCal = node->get_optional<std::string>("holiday_calendar"))
+		stockData->setHolidayCalendarID(*holCal);
+
+	boost::optional<Real> flatVol;
+	if(flatVol = node->get_optional<Real>("flat_vol"))
+		stockData->setFlatVol(*flatVol);
+
+	boost::optional<Real> price;
+	if(price = node->get_optional<Real>("price"))
+		stockData->setSpotPrice(*price);
+
+	boost::optional<Real> divYield;
+	if(divYield = node->get_optional<Real>("dividend_yield"))
+		stockData->setDividendYield(*divYield);
+
+	boost::optional<Real> repoRate;
+	if(repoRate = node->get_optional<Real>("repo_rate"))
+		stockData->setRepoRate(*repoRate);
+
+	boost::optional<Real> creditSpread;
+	if(creditSpread = node->get_optional<Real>("credit_spread"))
+		stockData->setCreditSpread(*creditSpread);
+
+	return stockData;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Prices Stream
+bool MarketCaches::usingPricesXMLStream()
+{
+	std::string pricesSource;
+	if( !( getConfig()->find("prices_source", pricesSource) ) )
+		pricesSource = getConfig()->get(CONST_STR_market_data_source_default);
+
+	return pricesSource == CONST_STR_xmlstream;
+}
+
+MarketCaches::PricesXMLStreamSharedPointer MarketCaches::getPricesXMLStream()
+{
+	if( m_pricesXMLStream == NULL )
+		m_pricesXMLStream = (PricesXMLStreamSharedPointer) new PricesXMLStream(this);
+
+	return m_pricesXMLStream;
+}
+
+MarketCaches::MarketDataSnapshotSharedPointer MarketCaches::getMarketDataSnapshot()
+{
+	if( m_marketDataSnapshot == NULL )
+		m_marketDataSnapshot = (MarketDataSnapshotSharedPointer) 
+		                           new MarketDataSnapshot(getConfig()->get("market_data_snapshot_path"));
+
+	return m_marketDataSnapshot;
+}
+
+void MarketCaches::requestStockPrices(const std::string& ID, const std::string& IDType)
+{
+	if( usingPricesXMLStream() )
+		getPricesXMLStream()->requestStockPrices(ID, IDType);
+}
+
+void MarketCaches::requestFXPrices(const std::string& ID1, const std::string& ID2)
+{
+	if( usingPricesXMLStream() )
+		getPricesXMLStream()->requestFXPrices(ID1, ID2);
+}
+
+StockPricesXMLStreamSource::StockPricesXMLStreamSource(MarketCaches* marketCaches)
+	: MarketObjSource<boost::shared_ptr<Prices> >(marketCaches)
+{}
+
+boost::shared_ptr<Prices> StockPricesXMLStreamSource::get(const std::string& ID, const std::string& IDType)
+{
+	return m_marketCaches->getPricesXMLStream()->getStockPrices(ID, IDType);
+}
+
+FXPricesXMLStreamSource::FXPricesXMLStreamSource(MarketCaches* marketCaches)
+	: MarketObjSource<boost::shared_ptr<Prices> >(marketCaches)
+{}
+
+boost::shared_ptr<Prices> FXPricesXMLStreamSource::get(const std::string& ID1, const std::string& ID2)
+{
+	return m_marketCaches->getPricesXMLStream()->getFXPrices(ID1, ID2);
+}
+
+namespace
+{
+	// A pull reader for the plain xml used for market data. It reports elements and text, 
+	// and skips comments, processing instructions and attributes. 
+	// Only the current tag or text is held in memory, never the document.
+	class XMLPullReader
+	{
+	public:
+		enum Event { start_element, end_element, characters, end_of_file };
+
+		XMLPullReader(std::istream& stream) : m_stream(stream), m_selfClosing(false) {}
+
+		Event next();
+		const std::string& name() const { return m_name; } // set for start_element and end_element
+		const std::string& text() const { return m_text; } // set for characters, with whitespace trimmed
+
+	private:
+		std::istream&  m_stream;
+		std::string    m_name, m_text;
+		bool           m_selfClosing; // when true the next event is the end of <m_name/>
+
+		void skipPast(const std::string& terminator);
+		void decodeEntities(std::string& str) const;
+	};
+
+	XMLPullReader::Event XMLPullReader::next()
+	{
+		if( m_selfClosing )
+		{
+			m_selfClosing = false;
+			return end_element;
+		}
+		while( true )
+		{
+			int c;
+			m_text.clear();
+			while( ((c = m_stream.get()) != EOF) && (c != '<') )
+				m_text += (char) c;
+
+			boost::algorithm::trim(m_text);
+			if( m_text.size() > 0 )
 			{
-				stockData = (boost::shared_ptr<StockData>) new StockData();
-				stockData->setID(IDinData);
-
-				if( ID_typeInData )
-					stockData->setIDType(*ID_typeInData);
-					
-				boost::optional<std::string> ccyInData;
-				if(ccyInData = iter->second.get_optional<std::string>("currency"))
-					stockData->setCurrency(*ccyInData);
-				
-				boost::optional<std::string> name;
-				if(name = iter->second.get_optional<std::string>("name"))
-					stockData->setName(*name);
-
-				boost::optional<std::string> holCal;
-				if(holCal = iter->second.get_optional<std::string>("holiday_calendar"))
-					stockData->setHolidayCalendarID(*holCal);
-
-				boost::optional<Real> flatVol;
-				if(flatVol = iter->second.get_optional<Real>("flat_vol"))
-					stockData->setFlatVol(*flatVol);
-
-				boost::optional<Real> price;
-				if(price = iter->second.get_optional<Real>("price"))
-					stockData->setSpotPrice(*price);
-
-				boost::optional<Real> divYield;
-				if(divYield = iter->second.get_optional<Real>("dividend_yield"))
-					stockData->setDividendYield(*divYield);
-
-				boost::optional<Real> repoRate;
-				if(repoRate = iter->second.get_optional<Real>("repo_rate"))
-					stockData->setRepoRate(*repoRate);
-			
-				boost::optional<Real> creditSpread;
-				if(creditSpread = iter->second.get_optional<Real>("credit_spread"))
-					stockData->setCreditSpread(*creditSpread);
+				if( c == '<' )
+					m_stream.unget(); // the tag will be read by the next call
+				decodeEntities(m_text);
+				return characters;
+			}
+			if( c == EOF )
+				return end_of_file;
 
-				found  = true;
+			c = m_stream.get();
+			if( c == '!' )
+			{
+				if( (m_stream.get() == '-') && (m_stream.get() == '-') )
+					skipPast("-->");
+				else
+					skipPast(">"); // e.g. <!DOCTYPE ...>
+				continue;
 			}
-		}		
-		iter++; // keep searching
-	}			// end of while(..)
-	QL_REQUIRE(found, "StockDataXMLSource::get(..): Was unable to find the stock, " 
-		              << stockIDType << " : " << stockID );
-	return stockData;
+			if( c == '?' )
+			{
+				skipPast("?>");
+				continue;
+			}
+
+			bool isEndTag = (c == '/');
+			if( isEndTag )
+				c = m_stream.get();
+
+			m_name.clear();
+			while( (c != EOF) && (c != '>') && (c != '/') && !isspace(c) )
+			{
+				m_name += (char) c;
+				c = m_stream.get();
+			}
+
+			char quote = 0, last = 0; // skip any attributes, they're not used in the market data
+			while( (c != EOF) && ( (c != '>') || quote ) )
+			{
+				if( quote )
+					quote = (c == quote) ? 0 : quote;
+				else if( (c == '"') || (c == '\'') )
+					quote = (char) c;
+				else if( !isspace(c) )
+					last = (char) c;
+				c = m_stream.get();
+			}
+			QL_REQUIRE( (c == '>') && (m_name.size() > 0), 
+			            "XMLPullReader::next(): Found an incomplete tag: <" << (isEndTag ? "/" : "") << m_name);
+
+			if( isEndTag )
+				return end_element;
+
+			m_selfClosing = (last == '/');
+			return start_element;
+		}
+	}
+
+	void XMLPullReader::skipPast(const std::string& terminator)
+	{
+		Size matched = 0;
+		int  c;
+		while( (matched < terminator.size()) && ((c = m_stream.get()) != EOF) )
+		{
+			if( c == terminator[matched] )
+				matched++;
+			else
+				matched = (c == terminator[0]) ? 1 : 0;
+		}
+	}
+
+	void XMLPullReader::decodeEntities(std::string& str) const
+	{
+		if( str.find('&') == std::string::npos )
+			return;
+		boost::algorithm::replace_all(str, "&lt;",   "<");
+		boost::algorithm::replace_all(str, "&gt;",   ">");
+		boost::algorithm::replace_all(str, "&quot;", "\"");
+		boost::algorithm::replace_all(str, "&apos;", "'");
+		boost::algorithm::replace_all(str, "&amp;",  "&"); // last, so that "&amp;lt;" becomes "&lt;"
+	}
+
+	// As the property tree would read it, returns false when str isn't a number.
+	bool stringToReal(const std::string& str, Real& value)
+	{
+		std::istringstream stream(str);
+		stream >> value;
+		if( !stream.fail() && !stream.eof() )
+			stream >> std::ws;
+		return !stream.fail() && stream.eof();
+	}
+
+	// The date and value of a <price> node, with the invalid values used by the xml sources when absent. 
+	void parsePrice(const std::pair<std::string, std::string>& priceStrings, 
+	                Real                                       invalidPrice,
+					Date&                                      date,          // output
+					Real&                                      price)         // output
+	{
+		date  = (priceStrings.first.size() > 0) ? stringToDate(priceStrings.first, getConfig()->getDateFormat()) 
+		                                        : Date();
+		if( !stringToReal(priceStrings.second, price) )
+			price = invalidPrice;
+	}
+}
+
+PricesXMLStream::PricesXMLStream(MarketCaches* marketCaches)
+{
+	m_marketCaches = marketCaches;
+	m_numScans     = 0;
+	m_path         = getConfig()->get("prices_xml_path");
+}
+
+void PricesXMLStream::requestStockPrices(const std::string& ID, const std::string& IDType)
+{
+	std::string key = ID + CONST_STR_divider + IDType;
+	if( m_stockPrices.insert(std::make_pair(key, boost::shared_ptr<Prices>())).second ) // a new request
+		m_pendingStockKeys.insert(key);
+}
+
+void PricesXMLStream::requestFXPrices(const std::string& ID1, const std::string& ID2)
+{
+	std::string key = ID1 + CONST_STR_divider + ID2;
+	if( m_FXPrices.insert(std::make_pair(key, boost::shared_ptr<Prices>())).second ) // a new request
+		m_pendingFXKeys.insert(key);
+}
+
+boost::shared_ptr<Prices> PricesXMLStream::getStockPrices(const std::string& ID, const std::string& IDType)
+{
+	requestStockPrices(ID, IDType);
+	if( m_pendingStockKeys.size() > 0 )
+		scan();
+
+	boost::shared_ptr<Prices> prices = m_stockPrices[ID + CONST_STR_divider + IDType];
+	QL_REQUIRE(prices, "PricesXMLStream::getStockPrices(..):\n"
+		<< "Was unable to find the stock prices for: "  
+		<< (IDType.length() > 0 ? IDType + toString(": ") : toString(""))
+		<< ID << " in " << m_path);
+	return prices;
+}
+
+boost::shared_ptr<Prices> PricesXMLStream::getFXPrices(const std::string& ID1, const std::string& ID2)
+{
+	requestFXPrices(ID1, ID2);
+	if( m_pendingFXKeys.size() > 0 )
+		scan();
+
+	boost::shared_ptr<Prices> prices = m_FXPrices[ID1 + CONST_STR_divider + ID2];
+	QL_REQUIRE(prices, "PricesXMLStream::getFXPrices(..):\n"
+		<< "Was unable to find the FX Prices for: " << ID1 << " - " << ID2 << " in " << m_path);  
+	return prices;
+}
+
+// An empty ID type, either requested or in the data, matches any ID type.
+bool PricesXMLStream::isRequestedStock(const std::string& ID, const std::string& IDType) const
+{
+	std::string prefix = ID + CONST_STR_divider;
+	std::set<std::string>::const_iterator iter = m_pendingStockKeys.lower_bound(prefix);
+	for(; (iter != m_pendingStockKeys.end()) && !iter->compare(0, prefix.size(), prefix); iter++)
+	{
+		std::string requestedIDType = iter->substr(prefix.size());
+		if( (requestedIDType.size() == 0) || (IDType.size() == 0) || (requestedIDType == IDType) )
+			return true;
+	}
+	return false;
+}
+
+bool PricesXMLStream::isRequestedFX(const std::string& ID1, const std::string& ID2) const
+{
+	return    (m_pendingFXKeys.count(ID1 + CONST_STR_divider + ID2) > 0)
+	       || (m_pendingFXKeys.count(ID2 + CONST_STR_divider + ID1) > 0);
+}
+
+void PricesXMLStream::foundStockPrices(const std::string&  ID, 
+									  const std::string&  IDType, 
+									  const std::string&  currentPrice, 
+									  const PriceStrings& priceStrings)
+{
+	boost::shared_ptr<Prices> prices = (boost::shared_ptr<Prices>) new Prices(m_marketCaches->getEvalDate(), ID);
+
+	Real price;
+	if( stringToReal(currentPrice, price) )
+		prices->setCurrentPrice(price);
+
+	for(Size i = 0; i < priceStrings.size(); i++)
+	{
+		Date date;
+		parsePrice(priceStrings[i], -99999.0, date, price);
+
+		if((date != Date()) && (price != -99999.0))
+			prices->addPrice(date, price);
+		else
+			writeDiagnostics("For " + ID + " was unable to get a valid price and date from: " 
+			                 + priceStrings[i].first + ", " + priceStrings[i].second, 
+							 low, "PricesXMLStream::foundStockPrices");
+	}
+
+	// As with the xml source, the first match in the file is used for each request.
+	std::string prefix = ID + CONST_STR_divider;
+	std::set<std::string>::iterator iter = m_pendingStockKeys.lower_bound(prefix);
+	while( (iter != m_pendingStockKeys.end()) && !iter->compare(0, prefix.size(), prefix) )
+	{
+		std::string requestedIDType = iter->substr(prefix.size());
+		if( (requestedIDType.size() == 0) || (IDType.size() == 0) || (requestedIDType == IDType) )
+		{
+			m_stockPrices[*iter] = prices;
+			m_pendingStockKeys.erase(iter++);
+		}
+		else
+			iter++;
+	}
+}
+
+void PricesXMLStream::foundFXPrices(const std::string&  ID1, 
+								   const std::string&  ID2, 
+								   const std::string&  currentPrice, 
+								   const PriceStrings& priceStrings)
+{
+	for(Size reciprocal = 0; reciprocal < 2; reciprocal++) // the pair may have been requested either way round
+	{
+		const std::string& requestedID1 = reciprocal ? ID2 : ID1;
+		const std::string& requestedID2 = reciprocal ? ID1 : ID2;
+
+		std::set<std::string>::iterator iter = m_pendingFXKeys.find(requestedID1 + CONST_STR_divider + requestedID2);
+		if( iter == m_pendingFXKeys.end() )
+			continue;
+
+		boost::shared_ptr<Prices> prices = (boost::shared_ptr<Prices>) 
+		                                       new Prices(m_marketCaches->getEvalDate(), requestedID1, requestedID2);
+		Real price;
+		if( stringToReal(currentPrice, price) && (price > 0.0) )
+			prices->setCurrentPrice(reciprocal ? 1.0/price : price);
+
+		for(Size i = 0; i < priceStrings.size(); i++)
+		{
+			Date date;
+			parsePrice(priceStrings[i], 0.0, date, price);
+
+			if((date != Date()) && (price != 0.0))
+				prices->addPrice(date, reciprocal ? 1.0/price : price);
+			else
+				writeDiagnostics("For " + requestedID1 + "-" + requestedID2 
+				                 + " was unable to get a valid price and date from: " 
+				                 + priceStrings[i].first + ", " + priceStrings[i].second, 
+								 low, "PricesXMLStream::foundFXPrices");
+		}
+		m_FXPrices[*iter] = prices;
+		m_pendingFXKeys.erase(iter);
+	}
+}
+
+// Reads the file once, from start to end. For each <item> only its IDs and, when it's been
+// requested, its prices are held. Every other item is passed over.
+void PricesXMLStream::scan()
+{
+	std::ifstream file(m_path.c_str());
+	QL_REQUIRE(!file.fail(), "PricesXMLStream::scan(): Was unable to open the prices xml file: " << m_path);
+
+	m_numScans++;
+	writeDiagnostics("Pass " + toString(m_numScans) + " through " + m_path + ", looking for " 
+	                 + toString(m_pendingStockKeys.size() + m_pendingFXKeys.size()) + " prices.",
+					 (m_numScans > 1) ? low : high, // more than one pass suggests the requests weren't all made up front
+					 "PricesXMLStream::scan");
+
+	XMLPullReader             reader(file);
+	std::vector<std::string>  path;        // the tags from the root to the current element
+	bool                      isFX = false; 
+	std::string               ID1, ID2, currentPrice; // for stocks ID2 holds the id_type
+	PriceStrings              prices;
+
+	XMLPullReader::Event event;
+	while( (event = reader.next()) != XMLPullReader::end_of_file )
+	{
+		// an <item> is at market_data.prices.item or market_data.fx_spots.item
+		bool inItem =    (path.size() >= 3) && (path[0] == "market_data") && (path[2] == CONST_STR_item) 
+		              && ((path[1] == "prices") || (path[1] == "fx_spots"));
+		switch( event )
+		{
+		case XMLPullReader::start_element:
+			path.push_back(reader.name());
+			if( (path.size() == 3) && (path[2] == CONST_STR_item) )
+			{
+				isFX = (path[1] == "fx_spots");
+				ID1.clear(); ID2.clear(); currentPrice.clear(); prices.clear();
+			}
+			else if( inItem && (path.size() == 4) && (path[3] == "price") )
+				prices.push_back(std::make_pair(std::string(), std::string()));
+			break;
+
+		case XMLPullReader::characters:
+			if( inItem && (path.size() == 4) )
+			{
+				if( path[3] == (isFX ? "id1" : "id") )
+					ID1 = reader.text();
+				else if( path[3] == (isFX ? "id2" : "id_type") )
+					ID2 = reader.text();
+				else if( path[3] == "current_price" )
+					currentPrice = reader.text();
+			}
+			else if( inItem && (path.size() == 5) && (path[3] == "price") )
+			{
+				if( path[4] == "date" )
+					prices.back().first  = reader.text();
+				else if( path[4] == "value" )
+					prices.back().second = reader.text();
+			}
+			break;
+
+		case XMLPullReader::end_element:
+			QL_REQUIRE( (path.size() > 0) && (path.back() == reader.name()), 
+			            "PricesXMLStream::scan(): In " << m_path << " found </" << reader.name() 
+						<< "> when expecting </" << (path.size() > 0 ? path.back() : toString("")) << ">");
+
+			// Once the IDs are known, the price nodes of items that haven't been requested are dropped,
+			// so memory doesn't grow with the length of the price histories that aren't needed.
+			if( inItem && (path.size() == 4) && (path[3] == "price") && (ID1.size() > 0) && (!isFX || (ID2.size() > 0))
+				&& !(isFX ? isRequestedFX(ID1, ID2) : isRequestedStock(ID1, ID2)) )
+				prices.clear();
+
+			if( inItem && (path.size() == 3) )
+			{
+				if( isFX && isRequestedFX(ID1, ID2) )
+					foundFXPrices(ID1, ID2, currentPrice, prices);
+				else if( !isFX && isRequestedStock(ID1, ID2) )
+					foundStockPrices(ID1, ID2, currentPrice, prices);
+				prices.clear();
+			}
+			path.pop_back();
+			break;
+
+		default:
+			break;
+		}
+		if( (m_pendingStockKeys.size() == 0) && (m_pendingFXKeys.size() == 0) )
+			break; // found everything that was requested, no need to read the rest of the file
+	}
+
+	// whatever hasn't been found isn't in the file 
+	m_pendingStockKeys.clear();
+	m_pendingFXKeys.clear();
 }
@@ -3,7 +3,8 @@
 
 #include "Utilities.hpp"
 
-class MarketCaches; // forward declaration
+class MarketCaches;       // forward declaration
+class MarketDataSnapshot; // forward declaration
 
 template<class Obj> class MarketObjSource
 {
@@ -53,12 +54,33 @@ class MarketObjXMLSource : public MarketObjSource<T_Obj> // base class for class
 {                                                        // market data objects from XML.
 protected:
 	boost::property_tree::ptree    m_PropTree;    
+
+	// The nodes of m_PropTree are indexed once, on construction, so that each get(..) 
+	// is a hash lookup rather than a linear scan of the xml.
+	typedef boost::unordered_map<std::string, const boost::property_tree::ptree*> NodeIndex;
+	NodeIndex                      m_index;
+	NodeIndex                      m_firstNodeWithID; // used when no ID type is requested
+
+	void addToIndex(const std::string& key, const boost::property_tree::ptree& node, const std::string& tag);
+	const boost::property_tree::ptree* findInIndex(const std::string& key) const; // NULL when absent
+
+	// For nodes with an "id" and an optional "id_type" (stocks and prices)
+	void indexByIDAndIDType(const std::string& tag);
+	const boost::property_tree::ptree* findByIDAndIDType(const std::string& ID, const std::string& IDType) const;
 public:
 	MarketObjXMLSource(MarketCaches*         marketCaches,
 		               const std::string&    tagOfFilenameInConfig, 
 					   const std::string&    pathInPropertyTree);
+
+	const boost::property_tree::ptree& getPropTree() const { return m_PropTree; }
 };
 
+// The same key whichever way round the currency pair is quoted, e.g. for GBP-USD and USD-GBP
+inline std::string getCurrencyPairKey(const std::string& ccy1, const std::string& ccy2)
+{
+	return (ccy1 < ccy2) ? ccy1 + CONST_STR_divider + ccy2 : ccy2 + CONST_STR_divider + ccy1;
+}
+
 // Very often the Obj will be a boost::shared_ptr<.>, though it could also be a Real
 template<class Obj> class CacheSingleKey 
 {   
@@ -199,6 +221,64 @@ public:
 	boost::shared_ptr<Prices> get(const std::string& ID1, const std::string& ID2);
 };
 ////////////////////////////////////////////////////////////////////////////////////
+// Used when the config's prices_source is 'xmlstream'.
+// Rather than loading the whole prices xml into a property tree, the file is read as a stream
+// and only the requested prices are kept. Requests made before the first get(..), e.g. for every 
+// underlying in the portfolio, are all found by a single pass through the file.
+// A request for prices not yet seen will cause another pass.
+class PricesXMLStream
+{
+private:
+	MarketCaches*                                        m_marketCaches;
+	std::string                                          m_path;
+	Size                                                 m_numScans;
+
+	// key: ID<divider>IDType, a NULL pointer until the scan finds the prices.
+	std::map<std::string, boost::shared_ptr<Prices> >    m_stockPrices; 
+	// key: ID1<divider>ID2, as requested, the xml may have the pair the other way round.
+	std::map<std::string, boost::shared_ptr<Prices> >    m_FXPrices;
+	// requests not yet looked for by a scan
+	std::set<std::string>                                m_pendingStockKeys, m_pendingFXKeys;
+
+	void scan(); // a single pass through the file, looking for the pending requests
+
+	// used by scan(), with the price nodes as (date, value) strings
+	typedef std::vector<std::pair<std::string, std::string> > PriceStrings;
+	bool isRequestedStock(const std::string& ID,  const std::string& IDType) const;
+	bool isRequestedFX   (const std::string& ID1, const std::string& ID2)    const;
+	void foundStockPrices(const std::string& ID,  const std::string& IDType, // an empty currentPrice when absent
+	                      const std::string& currentPrice, const PriceStrings& prices);
+	void foundFXPrices   (const std::string& ID1, const std::string& ID2, 
+	                      const std::string& currentPrice, const PriceStrings& prices);
+public:
+	PricesXMLStream(MarketCaches* marketCaches);
+
+	void requestStockPrices(const std::string& ID,  const std::string& IDType);
+	void requestFXPrices   (const std::string& ID1, const std::string& ID2);
+
+	// These will throw an error if the prices are not in the file.
+	boost::shared_ptr<Prices> getStockPrices(const std::string& ID,  const std::string& IDType);
+	boost::shared_ptr<Prices> getFXPrices   (const std::string& ID1, const std::string& ID2);
+};
+
+class StockPricesXMLStreamSource : public MarketObjSource<boost::shared_ptr<Prices> >
+{
+public:
+	StockPricesXMLStreamSource(MarketCaches* marketCaches);
+
+	// get(..) will throw an error if the Object is not found.
+	boost::shared_ptr<Prices> get(const std::string& ID, const std::string& IDType);
+};
+
+class FXPricesXMLStreamSource : public MarketObjSource<boost::shared_ptr<Prices> >
+{
+public:
+	FXPricesXMLStreamSource(MarketCaches* marketCaches);
+
+	// get(..) will throw an error if the Object is not found.
+	boost::shared_ptr<Prices> get(const std::string& ID1, const std::string& ID2);
+};
+////////////////////////////////////////////////////////////////////////////////////
 
 class CalendarXMLSource : public MarketObjXMLSource<boost::shared_ptr<Calendar> >
 {
@@ -228,9 +308,10 @@ private:
 	// The objects (T_Obj) come from the source and are stored in the cache.
 	// If the Cache has not already been created the this method will create it
 	// Either way a shared pointer to the cache will be returned.
-	template<class T_Obj,       // This is the object that will be created, perhaps a vol object, or yield-term-structure
-	         class T_XMLSource, // When xml is being use, this is the class that will create the object from the xml data
-	         class T_Cache>	    // Using 'T_' here to indicate a templated type.
+	template<class T_Obj,            // This is the object that will be created, perhaps a vol object, or yield-term-structure
+	         class T_XMLSource,      // When xml is being use, this is the class that will create the object from the xml data
+	         class T_SnapshotSource, // When a snapshot is being used, this class creates the object from the snapshot
+	         class T_Cache>	         // Using 'T_' here to indicate a templated type.
 	boost::shared_ptr<T_Cache>  getCache(// The tag used in the config to specify the data source
                                          const std::string&           sourceTagInConfig,     
 			    	                     // The key used in the config to specify the data source
@@ -257,7 +338,14 @@ private:
 				// When that is the case, the following line will set that member variable.
 				(*ptrToSharedPtrToCache) = (SharedPtrToCache) new T_Cache(sharedPtrToXMLSource);
 			}
-			// when we want to implement a data source other than xml,
+			else if( sourceStr == CONST_STR_snapshot) // a binary snapshot written from the xml, see MarketDataSnapshot
+			{
+				boost::shared_ptr<T_SnapshotSource> sharedPtrToSnapshotSource;
+				sharedPtrToSnapshotSource = (boost::shared_ptr<T_SnapshotSource>) new T_SnapshotSource (this);
+
+				(*ptrToSharedPtrToCache) = (SharedPtrToCache) new T_Cache(sharedPtrToSnapshotSource);
+			}
+			// when we want to implement a data source other than xml or snapshot,
 			// here we would need: else if ( sourceStr == ... ) ...
 			else
 			{
@@ -312,12 +400,37 @@ public:    StockPricesCacheSharedPointer  getStockPricesCache();
 private:   FXPricesCacheSharedPointer  m_FXPricesCache;
 public:    FXPricesCacheSharedPointer  getFXPricesCache();
 ///////////////////////////////////////////////////////////////////////////////
+// Prices Stream, only used when the prices_source is 'xmlstream', it's shared by both prices caches
+		   typedef boost::shared_ptr<PricesXMLStream>                     PricesXMLStreamSharedPointer;
+private:   PricesXMLStreamSharedPointer  m_pricesXMLStream;
+		   bool                          usingPricesXMLStream();
+public:    PricesXMLStreamSharedPointer  getPricesXMLStream();
+
+		   // Lets the prices source know in advance which prices will be needed.
+		   // Does nothing unless the prices_source is 'xmlstream'.
+		   void  requestStockPrices(const std::string& ID,  const std::string& IDType);
+		   void  requestFXPrices   (const std::string& ID1, const std::string& ID2);
+///////////////////////////////////////////////////////////////////////////////
+// Market Data Snapshot, only used when a source is 'snapshot'. Mapped once, shared by all the caches.
+		   typedef boost::shared_ptr<MarketDataSnapshot>                  MarketDataSnapshotSharedPointer;
+private:   MarketDataSnapshotSharedPointer  m_marketDataSnapshot;
+public:    MarketDataSnapshotSharedPointer  getMarketDataSnapshot();
+///////////////////////////////////////////////////////////////////////////////
 // Calendar Cache
 		   typedef boost::shared_ptr<Calendar>                                CalendarSharedPointer;
 		   typedef boost::shared_ptr<CacheSingleKey<CalendarSharedPointer> >  CalendarCacheSharedPointer;
 private:   CalendarCacheSharedPointer  m_calendarCache;
 public:    CalendarCacheSharedPointer  getCalendarCache();
 ///////////////////////////////////////////////////////////////////////////////
+// Lattice Cache
+// Not market data from a source, but lattices built from it. Tree priced contracts on the same process,
+// maturity, number of steps and discount rate share one lattice, so the tree is only built once.
+// The key must describe everything the lattice is built from.
+		   typedef boost::shared_ptr<Lattice>                         LatticeSharedPointer;
+private:   std::map<std::string, LatticeSharedPointer>                m_latticeCache;
+public:    LatticeSharedPointer findLattice(const std::string& key);  // returns an empty pointer if not found
+		   void                 addLattice (const std::string& key, const LatticeSharedPointer& lattice);
+///////////////////////////////////////////////////////////////////////////////
 
 };  // end of class MarketCaches
 
@@ -351,6 +464,66 @@ MarketObjXMLSource<Obj>::MarketObjXMLSource(MarketCaches*         marketCaches,
 	}	
 }
 
+template<class Obj>
+void MarketObjXMLSource<Obj>::addToIndex(const std::string&                 key, 
+										 const boost::property_tree::ptree& node, 
+										 const std::string&                 tag)
+{
+	// as with the linear search this replaces, the first node in the xml wins
+	if(!m_index.insert(typename NodeIndex::value_type(key, &node)).second)
+		writeDiagnostics("Ignoring a later duplicate '" + tag + "' in the xml market data for: " + key,
+		                 low, "MarketObjXMLSource::addToIndex");
+}
+
+template<class Obj>
+const boost::property_tree::ptree* MarketObjXMLSource<Obj>::findInIndex(const std::string& key) const
+{
+	typename NodeIndex::const_iterator iter = m_index.find(key);
+	return (iter == m_index.end()) ? NULL : iter->second;
+}
+
+template<class Obj>
+void MarketObjXMLSource<Obj>::indexByIDAndIDType(const std::string& tag)
+{
+	boost::property_tree::ptree::const_iterator iter;
+	for(iter = m_PropTree.begin(); iter != m_PropTree.end(); iter++)
+	{
+		if(tag != iter->first.data())
+			continue;
+
+		std::string ID     = iter->second.get<std::string>("id");
+		std::string IDType = iter->second.get<std::string>("id_type", "");
+
+		// An earlier node without an ID type matches any ID type, so it comes before this one.
+		if((IDType.size() > 0) && findInIndex(ID + CONST_STR_divider))
+			writeDiagnostics("Ignoring a '" + tag + "' in the xml market data for: " + ID + CONST_STR_divider + IDType
+			                 + ", an earlier one for " + ID + " without an ID type matches it.",
+							 low, "MarketObjXMLSource::indexByIDAndIDType");
+		else
+			addToIndex(ID + CONST_STR_divider + IDType, iter->second, tag);
+		m_firstNodeWithID.insert(typename NodeIndex::value_type(ID, &(iter->second))); // keeps the first
+	}
+}
+
+// An empty ID type, either requested or in the data, matches any ID type. As with the linear search 
+// this replaces, the first matching node in the xml wins: a node with the requested ID type is only
+// indexed when no node without an ID type comes before it, see indexByIDAndIDType(..).
+template<class Obj>
+const boost::property_tree::ptree* MarketObjXMLSource<Obj>::findByIDAndIDType(const std::string& ID, 
+																			   const std::string& IDType) const
+{
+	if(IDType.size() == 0)
+	{
+		typename NodeIndex::const_iterator iter = m_firstNodeWithID.find(ID);
+		return (iter == m_firstNodeWithID.end()) ? NULL : iter->second;
+	}
+
+	const boost::property_tree::ptree* node = findInIndex(ID + CONST_STR_divider + IDType);
+	if(!node)
+		node = findInIndex(ID + CONST_STR_divider); // a node without an ID type
+	return node;
+}
+
 template<class Obj>
 CacheSingleKey<Obj>::CacheSingleKey( boost::shared_ptr<MarketObjSource<Obj> > source )
 { 
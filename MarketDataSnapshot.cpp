@@ -0,0 +1,658 @@
+#include "MarketDataSnapshot.hpp"
+#include <boost/crc.hpp>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h> // MoveFileExA(..)
+#endif
+
+namespace
+{
+	// Builds the payload of a snapshot in memory.
+	class SnapshotWriter
+	{
+	private:
+		std::string  m_buffer;
+	public:
+		const std::string&  getBuffer() const { return m_buffer; }
+		boost::uint64_t     size()      const { return m_buffer.size(); }
+
+		void putUInt32 (boost::uint32_t value)    { m_buffer.append((const char*) &value, sizeof(value)); }
+		void putUInt64 (boost::uint64_t value)    { m_buffer.append((const char*) &value, sizeof(value)); }
+		void putInteger(Integer value)            { putUInt32((boost::uint32_t) (boost::int32_t) value); }
+		void putReal   (Real value)               { double d = value; m_buffer.append((const char*) &d, sizeof(d)); }
+		void putBool   (bool value)               { m_buffer.push_back(value ? 1 : 0); }
+		void putDate   (const Date& date)         { putInteger((Integer) date.serialNumber()); }
+		void putString (const std::string& str)
+		{
+			putUInt32((boost::uint32_t) str.size());
+			m_buffer.append(str);
+		}
+		void patchUInt64(boost::uint64_t offset, boost::uint64_t value)
+		{
+			memcpy(&m_buffer[(Size) offset], &value, sizeof(value));
+		}
+	};
+
+	// For each section: key -> offset of the record. Sorted, as the directory must be.
+	typedef std::map<std::string, boost::uint64_t> SectionKeys;
+
+	// As with the xml sources, the first node in the xml wins.
+	void addKey(SectionKeys&        keys,
+	            const std::string&  key,
+				boost::uint64_t     recordOffset,
+				const std::string&  tag)
+	{
+		if(!keys.insert(std::make_pair(key, recordOffset)).second)
+			writeDiagnostics("Ignoring a later duplicate '" + tag + "' in the xml market data for: " + key,
+			                 low, "writeMarketDataSnapshot");
+	}
+
+	// as MarketObjXMLSource::indexByIDAndIDType(..): a node with an ID type is not keyed when an earlier
+	// node for the same ID without one already matches it, so the first matching node in the xml wins
+	void addIDAndIDTypeKey(SectionKeys&        keys,
+	                       const std::string&  ID,
+	                       const std::string&  IDType,
+	                       boost::uint64_t     recordOffset,
+	                       const std::string&  tag)
+	{
+		if((IDType.size() > 0) && (keys.find(ID + CONST_STR_divider) != keys.end()))
+			writeDiagnostics("Ignoring a '" + tag + "' in the xml market data for: " + ID + CONST_STR_divider + IDType
+			                 + ", an earlier one for " + ID + " without an ID type matches it.",
+			                 low, "writeMarketDataSnapshot");
+		else
+			addKey(keys, ID + CONST_STR_divider + IDType, recordOffset, tag);
+	}
+
+	void putOptionalString(SnapshotWriter& writer, const boost::property_tree::ptree& node, const std::string& key)
+	{
+		boost::optional<std::string> value = node.get_optional<std::string>(key);
+		writer.putBool(value.is_initialized());
+		if(value)
+			writer.putString(*value);
+	}
+
+	void putOptionalReal(SnapshotWriter& writer, const boost::property_tree::ptree& node, const std::string& key)
+	{
+		boost::optional<Real> value = node.get_optional<Real>(key);
+		writer.putBool(value.is_initialized());
+		if(value)
+			writer.putReal(*value);
+	}
+
+	// The valid <price> nodes in an item, the others are reported and left out of the snapshot.
+	void getValidPrices(const boost::property_tree::ptree&      item,
+	                    const std::string&                      name,         // used in messages
+	                    Real                                    invalidPrice, // the xml sources' sentinel
+						std::vector<std::pair<Date, Real> >&    prices)       // output
+	{
+		boost::property_tree::ptree::const_iterator iter;
+		for(iter = item.begin(); iter != item.end(); iter++)
+		{
+			if(strcmp(iter->first.c_str(), "price"))
+				continue;
+
+			Date date  = pt_getDateOptional   (iter->second, "date",  Date());
+			Real price = pt_get_optional<Real>(iter->second, "value", invalidPrice);
+
+			if((date != Date()) && (price != invalidPrice))
+				prices.push_back(std::make_pair(date, price));
+			else
+				writeDiagnostics("For " + name + " was unable to get a valid price and date from the node:\n"
+				                 + toString(iter->second), low, "writeMarketDataSnapshot");
+		}
+	}
+
+	void putPrices(SnapshotWriter& writer, const std::vector<std::pair<Date, Real> >& prices)
+	{
+		writer.putUInt32((boost::uint32_t) prices.size());
+		for(Size i = 0; i < prices.size(); i++)
+		{
+			writer.putDate(prices[i].first);
+			writer.putReal(prices[i].second);
+		}
+	}
+}
+
+void writeMarketDataSnapshot(MarketCaches* marketCaches)
+{
+	std::string path = getConfig()->get("market_data_snapshot_path");
+
+	SnapshotWriter            writer;
+	std::vector<SectionKeys>  keys(MarketDataSnapshot::num_sections);
+	boost::property_tree::ptree::const_iterator iter;
+
+	// The section table: the number of keys and the offset of the directory, for each section.
+	// These are set once the directories have been written.
+	boost::uint64_t sectionTableOffset = writer.size();
+	for(Size section = 0; section < MarketDataSnapshot::num_sections; section++)
+	{
+		writer.putUInt64(0);
+		writer.putUInt64(0);
+	}
+
+	// The xml sources read the same files, or the same parts of the main xml, as they do when pricing.
+	CalendarXMLSource calendarSource(marketCaches);
+	for(iter = calendarSource.getPropTree().begin(); iter != calendarSource.getPropTree().end(); iter++)
+	{
+		if(CONST_STR_calendar != iter->first.data())
+			continue;
+		boost::uint64_t recordOffset = writer.size();
+		std::string     calID        = pt_get<std::string>(iter->second, "id");
+
+		std::vector<Date> holDates;
+		getVectorOfDatesFromBasicPTree(iter->second, "holiday", holDates);
+
+		writer.putString(calID);
+		writer.putUInt32((boost::uint32_t) holDates.size());
+		for(Size i = 0; i < holDates.size(); i++)
+			writer.putDate(holDates[i]);
+
+		addKey(keys[MarketDataSnapshot::calendars], calID, recordOffset, CONST_STR_calendar);
+	}
+
+	FXVolXMLSource FXVolSource(marketCaches);
+	for(iter = FXVolSource.getPropTree().begin(); iter != FXVolSource.getPropTree().end(); iter++)
+	{
+		if(CONST_STR_fx_vol != iter->first.data())
+			continue;
+		boost::uint64_t recordOffset = writer.size();
+		std::string     ccy1         = pt_get<std::string>(iter->second, "ccy1");
+		std::string     ccy2         = pt_get<std::string>(iter->second, "ccy2");
+
+		writer.putString(ccy1);
+		writer.putString(ccy2);
+		writer.putReal(iter->second.get<Real>("vol"));
+
+		addKey(keys[MarketDataSnapshot::fx_vols], getCurrencyPairKey(ccy1, ccy2), recordOffset, CONST_STR_fx_vol);
+	}
+
+	YieldTS_XMLSource yieldTSSource(marketCaches);
+	for(iter = yieldTSSource.getPropTree().begin(); iter != yieldTSSource.getPropTree().end(); iter++)
+	{
+		if(CONST_STR_risk_free_rate != iter->first.data())
+			continue;
+		boost::uint64_t recordOffset = writer.size();
+		std::string     currency     = pt_get<std::string>(iter->second, "currency");
+
+		writer.putString(currency);
+		writer.putReal(iter->second.get<Real>("flat_rate"));
+
+		addKey(keys[MarketDataSnapshot::risk_free_rates], currency, recordOffset, CONST_STR_risk_free_rate);
+	}
+
+	StockDataXMLSource stockDataSource(marketCaches);
+	for(iter = stockDataSource.getPropTree().begin(); iter != stockDataSource.getPropTree().end(); iter++)
+	{
+		if(CONST_STR_stock != iter->first.data())
+			continue;
+		boost::uint64_t recordOffset = writer.size();
+		std::string     ID           = pt_get<std::string>(iter->second, "id");
+		std::string     IDType       = iter->second.get<std::string>("id_type", "");
+
+		writer.putString(ID);
+		putOptionalString(writer, iter->second, "id_type");
+		putOptionalString(writer, iter->second, "currency");
+		putOptionalString(writer, iter->second, "name");
+		putOptionalString(writer, iter->second, "holiday_calendar");
+		putOptionalReal  (writer, iter->second, "flat_vol");
+		putOptionalReal  (writer, iter->second, "price");
+		putOptionalReal  (writer, iter->second, "dividend_yield");
+		putOptionalReal  (writer, iter->second, "repo_rate");
+		putOptionalReal  (writer, iter->second, "credit_spread");
+
+		addIDAndIDTypeKey(keys[MarketDataSnapshot::stock_data], ID, IDType, recordOffset, CONST_STR_stock);
+		keys[MarketDataSnapshot::stock_data_by_id].insert(std::make_pair(ID, recordOffset)); // keeps the first
+	}
+
+	StockPricesXMLSource stockPricesSource(marketCaches);
+	for(iter = stockPricesSource.getPropTree().begin(); iter != stockPricesSource.getPropTree().end(); iter++)
+	{
+		if(CONST_STR_item != iter->first.data())
+			continue;
+		boost::uint64_t recordOffset = writer.size();
+		std::string     ID           = pt_get<std::string>(iter->second, "id");
+		std::string     IDType       = iter->second.get<std::string>("id_type", "");
+
+		std::vector<std::pair<Date, Real> > prices;
+		getValidPrices(iter->second, ID, -99999.0, prices);
+
+		writer.putString(ID);
+		putOptionalReal(writer, iter->second, "current_price");
+		putPrices(writer, prices);
+
+		addIDAndIDTypeKey(keys[MarketDataSnapshot::stock_prices], ID, IDType, recordOffset, "prices.item");
+		keys[MarketDataSnapshot::stock_prices_by_id].insert(std::make_pair(ID, recordOffset)); // keeps the first
+	}
+
+	FXPricesXMLSource FXPricesSource(marketCaches);
+	for(iter = FXPricesSource.getPropTree().begin(); iter != FXPricesSource.getPropTree().end(); iter++)
+	{
+		if(CONST_STR_item != iter->first.data())
+			continue;
+		boost::uint64_t recordOffset = writer.size();
+		std::string     ID1          = pt_get<std::string>(iter->second, "id1");
+		std::string     ID2          = pt_get<std::string>(iter->second, "id2");
+
+		std::vector<std::pair<Date, Real> > prices;
+		getValidPrices(iter->second, ID1 + "-" + ID2, 0.0, prices);
+
+		writer.putString(ID1);
+		writer.putString(ID2);
+		writer.putReal(pt_get_optional<Real>(iter->second, "current_price", 0.0));
+		putPrices(writer, prices);
+
+		addKey(keys[MarketDataSnapshot::fx_spots], getCurrencyPairKey(ID1, ID2), recordOffset, "fx_spots.item");
+	}
+
+	// The keys and the directories
+	for(Size section = 0; section < MarketDataSnapshot::num_sections; section++)
+	{
+		std::vector<boost::uint64_t> keyOffsets;
+		SectionKeys::const_iterator  keyIter;
+		for(keyIter = keys[section].begin(); keyIter != keys[section].end(); keyIter++)
+		{
+			keyOffsets.push_back(writer.size());
+			writer.putString(keyIter->first);
+		}
+
+		boost::uint64_t directoryOffset = writer.size();
+		Size i = 0;
+		for(keyIter = keys[section].begin(); keyIter != keys[section].end(); keyIter++)
+		{
+			writer.putUInt64(keyOffsets[i++]);
+			writer.putUInt64(keyIter->second);
+		}
+		writer.patchUInt64(sectionTableOffset + 16 * section,     keys[section].size());
+		writer.patchUInt64(sectionTableOffset + 16 * section + 8, directoryOffset);
+	}
+
+	MarketDataSnapshotHeader header;
+	memcpy(header.magic, CONST_marketDataSnapshotMagic, sizeof(header.magic));
+	header.byteOrder    = CONST_marketDataSnapshotByteOrder;
+	header.version      = CONST_marketDataSnapshotVersion;
+	header.numSections  = MarketDataSnapshot::num_sections;
+	header.payloadSize  = writer.size();
+
+	boost::crc_32_type crc;
+	crc.process_bytes(writer.getBuffer().data(), writer.getBuffer().size());
+	header.checksum     = crc.checksum();
+
+	// Written to a temporary file first, so that a process starting up never maps half a snapshot.
+	std::string tempPath = path + ".tmp";
+	std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	QL_REQUIRE(!file.fail(), "writeMarketDataSnapshot(..): Was unable to open file " << tempPath << " for writing.");
+	file.write((const char*) &header, sizeof(header));
+	file.write(writer.getBuffer().data(), (std::streamsize) writer.getBuffer().size());
+	file.close();
+	QL_REQUIRE(!file.fail(), "writeMarketDataSnapshot(..): Was unable to write the snapshot to " << tempPath);
+
+	// The checksum is verified here, once per snapshot, by reading the temporary file back before it 
+	// replaces the old snapshot. The pricing processes then skip it by default, see MarketDataSnapshot(..).
+	{
+		std::ifstream check(tempPath.c_str(), std::ios::in | std::ios::binary);
+		MarketDataSnapshotHeader checkHeader;
+		check.read((char*) &checkHeader, sizeof(checkHeader));
+		std::vector<char> checkPayload((Size) header.payloadSize);
+		if(!checkPayload.empty())
+			check.read(&checkPayload[0], (std::streamsize) checkPayload.size());
+		QL_REQUIRE(!check.fail() && (check.peek() == std::char_traits<char>::eof()), 
+		           "writeMarketDataSnapshot(..): Was unable to read back the snapshot from " << tempPath);
+		check.close();
+
+		boost::crc_32_type checkCRC;
+		checkCRC.process_bytes(checkPayload.empty() ? 0 : &checkPayload[0], checkPayload.size());
+		QL_REQUIRE(!memcmp(&checkHeader, &header, sizeof(header)) && (checkCRC.checksum() == header.checksum),
+		           "writeMarketDataSnapshot(..): The snapshot read back from " << tempPath 
+				   << " differs from the one written, the old snapshot at " << path << " is kept.");
+	}
+
+	// The new snapshot replaces the old one in a single rename, so there's never a moment without a snapshot
+	// at the path. On POSIX rename(..) replaces the target atomically. On windows rename(..) fails when the 
+	// target exists, so MoveFileEx(..) replaces it instead. Windows refuses the replace while a pricing process 
+	// has the old snapshot mapped: then we throw, the old snapshot stays in place and the new one is left at 
+	// the temporary path, to be written again once those processes have finished.
+#ifdef _WIN32
+	QL_REQUIRE(MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH),
+	           "writeMarketDataSnapshot(..): Was unable to replace " << path << " with " << tempPath 
+			   << " (windows error " << GetLastError() << "). It may be mapped by a pricing process.");
+#else
+	QL_REQUIRE(!std::rename(tempPath.c_str(), path.c_str()),
+	           "writeMarketDataSnapshot(..): Was unable to rename " << tempPath << " to " << path);
+#endif
+
+	writeDiagnostics("Wrote market data snapshot " + path + " (" + toString(sizeof(header) + writer.size())
+	                 + " bytes) with " + toString(keys[MarketDataSnapshot::calendars].size()) + " calendars, "
+	                 + toString(keys[MarketDataSnapshot::stock_data].size()) + " stocks, "
+	                 + toString(keys[MarketDataSnapshot::stock_prices].size()) + " stock prices and "
+	                 + toString(keys[MarketDataSnapshot::fx_spots].size()) + " fx prices.",
+	                 low, "writeMarketDataSnapshot");
+}
+
+///////////////////////////////////////////////////////////////////////
+// class MarketDataSnapshot::RecordReader
+MarketDataSnapshot::RecordReader::RecordReader(const char* pos, const char* end)
+{
+	m_pos = pos;
+	m_end = end;
+}
+
+void MarketDataSnapshot::RecordReader::read(void* dest, Size numBytes)
+{
+	QL_REQUIRE(numBytes <= (Size) (m_end - m_pos),
+	           "MarketDataSnapshot::RecordReader: Attempted to read beyond the end of the snapshot, it may be corrupt.");
+	memcpy(dest, m_pos, numBytes); // memcpy(..) since the fields aren't aligned
+	m_pos += numBytes;
+}
+
+boost::uint32_t MarketDataSnapshot::RecordReader::getUInt32() { boost::uint32_t value; read(&value, sizeof(value)); return value; }
+boost::uint64_t MarketDataSnapshot::RecordReader::getUInt64() { boost::uint64_t value; read(&value, sizeof(value)); return value; }
+Integer         MarketDataSnapshot::RecordReader::getInteger(){ return (Integer) (boost::int32_t) getUInt32();                  }
+Real            MarketDataSnapshot::RecordReader::getReal()   { double          value; read(&value, sizeof(value)); return value; }
+bool            MarketDataSnapshot::RecordReader::getBool()   { char            value; read(&value, sizeof(value)); return value != 0; }
+Date            MarketDataSnapshot::RecordReader::getDate()   { return Date((BigInteger) getInteger());                         }
+
+std::string MarketDataSnapshot::RecordReader::getString()
+{
+	boost::uint32_t length = getUInt32();
+	QL_REQUIRE(length <= (Size) (m_end - m_pos),
+	           "MarketDataSnapshot::RecordReader: Found a string longer than the rest of the snapshot, it may be corrupt.");
+	std::string str(m_pos, length);
+	m_pos += length;
+	return str;
+}
+
+///////////////////////////////////////////////////////////////////////
+// class MarketDataSnapshot
+MarketDataSnapshot::MarketDataSnapshot(const std::string& path)
+{
+	m_path = path;
+	try
+	{   // the mapping stays valid once the file_mapping has gone out of scope
+		boost::interprocess::file_mapping  file(path.c_str(), boost::interprocess::read_only);
+		boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+		m_region.swap(region);
+	}
+	catch(std::exception& e)
+	{
+		QL_FAIL("MarketDataSnapshot::MarketDataSnapshot(..): Was unable to map the market data snapshot "
+		        << path << "\n" << e.what());
+	}
+
+	const char* start = (const char*) m_region.get_address();
+	Size        size  = m_region.get_size();
+
+	MarketDataSnapshotHeader header;
+	QL_REQUIRE(size >= sizeof(header), "MarketDataSnapshot::MarketDataSnapshot(..): " << path
+	           << " is too small to be a market data snapshot.");
+	memcpy(&header, start, sizeof(header));
+
+	QL_REQUIRE(!memcmp(header.magic, CONST_marketDataSnapshotMagic, sizeof(header.magic)),
+	           "MarketDataSnapshot::MarketDataSnapshot(..): " << path << " is not a market data snapshot.");
+
+	// The records are read in the machine's byte order, so a snapshot from a machine with the 
+	// other byte order can't be used. A version 1 snapshot has its version where the mark now is.
+	QL_REQUIRE(header.byteOrder != 0x04030201, "MarketDataSnapshot::MarketDataSnapshot(..): " << path 
+	           << " was written on a machine with the other byte order.\n"
+			   << "The snapshot can be rewritten with: sateek <path_to_config> snapshot");
+	QL_REQUIRE(header.byteOrder == CONST_marketDataSnapshotByteOrder, "MarketDataSnapshot::MarketDataSnapshot(..): " 
+	           << path << " has no byte order mark, it's from an older version or corrupt.\n"
+			   << "The snapshot can be rewritten with: sateek <path_to_config> snapshot");
+
+	QL_REQUIRE(header.version == CONST_marketDataSnapshotVersion, "MarketDataSnapshot::MarketDataSnapshot(..): "
+	           << path << " is a version " << header.version << " snapshot, but version "
+			   << CONST_marketDataSnapshotVersion << " is required.\n"
+			   << "The snapshot can be rewritten with: sateek <path_to_config> snapshot");
+
+	QL_REQUIRE(header.numSections == num_sections, "MarketDataSnapshot::MarketDataSnapshot(..): " << path
+	           << " has " << header.numSections << " sections, expected " << (Size) num_sections);
+
+	QL_REQUIRE(header.payloadSize == size - sizeof(header), "MarketDataSnapshot::MarketDataSnapshot(..): "
+	           << path << " should have " << sizeof(header) + header.payloadSize << " bytes, but has "
+			   << size << ". It may be truncated.");
+
+	m_payload = start + sizeof(header);
+	m_end     = m_payload + (Size) header.payloadSize;
+
+	// The checksum is off by default: it was verified when the snapshot was written, and checking it here
+	// reads every page of the file, so each pricing process would pay for the whole snapshot at startup
+	// instead of only the pages it looks up. Turning it on catches a snapshot damaged after it was written,
+	// e.g. on disk or while being copied between machines, at that cost.
+	std::string verify = "off";
+	getConfig()->find("market_data_snapshot_verify", verify);
+	if(verify == "on")
+	{
+		boost::crc_32_type crc;
+		crc.process_bytes(m_payload, (Size) header.payloadSize);
+		QL_REQUIRE(crc.checksum() == header.checksum, "MarketDataSnapshot::MarketDataSnapshot(..): "
+		           << "The checksum of " << path << " is wrong, the snapshot is corrupt.");
+	}
+	writeDiagnostics("Mapped market data snapshot " + path, mid, "MarketDataSnapshot::MarketDataSnapshot");
+}
+
+MarketDataSnapshot::RecordReader MarketDataSnapshot::at(boost::uint64_t offset) const
+{
+	QL_REQUIRE(offset <= (boost::uint64_t) (m_end - m_payload),
+	           "MarketDataSnapshot: Found an offset beyond the end of " << m_path << ", it may be corrupt.");
+	return RecordReader(m_payload + (Size) offset, m_end);
+}
+
+// A binary search of the section's directory, which is sorted by key.
+bool MarketDataSnapshot::find(Section section, const std::string& key, RecordReader& record) const
+{
+	RecordReader    sectionTable    = at(16 * (boost::uint64_t) section);
+	boost::uint64_t numKeys         = sectionTable.getUInt64();
+	boost::uint64_t directoryOffset = sectionTable.getUInt64();
+
+	boost::uint64_t low = 0, high = numKeys;
+	while(low < high)
+	{
+		boost::uint64_t mid          = low + (high - low) / 2;
+		RecordReader    entry        = at(directoryOffset + 16 * mid);
+		boost::uint64_t keyOffset    = entry.getUInt64();
+		boost::uint64_t recordOffset = entry.getUInt64();
+
+		int comparison = key.compare(at(keyOffset).getString());
+		if(comparison == 0)
+		{
+			record = at(recordOffset);
+			return true;
+		}
+		if(comparison < 0)
+			high = mid;
+		else
+			low  = mid + 1;
+	}
+	return false;
+}
+
+bool MarketDataSnapshot::findByIDAndIDType(Section             section,
+										   Section             sectionByID,
+										   const std::string&  ID,
+										   const std::string&  IDType,
+										   RecordReader&       record) const
+{
+	if(IDType.size() == 0)
+		return find(sectionByID, ID, record);
+
+	return    find(section, ID + CONST_STR_divider + IDType, record)
+	       || find(section, ID + CONST_STR_divider,          record); // a record without an ID type
+}
+
+///////////////////////////////////////////////////////////////////////
+// The snapshot sources, these build the same objects as the xml sources
+CalendarSnapshotSource::CalendarSnapshotSource(MarketCaches* marketCaches)
+	: MarketObjSource<boost::shared_ptr<Calendar> >(marketCaches, true) // using a single key
+{}
+
+boost::shared_ptr<Calendar> CalendarSnapshotSource::get_s(const std::string& calID)
+{
+	MarketDataSnapshot::RecordReader record(NULL, NULL);
+	QL_REQUIRE(m_marketCaches->getMarketDataSnapshot()->find(MarketDataSnapshot::calendars, calID, record),
+	           "Was unable to find the holiday calendar " << calID << " in the market data snapshot.");
+
+	std::string calIDInData = record.getString();
+	boost::shared_ptr<BespokeCalendar> bCal = (boost::shared_ptr<BespokeCalendar>) new BespokeCalendar(calIDInData);
+	bCal->addWeekend(Saturday);
+	bCal->addWeekend(Sunday);
+
+	std::vector<Date> holDates(record.getUInt32());
+	for(Size i = 0; i < holDates.size(); i++)
+		holDates[i] = record.getDate();
+	addVectorOfHolidays(&(*bCal), holDates);
+
+	return (boost::shared_ptr<Calendar>) bCal;
+}
+
+FXVolSnapshotSource::FXVolSnapshotSource(MarketCaches* marketCaches)
+	: MarketObjSource<boost::shared_ptr<BlackVolTermStructure> >(marketCaches)
+{}
+
+boost::shared_ptr<BlackVolTermStructure> FXVolSnapshotSource::get(const std::string& currency1,
+																  const std::string& currency2)
+{
+	QL_REQUIRE( currency1 != currency2, "FXVolSnapshotSource::get(..): There's no FX vol between currency: '"
+		                                << currency1 << "' and itself.");
+
+	MarketDataSnapshot::RecordReader record(NULL, NULL);
+	QL_REQUIRE(m_marketCaches->getMarketDataSnapshot()->find(MarketDataSnapshot::fx_vols,
+	                                                         getCurrencyPairKey(currency1, currency2), record),
+	           "Was unable to find volatility in the market data snapshot for: " << currency1 << "-" << currency2);
+	record.getString(); // ccy1
+	record.getString(); // ccy2
+	Real FXVol = record.getReal();
+    QL_REQUIRE(FXVol > 0, "FXVolSnapshotSource::get(..): Found FX vol for "
+		                   << currency1 << " " << currency2  << " to be " << FXVol
+						   << ", but it should be strictly greater than zero.");
+
+	return (boost::shared_ptr<BlackVolTermStructure>)
+		             new BlackConstantVol(m_marketCaches->getEvalDate(),
+		                                  TARGET(),       // for now will use the target calendar
+				                          FXVol,
+                                          Actual365Fixed() );
+}
+
+YieldTS_SnapshotSource::YieldTS_SnapshotSource(MarketCaches* marketCaches)
+	: MarketObjSource<boost::shared_ptr<YieldTermStructure> >(marketCaches)
+{}
+
+boost::shared_ptr<YieldTermStructure> YieldTS_SnapshotSource::get(const std::string& yieldType,
+																  const std::string& currency)
+{
+	QL_REQUIRE( yieldType == CONST_STR_risk_free_rate, "YieldTS_SnapshotSource::get(..): For now yieldType must be '"
+		        << CONST_STR_risk_free_rate << "' here it is: " << yieldType << "." << std::endl);
+
+	MarketDataSnapshot::RecordReader record(NULL, NULL);
+	QL_REQUIRE(m_marketCaches->getMarketDataSnapshot()->find(MarketDataSnapshot::risk_free_rates, currency, record),
+	           "YieldTS_SnapshotSource::get(..): Was unable to find risk_free_rate in the market data snapshot for: "
+		       << currency);
+	record.getString(); // currency
+	Real flatRate = record.getReal();
+
+    QL_REQUIRE(flatRate >= 0, "YieldTS_SnapshotSource::get(..): Found flat_rate for "
+		                      << currency << " to be " << flatRate * 100.0
+						      << "%, but it should be greater than or equal to zero.");
+
+    QL_REQUIRE(flatRate < 1,  "YieldTS_SnapshotSource::get(..): Found flat_rate for "
+		                      << currency << " to be " << flatRate * 100.0
+						      << "%, but it should be less than 100%.");
+
+    return (boost::shared_ptr<YieldTermStructure>)
+		       new FlatForward(m_marketCaches->getEvalDate(), flatRate, Actual365Fixed() );
+}
+
+StockDataSnapshotSource::StockDataSnapshotSource(MarketCaches* marketCaches)
+	: MarketObjSource<boost::shared_ptr<StockData> >(marketCaches)
+{}
+
+boost::shared_ptr<StockData> StockDataSnapshotSource::get(const std::string& stockID, const std::string& stockIDType)
+{
+	QL_REQUIRE( stockID.size() > 0, "StockDataSnapshotSource::get(..): stockID can't be an empty string.");
+
+	MarketDataSnapshot::RecordReader record(NULL, NULL);
+	QL_REQUIRE(m_marketCaches->getMarketDataSnapshot()->findByIDAndIDType(MarketDataSnapshot::stock_data,
+	                                                                      MarketDataSnapshot::stock_data_by_id,
+																		  stockID, stockIDType, record),
+	           "StockDataSnapshotSource::get(..): Was unable to find the stock, "
+		       << stockIDType << " : " << stockID );
+
+	boost::shared_ptr<StockData> stockData = (boost::shared_ptr<StockData>) new StockData();
+	stockData->setID(record.getString());
+
+	// in the order written by writeMarketDataSnapshot(..), each preceded by whether it's present
+	if(record.getBool()) stockData->setIDType           (record.getString());
+	if(record.getBool()) stockData->setCurrency         (record.getString());
+	if(record.getBool()) stockData->setName             (record.getString());
+	if(record.getBool()) stockData->setHolidayCalendarID(record.getString());
+	if(record.getBool()) stockData->setFlatVol          (record.getReal());
+	if(record.getBool()) stockData->setSpotPrice        (record.getReal());
+	if(record.getBool()) stockData->setDividendYield    (record.getReal());
+	if(record.getBool()) stockData->setRepoRate         (record.getReal());
+	if(record.getBool()) stockData->setCreditSpread     (record.getReal());
+
+	return stockData;
+}
+
+StockPricesSnapshotSource::StockPricesSnapshotSource(MarketCaches* marketCaches)
+	: MarketObjSource<boost::shared_ptr<Prices> >(marketCaches)
+{}
+
+boost::shared_ptr<Prices> StockPricesSnapshotSource::get(const std::string& ID, const std::string& IDType)
+{
+	MarketDataSnapshot::RecordReader record(NULL, NULL);
+	QL_REQUIRE(m_marketCaches->getMarketDataSnapshot()->findByIDAndIDType(MarketDataSnapshot::stock_prices,
+	                                                                      MarketDataSnapshot::stock_prices_by_id,
+																		  ID, IDType, record),
+	           "StockPricesSnapshotSource::get(..):\n"
+		       << "Was unable to find the stock prices for: "
+		       << (IDType.length() > 0 ? IDType + toString(": ") : toString(""))
+		       << ID);
+
+	boost::shared_ptr<Prices> prices = (boost::shared_ptr<Prices>) new Prices(m_marketCaches->getEvalDate(), ID);
+	record.getString(); // id
+
+	if(record.getBool())
+		prices->setCurrentPrice(record.getReal());
+
+	boost::uint32_t numPrices = record.getUInt32();
+	for(Size i = 0; i < numPrices; i++)
+	{
+		Date date  = record.getDate();
+		prices->addPrice(date, record.getReal());
+	}
+	return prices;
+}
+
+FXPricesSnapshotSource::FXPricesSnapshotSource(MarketCaches* marketCaches)
+	: MarketObjSource<boost::shared_ptr<Prices> >(marketCaches)
+{}
+
+// The value of 1 unit of ID1 quoted in currency ID2
+boost::shared_ptr<Prices> FXPricesSnapshotSource::get(const std::string& ID1, const std::string& ID2)
+{
+	MarketDataSnapshot::RecordReader record(NULL, NULL);
+	QL_REQUIRE(m_marketCaches->getMarketDataSnapshot()->find(MarketDataSnapshot::fx_spots,
+	                                                         getCurrencyPairKey(ID1, ID2), record),
+	           "FXPricesSnapshotSource::get(..):\n"
+		       << "Was unable to find the FX Prices for: " << ID1 << " - " << ID2);
+
+	// the data may be quoted the other way round
+	bool isReciprocal = (record.getString() != ID1);
+	record.getString(); // id2
+
+	boost::shared_ptr<Prices> prices = (boost::shared_ptr<Prices>) new Prices(m_marketCaches->getEvalDate(), ID1, ID2);
+
+	Real currentPrice = record.getReal();
+	if( currentPrice > 0.0)
+		prices->setCurrentPrice(isReciprocal ? 1.0/currentPrice : currentPrice);
+
+	boost::uint32_t numPrices = record.getUInt32();
+	for(Size i = 0; i < numPrices; i++)
+	{
+		Date date  = record.getDate();
+		Real price = record.getReal();
+		prices->addPrice(date, isReciprocal ? 1.0/price : price);
+	}
+	return prices;
+}
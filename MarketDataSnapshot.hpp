@@ -0,0 +1,141 @@
+#ifndef marketdatasnapshot_hpp
+#define marketdatasnapshot_hpp
+
+#include "MarketData.hpp"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/cstdint.hpp>
+
+// A market data snapshot is the xml market data compiled into a single binary file.
+// It's written once, when the market data is published, by running:
+//     sateek <path_to_config> snapshot
+// Pricing processes then set their sources to 'snapshot', the file is memory-mapped
+// rather than parsed, so processes on the same machine share its pages.
+//
+// Layout, in the byte order of the machine that wrote it:
+//     header:   magic, byte order mark, format version, number of sections, crc32 of the payload, payload size
+//     payload:  the section table, the records, the keys and for each section a directory
+//               of (key offset, record offset) pairs sorted by key, for a binary search.
+// Offsets are from the start of the payload.
+
+const char            CONST_marketDataSnapshotMagic[8]  = {'S','A','T','E','E','K','M','D'};
+const boost::uint32_t CONST_marketDataSnapshotByteOrder = 0x01020304; // reads as 0x04030201 with the other byte order
+const boost::uint32_t CONST_marketDataSnapshotVersion   = 2;          // increment when the layout changes
+
+// The byte order mark and version come straight after the magic, where every format version has them.
+struct MarketDataSnapshotHeader
+{
+	char             magic[8];
+	boost::uint32_t  byteOrder;   // CONST_marketDataSnapshotByteOrder
+	boost::uint32_t  version;     // the format version, CONST_marketDataSnapshotVersion
+	boost::uint32_t  numSections;
+	boost::uint32_t  checksum;    // crc32 of the payload
+	boost::uint64_t  payloadSize;
+};
+
+// Compiles the market data from the xml sources, whatever sources the config specifies,
+// into a snapshot at the config's market_data_snapshot_path.
+void writeMarketDataSnapshot(MarketCaches* marketCaches);
+
+class MarketDataSnapshot
+{
+public:
+	enum Section
+	{
+		calendars,           // key: id
+		fx_vols,             // key: the currency pair, see getCurrencyPairKey(..)
+		risk_free_rates,     // key: currency
+		stock_data,          // key: id<divider>id_type
+		stock_data_by_id,    // key: id, the first stock in the xml with that id
+		stock_prices,        // key: id<divider>id_type
+		stock_prices_by_id,  // key: id, the first item in the xml with that id
+		fx_spots,            // key: the currency pair
+		num_sections
+	};
+
+	// Reads fields from a record, throws rather than read past the end of the snapshot.
+	class RecordReader
+	{
+	private:
+		const char*  m_pos;
+		const char*  m_end;
+		void         read(void* dest, Size numBytes);
+	public:
+		RecordReader(const char* pos, const char* end);
+
+		boost::uint32_t  getUInt32();
+		boost::uint64_t  getUInt64();
+		Integer          getInteger();
+		Real             getReal();
+		bool             getBool();
+		std::string      getString();
+		Date             getDate();
+	};
+
+	// Maps the file, then checks the magic, byte order, version, size and, when market_data_snapshot_verify
+	// is 'on', the checksum. Will throw if any is wrong.
+	MarketDataSnapshot(const std::string& path);
+
+	// returns false when the key is not in the section
+	bool find(Section section, const std::string& key, RecordReader& record) const;
+
+	// An empty ID type, either requested or in the data, matches any ID type.
+	bool findByIDAndIDType(Section             section,
+	                       Section             sectionByID,
+	                       const std::string&  ID,
+	                       const std::string&  IDType,
+	                       RecordReader&       record) const;
+private:
+	std::string                         m_path;
+	boost::interprocess::mapped_region  m_region;
+	const char*                         m_payload;
+	const char*                         m_end;
+
+	RecordReader at(boost::uint64_t offset) const; // a reader at an offset into the payload
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+// The sources used when the config specifies 'snapshot'
+class CalendarSnapshotSource : public MarketObjSource<boost::shared_ptr<Calendar> >
+{
+public:
+	CalendarSnapshotSource(MarketCaches* marketCaches);
+	boost::shared_ptr<Calendar> get_s(const std::string& calID);
+};
+
+class FXVolSnapshotSource : public MarketObjSource<boost::shared_ptr<BlackVolTermStructure> >
+{
+public:
+	FXVolSnapshotSource(MarketCaches* marketCaches);
+	boost::shared_ptr<BlackVolTermStructure> get(const std::string& currency1, const std::string& currency2);
+};
+
+class YieldTS_SnapshotSource : public MarketObjSource<boost::shared_ptr<YieldTermStructure> >
+{
+public:
+	YieldTS_SnapshotSource(MarketCaches* marketCaches);
+	boost::shared_ptr<YieldTermStructure> get(const std::string& yieldType, const std::string& currency);
+};
+
+class StockDataSnapshotSource : public MarketObjSource<boost::shared_ptr<StockData> >
+{
+public:
+	StockDataSnapshotSource(MarketCaches* marketCaches);
+	boost::shared_ptr<StockData> get(const std::string& stockID, const std::string& stockIDType);
+};
+
+class StockPricesSnapshotSource : public MarketObjSource<boost::shared_ptr<Prices> >
+{
+public:
+	StockPricesSnapshotSource(MarketCaches* marketCaches);
+	boost::shared_ptr<Prices> get(const std::string& ID, const std::string& IDType);
+};
+
+class FXPricesSnapshotSource : public MarketObjSource<boost::shared_ptr<Prices> >
+{
+public:
+	FXPricesSnapshotSource(MarketCaches* marketCaches);
+	boost::shared_ptr<Prices> get(const std::string& ID1, const std::string& ID2);
+};
+
+#endif // for  #ifndef marketdatasnapshot_hpp
@@ -0,0 +1,748 @@
+#include "MonteCarlo.hpp"
+#include "Result.hpp"
+
+namespace
+{
+	// One application of the Philox4x32-10 bijection, the counter is overwritten with the output.
+	void philox4x32_10(boost::uint32_t counter[4], const boost::uint32_t key[2])
+	{
+		const boost::uint32_t multiplier0 = 0xD2511F53, multiplier1 = 0xCD9E8D57;
+		const boost::uint32_t weyl0       = 0x9E3779B9, weyl1       = 0xBB67AE85;
+
+		boost::uint32_t key0 = key[0], key1 = key[1];
+		for(Size round = 0; round < 10; round++)
+		{
+			boost::uint64_t product0 = (boost::uint64_t) multiplier0 * counter[0];
+			boost::uint64_t product1 = (boost::uint64_t) multiplier1 * counter[2];
+
+			boost::uint32_t hi0 = (boost::uint32_t)(product0 >> 32), lo0 = (boost::uint32_t) product0;
+			boost::uint32_t hi1 = (boost::uint32_t)(product1 >> 32), lo1 = (boost::uint32_t) product1;
+
+			counter[0] = hi1 ^ counter[1] ^ key0;
+			counter[1] = lo1;
+			counter[2] = hi0 ^ counter[3] ^ key1;
+			counter[3] = lo0;
+
+			key0 += weyl0;
+			key1 += weyl1;
+		}
+	}
+}
+
+PhiloxGaussianRsg::PhiloxGaussianRsg(Size dimension, BigNatural seed, BigNatural streamKey)
+	: m_dimension(dimension), m_nextPathIndex(0), m_sequence(std::vector<Real>(dimension), 1.0)
+{
+	QL_REQUIRE(dimension > 0, "PhiloxGaussianRsg: The dimension must be strictly positive.");
+
+	m_key[0] = (boost::uint32_t) seed;
+	m_key[1] = (boost::uint32_t) streamKey;
+
+	Size numBits = 4 * ((dimension + 3) / 4);
+	m_bits.resize(numBits);
+	m_radius.resize(numBits / 2);
+	m_angle.resize(numBits / 2);
+}
+
+const PhiloxGaussianRsg::sample_type& PhiloxGaussianRsg::nextSequence() const
+{
+	return sequenceForPath(m_nextPathIndex++);
+}
+
+const PhiloxGaussianRsg::sample_type& PhiloxGaussianRsg::lastSequence() const
+{
+	return m_sequence;
+}
+
+const PhiloxGaussianRsg::sample_type& PhiloxGaussianRsg::sequenceForPath(BigNatural pathIndex) const
+{
+	// Each block of 4 random integers comes from the counter (block, path index, 0, 0).
+	for(Size block = 0; block < m_bits.size() / 4; block++)
+	{
+		boost::uint32_t* counter = &m_bits[4 * block];
+		counter[0] = (boost::uint32_t) block;
+		counter[1] = (boost::uint32_t) pathIndex;
+		counter[2] = 0;
+		counter[3] = 0;
+		philox4x32_10(counter, m_key);
+	}
+
+	// The Box-Muller transform is done in separate simple loops over the whole sequence,
+	// so that the compiler can vectorize them.
+	const Real toUniform = 1.0 / 4294967296.0; // 2^-32
+	const Real twoPi     = 6.283185307179586;
+	Size numPairs = m_radius.size();
+	for(Size pair = 0; pair < numPairs; pair++)
+	{
+		m_radius[pair] = std::sqrt(-2.0 * std::log(((Real) m_bits[2 * pair] + 0.5) * toUniform));
+		m_angle [pair] = twoPi * ((Real) m_bits[2 * pair + 1] + 0.5) * toUniform;
+	}
+
+	std::vector<Real>& normals = m_sequence.value;
+	for(Size i = 0; i < m_dimension; i++)
+		normals[i] = m_radius[i / 2] * ( i % 2 == 0 ? std::cos(m_angle[i / 2]) : std::sin(m_angle[i / 2]));
+
+	return m_sequence;
+}
+
+BigNatural getContractStreamKey(const std::string& contractID)
+{   // 32 bit FNV-1a
+	boost::uint32_t hash = 2166136261U;
+	for(Size i = 0; i < contractID.length(); i++)
+	{
+		hash ^= (boost::uint32_t)(unsigned char) contractID[i];
+		hash *= 16777619U;
+	}
+	return (BigNatural) hash;
+}
+
+BigNatural getContractSeed(const std::string& contractID)
+{   // We mix the global seed and the contract's hash (using the 32 bit 'lowbias32' finalizer),
+	// so that nearby global seeds don't give related contract seeds. 
+	boost::uint32_t seed = (boost::uint32_t) getConfig()->getRandomGeneratorSeed() 
+		                   ^ (boost::uint32_t) getContractStreamKey(contractID);
+	seed ^= seed >> 16;
+	seed *= 0x7FEB352DU;
+	seed ^= seed >> 15;
+	seed *= 0x846CA68BU;
+	seed ^= seed >> 16;
+
+	// QuantLib's Mersenne Twister treats a seed of zero as 'seed from the clock', which we don't want.
+	if(seed == 0)
+		seed = 1;
+
+	writeDiagnostics("Contract " + contractID + " has random generator seed " + toString(seed), 
+		             high, "getContractSeed");
+	return (BigNatural) seed;
+}
+
+namespace
+{
+	// Appends the records to the convergence file, which is in the output directory (if there is one).
+	// A header is written when the file is new.
+	void appendConvergenceRecords(const std::string& fileName, const std::string& records)
+	{
+		std::string directory;
+		std::string path = (getConfig()->find("output_directory", directory) ? directory + "/" : "") + fileName;
+
+		std::ifstream existingFile(path.c_str());
+		bool isNewFile = existingFile.fail();
+		existingFile.close();
+
+		std::ofstream file;
+		file.open(path.c_str(), std::ios::app);
+		QL_REQUIRE(!file.fail(), "appendConvergenceRecords(..): Was unable to open file " << path 
+			       << " for writing the MC convergence records:\n" << records);
+		if(isNewFile)
+			file << "contract_id,num_samples,mean,error_estimate,wall_seconds,paths_per_wall_second\n";
+		file << records;
+		file.close();
+	}
+
+	// When batchSize is more than one, the samples are added a batch at a time (e.g. the stratified replications) 
+	// and the returned statistics are those of the batch means. numSamples must be a multiple of batchSize.
+	template <class RNG>
+	Statistics runFrozenGBMMonteCarlo(const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+									  const TimeGrid&                                          timeGrid,
+									  const boost::shared_ptr<PathPricer<Path> >&              pathPricer,
+									  const typename RNG::rsg_type&                            rsg,
+									  Size                                                     numSamples,
+									  Size                                                     batchSize,
+									  const std::string&                                       contractID)
+	{
+		typedef typename FrozenGBMSingleVariate<RNG>::path_generator_type generator_type;
+		boost::shared_ptr<generator_type> myPathGenerator(new generator_type(process, timeGrid, rsg));
+
+		// a statistics accumulator for the path-dependant Profit&Loss values
+		Statistics statisticsAccumulator;
+		bool antithetic = true;
+		// The Monte Carlo model generates paths using myPathGenerator
+		// each path is priced using the pathPricer
+		// prices will be accumulated into statisticsAccumulator
+		MonteCarloModel<FrozenGBMSingleVariate,RNG> MCSimulation(myPathGenerator, pathPricer,
+																 statisticsAccumulator, antithetic);
+		QL_REQUIRE((batchSize > 0) && (numSamples % batchSize == 0), "runFrozenGBMMonteCarlo(..): The number of "
+			       << "samples (" << numSamples << ") must be a multiple of the batch size (" << batchSize << ")");
+		Statistics batchMeans;
+		Real       sumOfPreviousBatches = 0.0;
+
+		// When the config has an mc_convergence_file, we add the samples in powers of two (batches), recording 
+		// the running mean, error estimate and wall clock timings after each. Each sample includes its antithetic path.
+		std::string convergenceFile;
+		bool recordConvergence = getConfig()->find("mc_convergence_file", convergenceFile);
+		std::ostringstream records;
+		// boost::timer measures the process' CPU time, we want the elapsed (wall) time.
+		boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+		Size samplesDone = 0, nextRecord = 2 * batchSize; // need at least 2 samples (batches) for the error estimate
+		while(samplesDone < numSamples)
+		{
+			Size target = (recordConvergence ? std::min(nextRecord, numSamples) : numSamples);
+			if(batchSize == 1)
+			{
+				MCSimulation.addSamples(target - samplesDone);
+				samplesDone = target;
+			}
+			else
+			{
+				for( ; samplesDone < target; samplesDone += batchSize)
+				{
+					MCSimulation.addSamples(batchSize);
+					Real sum = MCSimulation.sampleAccumulator().mean() * (Real) MCSimulation.sampleAccumulator().samples();
+					batchMeans.add((sum - sumOfPreviousBatches) / (Real) batchSize);
+					sumOfPreviousBatches = sum;
+				}
+			}
+
+			if(recordConvergence)
+			{
+				const Statistics& statistics = (batchSize > 1 ? batchMeans : MCSimulation.sampleAccumulator());
+				Real seconds = (Real)(boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds()
+					           / 1.0e6;
+				records << contractID << "," << samplesDone << std::setprecision(10) 
+					    << "," << statistics.mean()
+					    << "," << (statistics.samples() > 1 ? statistics.errorEstimate() : 0.0)
+						<< "," << seconds 
+						<< "," << (seconds > 0.0 ? 2.0 * (Real) samplesDone / seconds : 0.0) << "\n";
+				nextRecord *= 2;
+			}
+		}
+		if(recordConvergence)
+		{
+			appendConvergenceRecords(convergenceFile, records.str());
+			writeDiagnostics("Wrote the MC convergence records for " + contractID + " to " + convergenceFile,
+				             high, "getMonteCarloStatistics");
+		}
+
+		return (batchSize > 1 ? batchMeans : MCSimulation.sampleAccumulator());
+	}
+
+	template <class RNG>
+	Statistics runWithSampling(const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+							   const TimeGrid&                                          timeGrid,
+							   const boost::shared_ptr<PathPricer<Path> >&              pathPricer,
+							   const typename RNG::rsg_type&                            rsg,
+							   Size                                                     numSamples,
+							   BigNatural                                               permutationSeed,
+							   const std::string&                                       contractID)
+	{
+		std::string sampling = "plain";
+		getConfig()->find("mc_sampling", sampling);
+
+		Size numStratifiedDims;
+		if(sampling == "plain")
+			return runFrozenGBMMonteCarlo<RNG>(process, timeGrid, pathPricer, rsg, numSamples, 1, contractID);
+		else if(sampling == "stratified")
+			numStratifiedDims = 1; // the terminal value
+		else if(sampling == "latin_hypercube")
+			numStratifiedDims = 2; // the terminal value and the mid point
+		else
+			QL_FAIL("getMonteCarloStatistics(..): Unrecognised mc_sampling in the config: " << sampling
+					<< ".\nCould try 'plain', 'stratified' or 'latin_hypercube'.");
+
+		// The error estimate comes from the means of independent replications, each stratified on its own.
+		std::string numReplicationsStr = "20";
+		getConfig()->find("mc_sampling_replications", numReplicationsStr);
+		Size numReplications = atoi(numReplicationsStr.c_str());
+		QL_REQUIRE((numReplications > 1) && (numSamples >= numReplications), 
+			       "getMonteCarloStatistics(..): Need at least two mc_sampling_replications and at least one "
+				   << "sample per replication, here there are " << numReplications << " replications and " 
+				   << numSamples << " samples.");
+
+		Size numStrata = numSamples / numReplications;
+		if(numStrata * numReplications != numSamples)
+			writeDiagnostics("Using " + toString(numStrata * numReplications) + " samples, i.e. " 
+			                 + toString(numReplications) + " replications of " + toString(numStrata) + " strata.",
+							 mid, "getMonteCarloStatistics");
+
+		typename StratifiedRandom<RNG>::rsg_type stratifiedRsg(rsg, timeGrid, numStrata, numStratifiedDims, 
+			                                                     permutationSeed);
+		return runFrozenGBMMonteCarlo<StratifiedRandom<RNG> >(process, timeGrid, pathPricer, stratifiedRsg, 
+			                                                  numStrata * numReplications, numStrata, contractID);
+	}
+}
+
+std::string getRandomGeneratorType()
+{
+	std::string randomGenerator = "mersenne_twister";
+	getConfig()->find("random_generator", randomGenerator);
+	QL_REQUIRE((randomGenerator == "mersenne_twister") || (randomGenerator == "philox"),
+		       "getRandomGeneratorType(): Unrecognised random_generator in the config: " << randomGenerator
+		       << ".\nCould try 'mersenne_twister' or 'philox'.");
+	return randomGenerator;
+}
+
+PseudoRandom::rsg_type makeMersenneTwisterRsg(Size dimension, const std::string& contractID, BigNatural stream)
+{
+	return PseudoRandom::make_sequence_generator(dimension, getContractSeed(contractID) + stream);
+}
+
+PhiloxRandom::rsg_type makePhiloxRsg(Size dimension, const std::string& contractID, BigNatural stream)
+{
+	return PhiloxRandom::make_sequence_generator(dimension, getConfig()->getRandomGeneratorSeed(), 
+		                                         getContractStreamKey(contractID) + stream);
+}
+
+Statistics getMonteCarloStatistics(const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+								   const TimeGrid&                                          timeGrid,
+								   const boost::shared_ptr<PathPricer<Path> >&              pathPricer,
+								   Size                                                     numSamples,
+								   const std::string&                                       contractID)
+{
+	// The strata permutations get a seed of their own, from a separate hash rather than a stream offset, 
+	// since the offsets are taken by the MLMC levels.
+	Size       dimension       = timeGrid.size() - 1;
+	BigNatural permutationSeed = getContractSeed(contractID + "_strata_permutations");
+
+	if(getRandomGeneratorType() == "philox")
+		return runWithSampling<PhiloxRandom>(process, timeGrid, pathPricer, makePhiloxRsg(dimension, contractID), 
+			                                 numSamples, permutationSeed, contractID);
+	else
+		return runWithSampling<PseudoRandom>(process, timeGrid, pathPricer, makeMersenneTwisterRsg(dimension, contractID), 
+			                                 numSamples, permutationSeed, contractID);
+}
+
+namespace
+{
+	template <class GSG>
+	class FrozenGBMLevelPathGenerator : public MultilevelMonteCarlo::LevelPathGenerator
+	{
+	private:
+		FrozenGBMPathGenerator<GSG> m_generator;
+	public:
+		FrozenGBMLevelPathGenerator(const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+		                            const TimeGrid&                                          timeGrid,
+									const GSG&                                               generator)
+			: m_generator(process, timeGrid, generator) {}
+
+		const Path& next()       const { return m_generator.next().value; }
+		const Path& antithetic() const { return m_generator.antithetic().value; }
+	};
+}
+
+void buildGridPathIndices(Size numPathIndices, Size stride, const std::vector<Size>& mandatoryPathIndices, // inputs
+						  std::vector<Size>& gridPathIndices)                                            // output
+{
+	QL_REQUIRE(stride > 0, "buildGridPathIndices(..): The stride must be strictly positive.");
+
+	std::vector<bool> isMandatory(numPathIndices, false);
+	for(Size i = 0; i < mandatoryPathIndices.size(); i++)
+		if(mandatoryPathIndices[i] < numPathIndices)
+			isMandatory[mandatoryPathIndices[i]] = true;
+
+	gridPathIndices.clear();
+	for(Size pathIndex = 0; pathIndex < numPathIndices; pathIndex++)
+	{
+		if( (pathIndex % stride == 0) || isMandatory[pathIndex] || (pathIndex == numPathIndices - 1))
+			gridPathIndices.push_back(pathIndex);
+	}
+}
+
+MultilevelMonteCarlo::MultilevelMonteCarlo(boost::shared_ptr<GridPathPricer>                 pricer,
+										   boost::shared_ptr<GeneralizedBlackScholesProcess> process,
+										   Time                                              maturity,
+										   Size                                              numDailySteps,
+										   Size                                              numLevels,
+										   const std::string&                                contractID)
+{
+	QL_REQUIRE(numLevels > 0,     "MultilevelMonteCarlo: Need at least one level.");
+	QL_REQUIRE(numDailySteps > 0, "MultilevelMonteCarlo: Need at least one time step.");
+
+	m_pricer    = pricer;
+	m_numLevels = numLevels;
+	bool usePhilox = (getRandomGeneratorType() == "philox");
+
+	std::vector<Size> mandatoryPathIndices;
+	m_pricer->getMandatoryPathIndices(mandatoryPathIndices);
+
+	m_gridPathIndices.resize(m_numLevels);
+	m_coarsePositions.resize(m_numLevels);
+	m_timeGrids.resize(m_numLevels);
+	m_pathGenerators.resize(m_numLevels);
+	m_levelStatistics.resize(m_numLevels);
+	m_levelSeconds.resize(m_numLevels, 0.0);
+	m_dailySeconds = 0.0;
+
+	Time dt = maturity / (Real) numDailySteps;
+	for(Size level = 0; level < m_numLevels; level++)
+	{
+		Size stride = (Size)1 << (m_numLevels - 1 - level); // the last level is daily
+		buildGridPathIndices(numDailySteps + 1, stride, mandatoryPathIndices, // inputs
+			                 m_gridPathIndices[level]);                       // output
+
+		std::vector<Time> gridTimes; // the TimeGrid will add on time zero
+		for(Size gridIndex = 1; gridIndex < m_gridPathIndices[level].size(); gridIndex++)
+			gridTimes.push_back(dt * (Real) m_gridPathIndices[level][gridIndex]);
+		m_timeGrids[level] = TimeGrid(gridTimes.begin(), gridTimes.end());
+
+		// Each level gets its own random number stream.
+		Size dimension = m_timeGrids[level].size() - 1;
+		if(usePhilox)
+			m_pathGenerators[level].reset(new FrozenGBMLevelPathGenerator<PhiloxRandom::rsg_type>(
+			                                  process, m_timeGrids[level], makePhiloxRsg(dimension, contractID, level)));
+		else
+			m_pathGenerators[level].reset(new FrozenGBMLevelPathGenerator<PseudoRandom::rsg_type>(
+			                                  process, m_timeGrids[level], makeMersenneTwisterRsg(dimension, contractID, level)));
+
+		if(level > 0) // the coarse grid is a subset of the fine grid, so we can find its points in the fine grid.
+		{
+			const std::vector<Size>& fineGrid   = m_gridPathIndices[level];
+			const std::vector<Size>& coarseGrid = m_gridPathIndices[level - 1];
+			Size fineIndex = 0;
+			for(Size coarseIndex = 0; coarseIndex < coarseGrid.size(); coarseIndex++)
+			{
+				while(fineGrid[fineIndex] < coarseGrid[coarseIndex])
+					fineIndex++;
+				m_coarsePositions[level].push_back(fineIndex);
+			}
+		}
+		writeDiagnostics("MLMC level " + toString(level) + " has " + toString(m_gridPathIndices[level].size())
+			             + " grid points.", high, "MultilevelMonteCarlo");
+	}
+}
+
+Real MultilevelMonteCarlo::getLevelSample(Size level)
+{
+	bool isDaily = (level == m_numLevels - 1);
+	Real sample = 0.0, dailyValue = 0.0;
+	for(Size i = 0; i < 2; i++)
+	{
+		boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+		const Path& finePath = (i == 0 ? m_pathGenerators[level]->next() 
+			                           : m_pathGenerators[level]->antithetic());
+
+		Real value = m_pricer->valueOnGrid(finePath, m_gridPathIndices[level]);
+		if(isDaily) // what plain daily MC would have spent on this path
+		{
+			m_dailySeconds += (Real)(boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds()
+				              / 1.0e6;
+			dailyValue     += 0.5 * value;
+		}
+		if(level > 0)
+		{
+			const std::vector<Size>& coarsePositions = m_coarsePositions[level];
+			Array coarseValues(coarsePositions.size());
+			for(Size coarseIndex = 0; coarseIndex < coarsePositions.size(); coarseIndex++)
+				coarseValues[coarseIndex] = finePath.value(coarsePositions[coarseIndex]);
+
+			Path coarsePath(m_timeGrids[level - 1], coarseValues);
+			value -= m_pricer->valueOnGrid(coarsePath, m_gridPathIndices[level - 1]);
+		}
+		sample += 0.5 * value;
+	}
+	if(isDaily)
+		m_dailyStatistics.add(dailyValue);
+	return sample;
+}
+
+Real MultilevelMonteCarlo::getCostPerSample(Size level) const
+{   // The measured wall clock time per sample. The clock's resolution can be coarse, so a level
+	// it hasn't seen move yet is taken to cost a microsecond per sample.
+	Real samples = (Real) m_levelStatistics[level].samples();
+	return std::max(m_levelSeconds[level], 1.0e-6 * samples) / samples;
+}
+
+void MultilevelMonteCarlo::addSamples(Size level, Size numSamples)
+{
+	boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+	for(Size i = 0; i < numSamples; i++)
+		m_levelStatistics[level].add(getLevelSample(level));
+	m_levelSeconds[level] += (Real)(boost::posix_time::microsec_clock::universal_time() - startTime).total_microseconds()
+		                     / 1.0e6;
+}
+
+Real MultilevelMonteCarlo::calculate(Real targetRMSE, Size initialSamplesPerLevel, Size maxIterations)
+{
+	QL_REQUIRE(targetRMSE > 0.0, "MultilevelMonteCarlo::calculate(..): target RMSE must be strictly positive, "
+		       << "here it is: " << targetRMSE);
+	QL_REQUIRE(initialSamplesPerLevel > 1, "MultilevelMonteCarlo::calculate(..): need at least two initial "
+		       << "samples per level to estimate the variance.");
+
+	for(Size level = 0; level < m_numLevels; level++)
+		addSamples(level, initialSamplesPerLevel);
+
+	// The optimal number of samples on level l is:  
+	//    N_l = 1 / targetRMSE^2 * sqrt(V_l / C_l) * sum_k sqrt(V_k * C_k)
+	// with V_l the variance and C_l the cost per sample. Giles splits the mean square error equally between
+	// the variance and the squared bias of the finest level, hence his factor 2, but our finest level is the 
+	// daily grid the contract is defined on, so it has no bias and the whole target goes to the variance.
+	// Since the variances and costs are estimated from the samples, we repeat until no more samples are required.
+	for(Size iteration = 0; iteration < maxIterations; iteration++)
+	{
+		Real sumSqrtVarTimesCost = 0.0;
+		for(Size level = 0; level < m_numLevels; level++)
+			sumSqrtVarTimesCost += std::sqrt(m_levelStatistics[level].variance() * getCostPerSample(level));
+
+		bool addedSamples = false;
+		for(Size level = 0; level < m_numLevels; level++)
+		{
+			Real optimalSamples = 1.0 / (targetRMSE * targetRMSE) * sumSqrtVarTimesCost
+				                  * std::sqrt(m_levelStatistics[level].variance() / getCostPerSample(level));
+			Size samplesDone = m_levelStatistics[level].samples();
+			if(optimalSamples > (Real) samplesDone)
+			{
+				addSamples(level, (Size) std::ceil(optimalSamples) - samplesDone);
+				addedSamples = true;
+			}
+		}
+		if(!addedSamples)
+			break;
+	}
+
+	Real estimate = 0.0;
+	for(Size level = 0; level < m_numLevels; level++)
+	{
+		estimate += m_levelStatistics[level].mean();
+		writeDiagnostics("MLMC level " + toString(level) + ": samples: " + toString(m_levelStatistics[level].samples())
+			             + ", mean: " + toString(m_levelStatistics[level].mean()) 
+						 + ", variance: " + toString(m_levelStatistics[level].variance()),
+						 mid, "MultilevelMonteCarlo::calculate");
+	}
+	return estimate;
+}
+
+Real MultilevelMonteCarlo::errorEstimate() const
+{
+	Real variance = 0.0;
+	for(Size level = 0; level < m_numLevels; level++)
+		variance += m_levelStatistics[level].variance() / (Real) m_levelStatistics[level].samples();
+
+	return std::sqrt(variance);
+}
+
+Real MultilevelMonteCarlo::getDailyMCSecondsAtSameRMSE() const
+{
+	Real error = errorEstimate();
+	if(m_dailyStatistics.samples() < 2 || error <= 0.0)
+		return 0.0;
+	return m_dailyStatistics.variance() / (error * error) * m_dailySeconds / (Real) m_dailyStatistics.samples();
+}
+
+Real MultilevelMonteCarlo::getSeconds() const
+{
+	Real seconds = 0.0;
+	for(Size level = 0; level < m_numLevels; level++)
+		seconds += m_levelSeconds[level];
+	return seconds;
+}
+
+Real getMultilevelMCValue(boost::shared_ptr<GridPathPricer>                 pricer,
+						  boost::shared_ptr<GeneralizedBlackScholesProcess> process,
+						  Time                                              maturity,
+						  Size                                              numDailySteps,
+						  Real                                              notional,
+						  const std::string&                                contractID)
+{
+	std::string numLevels = "4", targetRMSE = "0.001", initialSamples = "100", maxIterations = "10";
+	getConfig()->find("mlmc_num_levels",      numLevels);
+	getConfig()->find("mlmc_target_rmse",     targetRMSE);
+	getConfig()->find("mlmc_initial_samples", initialSamples);
+	getConfig()->find("mlmc_max_iterations",  maxIterations);
+
+	MultilevelMonteCarlo mlmc(pricer, process, maturity, numDailySteps, atoi(numLevels.c_str()), contractID);
+
+	Real value = mlmc.calculate(atof(targetRMSE.c_str()) * notional, atoi(initialSamples.c_str()), 
+		                        atoi(maxIterations.c_str()));
+	writeDiagnostics("MLMC error estimate per unit notional is " + toString(mlmc.errorEstimate() / notional), 
+		             mid, "getMultilevelMCValue");
+	writeDiagnostics("MLMC took " + toString(mlmc.getSeconds()) + " wall clock seconds, plain MC on the daily grid "
+		             + "would take about " + toString(mlmc.getDailyMCSecondsAtSameRMSE()) + " to reach the same RMSE.",
+					 mid, "getMultilevelMCValue");
+	return value;
+}
+
+void ExposurePathPricer::getRegressors(const Path& path, Size pathIndex,  // inputs 
+									   std::vector<Real>& regressors) const // output
+{
+	Real x = path.value(pathIndex) / path.value(0);
+	regressors.resize(3);
+	regressors[0] = 1.0;
+	regressors[1] = x;
+	regressors[2] = x * x;
+}
+
+Real ExposurePathPricer::getConditionalValue(const Path& path, Size pathIndex, const Date& date) const
+{
+	QL_FAIL("ExposurePathPricer::getConditionalValue(..): This pricer has no exact conditional value, "
+		    << "so the exposure_method must be 'regression'.");
+}
+
+namespace
+{
+	// Solves the normal equations A beta = b, with Gaussian elimination and partial pivoting. 
+	// A regressor that is always zero (e.g. when no path has knocked out) gets a zero coefficient.
+	void solveNormalEquations(std::vector<std::vector<Real> > A, std::vector<Real> b, // inputs (copied)
+							  std::vector<Real>& beta)                                // output
+	{
+		Size n = b.size();
+		Real scale = 0.0;
+		for(Size i = 0; i < n; i++)
+			scale = std::max(scale, std::fabs(A[i][i]));
+
+		std::vector<bool> isUsed(n, true);
+		for(Size col = 0; col < n; col++)
+		{
+			Size pivotRow = col;
+			for(Size row = col + 1; row < n; row++)
+				if(std::fabs(A[row][col]) > std::fabs(A[pivotRow][col]))
+					pivotRow = row;
+			std::swap(A[col], A[pivotRow]);
+			std::swap(b[col], b[pivotRow]);
+
+			if(std::fabs(A[col][col]) <= 1.0e-12 * scale)
+			{
+				isUsed[col] = false;
+				continue;
+			}
+			for(Size row = col + 1; row < n; row++)
+			{
+				Real factor = A[row][col] / A[col][col];
+				for(Size k = col; k < n; k++)
+					A[row][k] -= factor * A[col][k];
+				b[row] -= factor * b[col];
+			}
+		}
+
+		beta.assign(n, 0.0);
+		for(Size i = n; i-- > 0; )
+		{
+			if(!isUsed[i])
+				continue;
+			Real sum = b[i];
+			for(Size k = i + 1; k < n; k++)
+				sum -= A[i][k] * beta[k];
+			beta[i] = sum / A[i][i];
+		}
+	}
+}
+
+bool isExposureModeOn()
+{
+	std::string exposureMode = "off";
+	getConfig()->find("exposure_mode", exposureMode);
+	QL_REQUIRE((exposureMode == "off") || (exposureMode == "on"), 
+		       "isExposureModeOn(): Unrecognised exposure_mode in the config: " << exposureMode 
+			   << ".\nCould try 'off' or 'on'.");
+	return (exposureMode == "on");
+}
+
+ExposureCollector::ExposureCollector(const boost::shared_ptr<PathPricer<Path> >&  pathPricer,
+									 const boost::shared_ptr<ExposurePathPricer>& exposurePricer,
+									 Date                                         evalDate,
+									 Size                                         numDailySteps)
+	: m_pathPricer(pathPricer), m_exposurePricer(exposurePricer), m_numDailySteps(numDailySteps)
+{
+	std::string stepMonthsStr = "1";
+	getConfig()->find("exposure_step_months", stepMonthsStr);
+	Integer stepMonths = atoi(stepMonthsStr.c_str());
+	QL_REQUIRE(stepMonths > 0, "ExposureCollector: exposure_step_months must be positive, here it is: " << stepMonths);
+
+	std::string exposureMethod = "regression";
+	getConfig()->find("exposure_method", exposureMethod);
+	QL_REQUIRE((exposureMethod == "regression") || (exposureMethod == "exact"),
+		       "ExposureCollector: Unrecognised exposure_method in the config: " << exposureMethod
+			   << ".\nCould try 'regression' or 'exact'.");
+	m_useExactValues = (exposureMethod == "exact");
+
+	m_settlementDates = m_exposurePricer->getSettlementDates();
+	Date lastSettlementDate = *std::max_element(m_settlementDates.begin(), m_settlementDates.end());
+
+	for(Integer step = 1; evalDate + Period(step * stepMonths, Months) < lastSettlementDate; step++)
+		m_exposureDates.push_back(evalDate + Period(step * stepMonths, Months));
+
+	Size numDates = m_exposureDates.size();
+	m_pathIndices.resize(numDates);
+	for(Size d = 0; d < numDates; d++)
+		m_pathIndices[d] = std::min(m_exposurePricer->getPathIndexOfDate(m_exposureDates[d]), m_numDailySteps);
+
+	m_regressors.resize(numDates);
+	m_futurePVs.resize(numDates);
+	m_exactValues.resize(numDates);
+}
+
+Real ExposureCollector::operator()(const Path& path) const
+{
+	QL_REQUIRE(path.length() == m_numDailySteps + 1, "ExposureCollector: The exposure needs the daily paths, " 
+		       << "with " << m_numDailySteps + 1 << " points, but the path has " << path.length());
+
+	// We keep the regressors and the cashflows after each exposure date for every path,
+	// since the regression needs all the paths before the values can be found.
+	m_exposurePricer->getCashflowPVs(path, m_cashflowPVs);
+	for(Size d = 0; d < m_exposureDates.size(); d++)
+	{
+		m_regressors[d].push_back(std::vector<Real>());
+		m_exposurePricer->getRegressors(path, m_pathIndices[d], m_regressors[d].back());
+
+		Real futurePV = 0.0;
+		for(Size i = 0; i < m_cashflowPVs.size(); i++)
+			if(m_settlementDates[i] > m_exposureDates[d])
+				futurePV += m_cashflowPVs[i];
+		m_futurePVs[d].push_back(futurePV);
+
+		if(m_useExactValues)
+			m_exactValues[d].push_back(m_exposurePricer->getConditionalValue(path, m_pathIndices[d], 
+			                                                                 m_exposureDates[d]));
+	}
+	return (*m_pathPricer)(path);
+}
+
+void ExposureCollector::addExposureResults(const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+										   Real                                                     notional,
+										   const std::string&                                       contractID,
+										   const Result&                                            resultTemplate,
+										   ResultSet*                                               resultSet) const // output
+{
+	std::string quantile = "0.975";
+	getConfig()->find("exposure_pfe_quantile", quantile);
+
+	Size numDates = m_exposureDates.size();
+	for(Size d = 0; d < numDates; d++)
+	{
+		const std::vector<std::vector<Real> >& regressors = m_regressors[d];
+		Size numPaths = regressors.size();
+		QL_REQUIRE(numPaths > 0, "ExposureCollector::addExposureResults(..): No paths have been priced.");
+
+		Size numRegressors = regressors[0].size();
+		std::vector<std::vector<Real> > A(numRegressors, std::vector<Real>(numRegressors, 0.0));
+		std::vector<Real>               b(numRegressors, 0.0), beta;
+		for(Size pathNum = 0; pathNum < numPaths; pathNum++)
+		{
+			const std::vector<Real>& x = regressors[pathNum];
+			for(Size i = 0; i < numRegressors; i++)
+			{
+				b[i] += x[i] * m_futurePVs[d][pathNum];
+				for(Size j = 0; j < numRegressors; j++)
+					A[i][j] += x[i] * x[j];
+			}
+		}
+		if(!m_useExactValues)
+			solveNormalEquations(A, b, beta);
+
+		// The regression gives the value discounted to today, so we forward it to the exposure date.
+		Real discount = process->riskFreeRate()->discount(m_exposureDates[d]);
+		std::vector<Real> exposures(numPaths);
+		Real sumExposures = 0.0;
+		for(Size pathNum = 0; pathNum < numPaths; pathNum++)
+		{
+			Real value = 0.0;
+			if(m_useExactValues)
+				value = m_exactValues[d][pathNum];
+			else
+				for(Size i = 0; i < numRegressors; i++)
+					value += beta[i] * regressors[pathNum][i];
+			exposures[pathNum] = std::max(0.0, value / discount) * notional;
+			sumExposures += exposures[pathNum];
+		}
+		std::sort(exposures.begin(), exposures.end());
+		Size quantileIndex = std::min(numPaths - 1, (Size)(atof(quantile.c_str()) * (Real) numPaths));
+
+		boost::shared_ptr<Result> EERes = (boost::shared_ptr<Result>) new Result(resultTemplate);
+		EERes->setValueAndCategory(expected_exposure, sumExposures / (Real) numPaths);
+		EERes->setAttribute(exposure_date, toString(m_exposureDates[d]), true);
+		resultSet->addNewResult(EERes);
+
+		boost::shared_ptr<Result> PFERes = (boost::shared_ptr<Result>) new Result(*EERes);
+		PFERes->setValueAndCategory(potential_future_exposure, exposures[quantileIndex]);
+		resultSet->addNewResult(PFERes);
+	}
+	writeDiagnostics("Added exposure results for " + toString(numDates) + " dates, for contract " + contractID,
+		             mid, "ExposureCollector::addExposureResults");
+}
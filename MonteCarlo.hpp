@@ -0,0 +1,425 @@
+#ifndef montecarlo_hpp
+#define montecarlo_hpp
+
+#include "Utilities.hpp"
+#include <boost/cstdint.hpp>
+
+class Result;    // forward declarations
+class ResultSet;
+
+// A path generator for the Black-Scholes process, that can be used in place of QuantLib's PathGenerator.
+// The QuantLib generator calls the process' evolve(..) for each step of each path, which looks up the 
+// drift and diffusion in the term structures every time. Here we do the look-ups once, for the time grid, 
+// storing the multiplicative drift factor and the standard deviation for each step, so that each step
+// of a path is just:  S(i+1) = S(i) * driftFactor(i) * exp( stdDev(i) * z(i) ).
+// This is exact (i.e. no discretization error) when the vol doesn't depend on the spot.
+template <class GSG>
+class FrozenGBMPathGenerator
+{
+public:
+	typedef Sample<Path> sample_type;
+
+	FrozenGBMPathGenerator(const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+		                   const TimeGrid&                                          timeGrid,
+						   const GSG&                                               generator);
+
+	const sample_type& next()       const;
+	const sample_type& antithetic() const;
+	Size               size()       const { return m_driftFactors.size(); }
+	const TimeGrid&    timeGrid()   const { return m_timeGrid; }
+
+private:
+	const sample_type& buildPath(const std::vector<Real>& normals, Real sign) const;
+
+	GSG                 m_generator;
+	TimeGrid            m_timeGrid;
+	Real                m_spot;
+	std::vector<Real>   m_driftFactors; // one per time step
+	std::vector<Real>   m_stdDevs;      // one per time step
+	mutable sample_type m_next;
+};
+
+template <class GSG>
+FrozenGBMPathGenerator<GSG>::FrozenGBMPathGenerator(const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+													const TimeGrid&                                          timeGrid,
+													const GSG&                                               generator)
+	: m_generator(generator), m_timeGrid(timeGrid), m_next(Path(timeGrid), 1.0)
+{
+	QL_REQUIRE(m_generator.dimension() == m_timeGrid.size() - 1,
+		       "FrozenGBMPathGenerator: The dimension of the generator (" << m_generator.dimension()
+			   << ") must be the number of time steps (" << m_timeGrid.size() - 1 << ")");
+
+	m_spot = process->x0();
+	Size numSteps = m_timeGrid.size() - 1;
+	m_driftFactors.resize(numSteps);
+	m_stdDevs.resize(numSteps);
+	for(Size step = 0; step < numSteps; step++)
+	{
+		Time start = m_timeGrid[step], end = m_timeGrid[step + 1];
+		Real variance = process->blackVolatility()->blackVariance(end,   m_spot) 
+			          - process->blackVolatility()->blackVariance(start, m_spot);
+
+		// the forward of the spot grows by (Dq(end) / Dq(start)) / (Dr(end) / Dr(start)) over the step.
+		m_driftFactors[step] = process->dividendYield()->discount(end) / process->dividendYield()->discount(start)
+			                   * process->riskFreeRate()->discount(start) / process->riskFreeRate()->discount(end)
+							   * std::exp(-0.5 * variance);
+		m_stdDevs[step] = std::sqrt(variance);
+	}
+}
+
+template <class GSG>
+const typename FrozenGBMPathGenerator<GSG>::sample_type& FrozenGBMPathGenerator<GSG>::next() const
+{
+	return buildPath(m_generator.nextSequence().value, 1.0);
+}
+
+template <class GSG>
+const typename FrozenGBMPathGenerator<GSG>::sample_type& FrozenGBMPathGenerator<GSG>::antithetic() const
+{
+	return buildPath(m_generator.lastSequence().value, -1.0);
+}
+
+template <class GSG>
+const typename FrozenGBMPathGenerator<GSG>::sample_type& 
+FrozenGBMPathGenerator<GSG>::buildPath(const std::vector<Real>& normals, Real sign) const
+{
+	Path& path = m_next.value;
+	path.value(0) = m_spot;
+	for(Size step = 0; step < m_driftFactors.size(); step++)
+		path.value(step + 1) = path.value(step) * m_driftFactors[step] * std::exp(sign * m_stdDevs[step] * normals[step]);
+
+	m_next.weight = 1.0;
+	return m_next;
+}
+
+// Used with QuantLib's MonteCarloModel, in place of SingleVariate, i.e.
+//    MonteCarloModel<FrozenGBMSingleVariate, PseudoRandom> 
+template <class RNG>
+struct FrozenGBMSingleVariate 
+{
+	typedef FrozenGBMPathGenerator<typename RNG::rsg_type> path_generator_type;
+	typedef PathPricer<Path>                               path_pricer_type;
+};
+
+// A counter-based Gaussian sequence generator, using the Philox4x32-10 bijection (Salmon et al. 2011).
+// The random numbers for a path depend only on the key (seed, stream key) and the path index,
+// so any path can be regenerated on its own, e.g. to replay a path when debugging, 
+// or when the paths are split between threads. The stream key would usually be the contract's.
+// It has the same interface as PseudoRandom::rsg_type, so can be used with the path generators.
+class PhiloxGaussianRsg
+{
+public:
+	typedef Sample<std::vector<Real> > sample_type;
+
+	PhiloxGaussianRsg(Size dimension, BigNatural seed, BigNatural streamKey);
+
+	const sample_type& nextSequence() const; // the sequence for the next path index
+	const sample_type& lastSequence() const;
+	const sample_type& sequenceForPath(BigNatural pathIndex) const;
+	Size               dimension()    const { return m_dimension; }
+
+private:
+	Size                                 m_dimension;
+	boost::uint32_t                      m_key[2];
+	mutable BigNatural                   m_nextPathIndex;
+	mutable sample_type                  m_sequence;
+	mutable std::vector<boost::uint32_t> m_bits;    // size: dimension rounded up to a multiple of 4
+	mutable std::vector<Real>            m_radius;  // work space for the Box-Muller transform
+	mutable std::vector<Real>            m_angle;
+};
+
+// Used in place of PseudoRandom, to use the counter-based generator.
+struct PhiloxRandom
+{
+	typedef PhiloxGaussianRsg rsg_type;
+	static rsg_type make_sequence_generator(Size dimension, BigNatural seed, BigNatural streamKey = 0)
+	{ return rsg_type(dimension, seed, streamKey); }
+};
+
+// Wraps a Gaussian sequence generator, to stratify the first numStratifiedDims dimensions of the 
+// Brownian bridge construction, i.e. the terminal value (and, with 2 dimensions, the mid point).
+// The base generator's normals are passed through QuantLib's BrownianBridge, so that the first normal
+// drives the terminal value and the rest fill in the path conditional on it.
+// Before the bridge, the normal z of a stratified dimension is replaced by 
+//    InvNormal( (stratum + Normal(z)) / numStrata )
+// The samples come in replications of numStrata samples. In a replication each stratified dimension 
+// takes every stratum once, in a random order, with the dimensions shuffled independently 
+// ('stratified' with one dimension, 'latin_hypercube' with two). Each replication shuffles again,
+// so the replications are independent, while the samples within one aren't. The MC error is 
+// therefore estimated from the replication means, see getMonteCarloStatistics(..).
+// The permutation seed must not be the base generator's seed, or the shuffles would be driven by the
+// same Mersenne Twister sequence as the normals.
+template <class GSG>
+class StratifiedBridgeRsg
+{
+public:
+	typedef Sample<std::vector<Real> > sample_type;
+
+	StratifiedBridgeRsg(const GSG& generator, const TimeGrid& timeGrid, Size numStrata, 
+		                Size numStratifiedDims, BigNatural permutationSeed);
+
+	const sample_type& nextSequence() const;
+	const sample_type& lastSequence() const { return m_sequence; }
+	Size               dimension()    const { return m_generator.dimension(); }
+
+private:
+	void shufflePermutations() const; // at the start of each replication
+
+	GSG                                     m_generator;
+	BrownianBridge                          m_bridge;
+	Size                                    m_numStrata;
+	MersenneTwisterUniformRng               m_uniformRng;     // for the permutations
+	mutable std::vector<std::vector<Size> > m_permutations;   // one for each stratified dimension
+	mutable Size                            m_sampleIndex;
+	mutable std::vector<Real>               m_bridgeInput;
+	mutable sample_type                     m_sequence;
+	CumulativeNormalDistribution            m_cumNormal;
+	InverseCumulativeNormal                 m_invCumNormal;
+};
+
+template <class GSG>
+StratifiedBridgeRsg<GSG>::StratifiedBridgeRsg(const GSG& generator, const TimeGrid& timeGrid, Size numStrata, 
+											  Size numStratifiedDims, BigNatural permutationSeed)
+	: m_generator(generator), m_bridge(timeGrid), m_numStrata(numStrata), m_uniformRng(permutationSeed),
+	  m_sampleIndex(0), m_bridgeInput(generator.dimension()), 
+	  m_sequence(std::vector<Real>(generator.dimension()), 1.0)
+{
+	QL_REQUIRE(numStrata > 0, "StratifiedBridgeRsg: Need at least one stratum.");
+
+	numStratifiedDims = std::min(numStratifiedDims, m_generator.dimension());
+	m_permutations.resize(numStratifiedDims);
+	for(Size dim = 0; dim < numStratifiedDims; dim++)
+	{
+		std::vector<Size>& permutation = m_permutations[dim];
+		permutation.resize(m_numStrata);
+		for(Size stratum = 0; stratum < m_numStrata; stratum++)
+			permutation[stratum] = stratum;
+	}
+}
+
+template <class GSG>
+void StratifiedBridgeRsg<GSG>::shufflePermutations() const
+{   // Fisher-Yates shuffle
+	for(Size dim = 0; dim < m_permutations.size(); dim++)
+	{
+		std::vector<Size>& permutation = m_permutations[dim];
+		for(Size i = m_numStrata - 1; i > 0; i--)
+			std::swap(permutation[i], permutation[(Size)(m_uniformRng.next().value * (i + 1)) % (i + 1)]);
+	}
+}
+
+template <class GSG>
+const typename StratifiedBridgeRsg<GSG>::sample_type& StratifiedBridgeRsg<GSG>::nextSequence() const
+{
+	if(m_sampleIndex % m_numStrata == 0) // a new replication
+		shufflePermutations();
+
+	const std::vector<Real>& normals = m_generator.nextSequence().value;
+	std::copy(normals.begin(), normals.end(), m_bridgeInput.begin());
+
+	for(Size dim = 0; dim < m_permutations.size(); dim++)
+	{
+		Size stratum = m_permutations[dim][m_sampleIndex % m_numStrata];
+		m_bridgeInput[dim] = m_invCumNormal(((Real) stratum + m_cumNormal(normals[dim])) / (Real) m_numStrata);
+	}
+	m_sampleIndex++;
+
+	m_bridge.transform(m_bridgeInput.begin(), m_bridgeInput.end(), m_sequence.value.begin());
+	return m_sequence;
+}
+
+// Used in place of PseudoRandom or PhiloxRandom, when stratifying the Brownian bridge.
+template <class RNG>
+struct StratifiedRandom
+{
+	typedef StratifiedBridgeRsg<typename RNG::rsg_type> rsg_type;
+};
+
+// A hash of the contract ID, which doesn't depend on the platform or the order of the contracts.
+BigNatural getContractStreamKey(const std::string& contractID);
+
+// The seed for a contract's random stream, derived from the global seed in the config and the contract ID.
+// So a contract gets the same random numbers whether it is priced alone, in the test rig or in the full book.
+BigNatural getContractSeed(const std::string& contractID);
+
+// The random generator set in the config by random_generator: 'mersenne_twister' (default) or 'philox'.
+// Throws when it isn't recognised.
+std::string getRandomGeneratorType();
+
+// The contract's Gaussian sequence generators. Stream 0 is the one used by getMonteCarloStatistics(..),
+// the others (e.g. one per MLMC level) offset the Mersenne Twister seed or the Philox stream key.
+PseudoRandom::rsg_type makeMersenneTwisterRsg(Size dimension, const std::string& contractID, BigNatural stream = 0);
+PhiloxRandom::rsg_type makePhiloxRsg         (Size dimension, const std::string& contractID, BigNatural stream = 0);
+
+// Runs the MC for the path pricer, with the paths from the FrozenGBMPathGenerator on the time grid.
+// The random generator is chosen by random_generator in the config, see getRandomGeneratorType().
+// The sampling is set by mc_sampling: 'plain' (default), 'stratified' or 'latin_hypercube',
+// see StratifiedBridgeRsg. Antithetic paths are always used. When stratifying, the samples are split into
+// mc_sampling_replications (default 20) independent replications, and the returned statistics are those
+// of the replication means, so that the error estimate doesn't take the stratified samples to be independent.
+// When the config has an mc_convergence_file, the running mean and error estimate at powers of two 
+// samples, with the wall clock timings, are appended to that file (in the output_directory).
+Statistics getMonteCarloStatistics(const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+								   const TimeGrid&                                          timeGrid,
+								   const boost::shared_ptr<PathPricer<Path> >&              pathPricer,
+								   Size                                                     numSamples,
+								   const std::string&                                       contractID);
+
+// A path pricer for daily monitored payoffs, that can also value a path which has only been 
+// simulated on a subset of the days (the grid). The days between the grid points are dealt with
+// by the pricer, e.g. using the Brownian bridge.
+class GridPathPricer : public PathPricer<Path>
+{
+public:
+	// path.value(k) is the spot on the day with (daily) path index gridPathIndices[k],
+	// the first grid path index is always 0.
+	virtual Real valueOnGrid(const Path& path, const std::vector<Size>& gridPathIndices) const = 0;
+
+	// The (daily) path indices that must be on every grid, e.g. the period end dates.
+	virtual void getMandatoryPathIndices(std::vector<Size>& mandatoryPathIndices) const  // output
+	                                     { mandatoryPathIndices.clear(); }
+};
+
+// Sets the grid path indices: 0, every multiple of the stride, the mandatory indices and the last index.
+void buildGridPathIndices(Size numPathIndices, Size stride, const std::vector<Size>& mandatoryPathIndices, // inputs
+						  std::vector<Size>& gridPathIndices);                                            // output
+
+// Multilevel Monte Carlo (Giles 2008). Level l simulates on a grid with a stride of 2^(numLevels - 1 - l)
+// days, so the last level is daily. The level l > 0 estimator is the difference between the value on 
+// the level's grid and the value on the coarser grid of level l - 1, using the same path
+// (the coarse grid is a subset of the fine one). The number of samples per level is chosen to reach 
+// the target RMSE at the least cost. The cost of a level is the wall clock time per sample measured so far:
+// every level prices all the days of the path (between grid points through the Brownian bridge), so the
+// number of grid points understates the cost of the coarse levels. Since the costs are measured, the number
+// of samples per level, and so the estimate (within its error), can differ a little from run to run.
+// Level l uses the contract's random stream l, with the random_generator from the config, so with a single
+// level the paths are those of getMonteCarloStatistics(..) on the daily grid. The mc_sampling isn't used, 
+// since the number of samples on a level isn't known when it starts.
+class MultilevelMonteCarlo
+{
+public:
+	// The paths of one level, and their antithetic paths, on the level's time grid.
+	class LevelPathGenerator
+	{
+	public:
+		virtual ~LevelPathGenerator() {}
+		virtual const Path& next()       const = 0;
+		virtual const Path& antithetic() const = 0;
+	};
+private:
+	boost::shared_ptr<GridPathPricer>              m_pricer;
+	Size                                           m_numLevels;
+	std::vector<std::vector<Size> >                m_gridPathIndices;     // size m_numLevels
+	std::vector<std::vector<Size> >                m_coarsePositions;     // position of coarse grid points in the fine grid
+	std::vector<TimeGrid>                          m_timeGrids;           // size m_numLevels
+	std::vector<boost::shared_ptr<LevelPathGenerator> > m_pathGenerators; // size m_numLevels
+	std::vector<Statistics>                        m_levelStatistics;     // size m_numLevels
+	std::vector<Real>                              m_levelSeconds;        // wall clock time spent on each level
+	Statistics                                     m_dailyStatistics;     // the fine (daily) values on the last level
+	Real                                           m_dailySeconds;        // wall clock time spent on them
+
+	MultilevelMonteCarlo() { QL_FAIL("MultilevelMonteCarlo(): Please don't use this constructor"); }
+
+	Real getLevelSample(Size level); // uses antithetic paths
+	Real getCostPerSample(Size level) const;
+	void addSamples(Size level, Size numSamples);
+public:
+	MultilevelMonteCarlo(boost::shared_ptr<GridPathPricer>                 pricer,
+		                 boost::shared_ptr<GeneralizedBlackScholesProcess> process,
+						 Time                                              maturity,
+						 Size                                              numDailySteps,
+						 Size                                              numLevels,
+						 const std::string&                                contractID); // for the random streams
+
+	// Returns the MLMC estimate of the value. Stops after maxIterations rounds of adding samples, even if
+	// the estimated variances still ask for more.
+	Real calculate(Real targetRMSE, Size initialSamplesPerLevel, Size maxIterations);
+	Real errorEstimate() const;
+
+	// The wall clock time plain MC on the daily grid would take to reach the same RMSE: the variance of the
+	// daily values on the last level over the squared error estimate, times their measured time per sample.
+	Real getDailyMCSecondsAtSameRMSE() const;
+	Real getSeconds() const;
+};
+
+// Reads mlmc_num_levels, mlmc_target_rmse, mlmc_initial_samples and mlmc_max_iterations from the config and
+// returns the MLMC value.
+// The target RMSE in the config is per unit notional, so it is multiplied by the notional.
+Real getMultilevelMCValue(boost::shared_ptr<GridPathPricer>                 pricer,
+						  boost::shared_ptr<GeneralizedBlackScholesProcess> process,
+						  Time                                              maturity,
+						  Size                                              numDailySteps,
+						  Real                                              notional,
+						  const std::string&                                contractID);
+
+// For the exposure profile, the pricer splits the value of a (daily) path into its cashflows.
+// The value on an exposure date is then the regression of the cashflows settling after that date
+// on the regressors at that date, see ExposureCollector.
+class ExposurePathPricer
+{
+public:
+	virtual ~ExposurePathPricer() {}
+
+	// The present values (at the eval date) of the path's cashflows, one for each settlement date.
+	virtual void              getCashflowPVs(const Path& path, std::vector<Real>& cashflowPVs) const = 0; // output
+	virtual std::vector<Date> getSettlementDates() const = 0;
+
+	// The path index of the last observation on or before the date.
+	virtual Size              getPathIndexOfDate(const Date& date) const = 0;
+
+	// The regressors for the conditional value at the path index, the default is {1, x, x^2}
+	// with x the spot divided by today's spot.
+	virtual void              getRegressors(const Path& path, Size pathIndex,  // inputs 
+		                                    std::vector<Real>& regressors) const; // output
+
+	// The value, discounted to today, of the cashflows settling after the date, conditional on the path up to
+	// the path index. Only for the pricers that can find it exactly (e.g. the range accrual), it is used with
+	// exposure_method 'exact' to check the regression. The default throws.
+	virtual Real              getConditionalValue(const Path& path, Size pathIndex, const Date& date) const;
+};
+
+// Returns true when exposure_mode is 'on' in the config (default 'off'), throws when it isn't recognised.
+bool isExposureModeOn();
+
+// The exposure profile is regressed on the pricing MC paths, which must be daily and unweighted.
+// The collector wraps the pricing path pricer and, for each path priced, keeps the regressors at the 
+// exposure dates and the PVs of the cashflows settling after them. The exposure dates are every 
+// exposure_step_months months from the eval date until the last settlement date.
+// With exposure_method 'exact' (default 'regression') the path's value on an exposure date is the pricer's 
+// getConditionalValue(..) instead of the regression, i.e. a nested MC with infinitely many inner paths.
+class ExposureCollector : public PathPricer<Path>
+{
+private:
+	boost::shared_ptr<PathPricer<Path> >            m_pathPricer;
+	boost::shared_ptr<ExposurePathPricer>           m_exposurePricer;
+	Size                                            m_numDailySteps;
+	std::vector<Date>                               m_settlementDates;
+	std::vector<Date>                               m_exposureDates;
+	std::vector<Size>                               m_pathIndices;       // of the exposure dates
+	mutable std::vector<Real>                       m_cashflowPVs;       // work space
+	mutable std::vector<std::vector<std::vector<Real> > > m_regressors;  // [exposure date][path]
+	mutable std::vector<std::vector<Real> >         m_futurePVs;         // [exposure date][path]
+	bool                                            m_useExactValues;    // exposure_method 'exact'
+	mutable std::vector<std::vector<Real> >         m_exactValues;       // [exposure date][path]
+
+	ExposureCollector() { QL_FAIL("ExposureCollector(): Please don't use this constructor"); }
+public:
+	ExposureCollector(const boost::shared_ptr<PathPricer<Path> >&  pathPricer,     // used for the pricing
+		              const boost::shared_ptr<ExposurePathPricer>& exposurePricer,
+					  Date                                         evalDate,
+					  Size                                         numDailySteps);
+
+	// returns the value from the pricing path pricer, keeping the path's exposure data.
+	Real operator()(const Path& path) const;
+
+	// Adds the expected_exposure and potential_future_exposure results for each exposure date, from the 
+	// paths priced so far. The results are the path values times the notional, with the attributes 
+	// copied from resultTemplate.
+	void addExposureResults(const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
+		                    Real                                                     notional,
+						    const std::string&                                       contractID,
+						    const Result&                                            resultTemplate,
+						    ResultSet*                                               resultSet) const; // output
+};
+
+#endif
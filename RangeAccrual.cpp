@@ -1,5 +1,6 @@
 #include "RangeAccrual.hpp"
 #include "MarketData.hpp"
+#include "MonteCarlo.hpp"
 
 RangeAccrualContract::RangeAccrualContract(const boost::property_tree::ptree &parentTree)
     : Contract( range_accrual, pt_get<std::string>(parentTree, "contract_id"))
@@ -7,8 +8,26 @@ RangeAccrualContract::RangeAccrualContract(const boost::property_tree::ptree &pa
 	boost::property_tree::ptree pTree = parentTree.get_child("range_accrual");
     
 	m_underlyingType     = pt_get<std::string> (pTree, "underlying_type");
-	m_accCcy             = pt_get<std::string> (pTree, "accounting_ccy"); // i.e. payout currency
-	m_undlCcy            = pt_get<std::string> (pTree, "underlying_ccy"); 
+
+	// The payout currency can be tagged either 'accounting_ccy' or 'payout_ccy'.
+	m_accCcy             = pt_get_optional<std::string>(pTree, "accounting_ccy", "");
+	if(m_accCcy.length() == 0)
+		m_accCcy         = pt_get<std::string> (pTree, "payout_ccy");
+
+	if( !strcmp(m_underlyingType.c_str(), "fx"))
+	{   // The underlying currency can be tagged either 'underlying_ccy' or 'underlying_id'.
+		m_undlCcy        = pt_get_optional<std::string>(pTree, "underlying_ccy", "");
+		if(m_undlCcy.length() == 0)
+			m_undlCcy    = pt_get<std::string> (pTree, "underlying_id");
+	}
+	else if( !strcmp(m_underlyingType.c_str(), "equity"))
+	{
+		m_underlyingID     = pt_get<std::string>         (pTree, "underlying_id");
+		m_underlyingIDType = pt_get_optional<std::string>(pTree, "underlying_id_type", "");
+	}
+	else
+		QL_FAIL("RangeAccrualContract: For trade: " << getID() 
+		        << "\nunderlying_type must be 'fx' or 'equity', here it is: " << m_underlyingType);
     m_firstAccrualDate   = pt_getDate          (pTree, "start_date");
 	m_maturity           = pt_getDate          (pTree, "maturity_date");
 	m_monthsPerPeriod    = pt_get<Size>        (pTree, "months_per_period");
@@ -25,7 +44,9 @@ RangeAccrualContract::RangeAccrualContract(const boost::property_tree::ptree &pa
                               m_holCalIDs);                        // outputs
 }
 
-class RangeAccrualMCEngine : public PathPricer<Path>
+class RangeAccrualAnalyticEngine;
+
+class RangeAccrualMCEngine : public GridPathPricer, public ExposurePathPricer
 {
 public:
 	RangeAccrualContract*        m_RA_terms; // the range accrual contract (terms and conditions)
@@ -47,12 +68,20 @@ public:
 	Size                         m_pathLength;
 	Real                         m_currentSpot;
 	boost::shared_ptr<Prices>    m_spotPrices; // includes historics
+	boost::shared_ptr<StockData> m_stockData;  // only used when the underlying is an equity
 
 	// We do some pre-calculation so that it doesn't have to be repeated for each path. 
 	// The variables is the coupon rate times the day count fraction times the discount factor 
 	// divided by the number of observations in the period.
     std::vector<Real>            m_CPNxDCFxDFoverNumObs;  // length m_numPeriods
     Real                         m_PVOfRedemption;
+
+	// used by valueOnGrid(..), for the Brownian bridge between grid points
+	Real                         m_varianceOfOneDay;
+	CumulativeNormalDistribution m_cumNormal;
+
+	// used by getConditionalValue(..), with exposure_method 'exact'
+	boost::shared_ptr<RangeAccrualAnalyticEngine> m_conditionalEngine;
     ////////////////////////////////////////////////////////////////////////////////////////////////
 	// we now have some private members that are used in initialization, called by the constructor
 private:
@@ -73,7 +102,24 @@ public:
     // returns the present value for given path.
 	Real operator()(const Path& path) const;
 
+	// returns the present value for a path that only has values on the grid, 
+	// the observations between the grid points use the Brownian bridge.
+	Real valueOnGrid(const Path& path, const std::vector<Size>& gridPathIndices) const;
+	void setVarianceOfOneDay(Real varianceOfOneDay);
+
+	// For the exposure profile, see ExposurePathPricer
+	void              getCashflowPVs(const Path& path, std::vector<Real>& cashflowPVs) const;
+	std::vector<Date> getSettlementDates() const;
+	Size              getPathIndexOfDate(const Date& date) const;
+	void              getRegressors(const Path& path, Size pathIndex, std::vector<Real>& regressors) const;
+	Real              getConditionalValue(const Path& path, Size pathIndex, const Date& date) const;
+	void              setConditionalEngine(const boost::shared_ptr<RangeAccrualAnalyticEngine>& conditionalEngine);
+
 	Size getNumMCTimeSteps();
+
+	// The BSM process for the underlying, i.e. the fx rate or the stock price.
+	boost::shared_ptr<GeneralizedBlackScholesProcess> getProcess(); 
+	std::string getUnderlyingDescription() const; // used in the results
 };
 
 Size RangeAccrualMCEngine::getNumMCTimeSteps()
@@ -134,8 +180,9 @@ void RangeAccrualMCEngine::setPeriodIndex()
 RangeAccrualMCEngine::RangeAccrualMCEngine(RangeAccrualContract*  ra_terms,
 										   MarketCaches*          marketCaches)
 {
-	m_RA_terms     = ra_terms;
-	m_marketCaches = marketCaches;
+	m_RA_terms         = ra_terms;
+	m_marketCaches     = marketCaches;
+	m_varianceOfOneDay = 0.0;
 	setCurrentSpotAndCurrencies();
 	m_obsHolCal = getHolCal(m_RA_terms->m_holCalIDs,            m_marketCaches, 
 		                    m_RA_terms->m_firstAccrualDate, 
@@ -232,6 +279,106 @@ Real RangeAccrualMCEngine::operator ()(const Path& path) const
 	return pv;
 }
 
+void RangeAccrualMCEngine::getCashflowPVs(const Path& path, std::vector<Real>& cashflowPVs) const
+{   // one coupon for each period, with the redemption paid with the last coupon.
+	std::vector<Size> numDaysInRange(m_numPeriods, 0);
+    numDaysInRange[m_currentPeriod] = m_obsAlreadyInRangeThisPeriod;
+	for(Size pathIndex = 0; pathIndex < path.length(); pathIndex++)
+		numDaysInRange[m_periodIndex[pathIndex] ] += (path[pathIndex] >= m_barriers[m_periodIndex[pathIndex] ] ? 1 : 0);
+
+	cashflowPVs.assign(m_numPeriods, 0.0);
+	for(Size period = m_currentPeriod; period < m_numPeriods; period++)
+		cashflowPVs[period] = (Real) numDaysInRange[period] * m_CPNxDCFxDFoverNumObs[period];
+
+	cashflowPVs[m_numPeriods - 1] += m_PVOfRedemption;
+}
+
+std::vector<Date> RangeAccrualMCEngine::getSettlementDates() const
+{
+	return m_periodSettleDates;
+}
+
+Size RangeAccrualMCEngine::getPathIndexOfDate(const Date& date) const
+{
+	if(date <= m_marketCaches->getEvalDate())
+		return 0;
+
+	return m_obsHolCal->businessDaysBetween(m_marketCaches->getEvalDate(), 
+		                                    std::min(date, m_periodEndDates[m_numPeriods-1]), false, true);
+}
+
+// The coupon of the period depends on the days already in range, not only on the spot, so the regressors
+// are {1, x, x^2, f, f x}, with x the spot divided by today's spot and f the fraction of the period's
+// observations that have been in range up to the path index (including those before the eval date).
+void RangeAccrualMCEngine::getRegressors(const Path& path, Size pathIndex, std::vector<Real>& regressors) const
+{
+	Size period = m_periodIndex[pathIndex];
+	Real numDaysInRange = (period == m_currentPeriod ? (Real) m_obsAlreadyInRangeThisPeriod : 0.0);
+	for(Size i = 0; i <= pathIndex; i++)
+		if(m_periodIndex[i] == period)
+			numDaysInRange += (path.value(i) >= m_barriers[period] ? 1.0 : 0.0);
+
+	Real x = path.value(pathIndex) / path.value(0);
+	Real f = numDaysInRange / m_numObsDates[period];
+	regressors.resize(5);
+	regressors[0] = 1.0;
+	regressors[1] = x;
+	regressors[2] = x * x;
+	regressors[3] = f;
+	regressors[4] = f * x;
+}
+
+void RangeAccrualMCEngine::setConditionalEngine(const boost::shared_ptr<RangeAccrualAnalyticEngine>& conditionalEngine)
+{
+	m_conditionalEngine = conditionalEngine;
+}
+
+void RangeAccrualMCEngine::setVarianceOfOneDay(Real varianceOfOneDay)
+{
+	m_varianceOfOneDay = varianceOfOneDay;
+}
+
+// On the grid points we know the spot. For the observations in between, the probability of being 
+// in range uses the Brownian bridge mean and variance of the log spot, conditional on the grid values.
+Real RangeAccrualMCEngine::valueOnGrid(const Path& path, const std::vector<Size>& gridPathIndices) const
+{
+	std::vector<Real> numDaysInRange(m_numPeriods, 0.0); // expected number of days, so not an integer
+    numDaysInRange[m_currentPeriod] = (Real) m_obsAlreadyInRangeThisPeriod;
+	numDaysInRange[m_periodIndex[0]] += (path.value(0) >= m_barriers[m_periodIndex[0]] ? 1.0 : 0.0);
+
+	for(Size gridIndex = 1; gridIndex < path.length(); gridIndex++)
+	{
+		Size startPathIndex = gridPathIndices[gridIndex - 1];
+		Size endPathIndex   = gridPathIndices[gridIndex];
+		Real numDays        = (Real)(endPathIndex - startPathIndex);
+		Real logStart       = std::log(path.value(gridIndex - 1));
+		Real logEnd         = std::log(path.value(gridIndex));
+
+		for(Size pathIndex = startPathIndex + 1; pathIndex < endPathIndex; pathIndex++)
+		{
+			Real barrier = m_barriers[m_periodIndex[pathIndex]];
+			if(barrier <= 0.0)
+			{
+				numDaysInRange[m_periodIndex[pathIndex]] += 1.0;
+				continue;
+			}
+			Real fraction     = (Real)(pathIndex - startPathIndex) / numDays;
+			Real bridgeMean   = logStart + fraction * (logEnd - logStart);
+			Real bridgeStdDev = std::sqrt(m_varianceOfOneDay * numDays * fraction * (1.0 - fraction));
+
+			numDaysInRange[m_periodIndex[pathIndex]] += m_cumNormal((bridgeMean - std::log(barrier)) / bridgeStdDev);
+		}
+		numDaysInRange[m_periodIndex[endPathIndex]] += 
+			      (path.value(gridIndex) >= m_barriers[m_periodIndex[endPathIndex]] ? 1.0 : 0.0);
+	}
+
+	Real pv = m_PVOfRedemption;
+	for(Size period = m_currentPeriod; period < m_numPeriods; period++)
+		pv += numDaysInRange[period] * m_CPNxDCFxDFoverNumObs[period];
+
+	return pv;
+}
+
 void RangeAccrualMCEngine::setCurrentSpotAndCurrencies()
 {
 	if( !strcmp(m_RA_terms->m_underlyingType.c_str(), "fx"))
@@ -242,11 +389,179 @@ void RangeAccrualMCEngine::setCurrentSpotAndCurrencies()
 			             + m_RA_terms->m_accCcy + "\nhave spot rate of " + toString(m_currentSpot),
 						 high, "RangeAccrualMCEngine::setCurrentSpotAndCurrencies");
 	}
+	else if( !strcmp(m_RA_terms->m_underlyingType.c_str(), "equity"))
+	{
+		m_stockData = m_marketCaches->getStockDataCache()->get(m_RA_terms->m_underlyingID, 
+			                                                   m_RA_terms->m_underlyingIDType);
+
+		QL_REQUIRE(m_stockData->getCurrency() == m_RA_terms->m_accCcy,
+			       "RangeAccrualMCEngine::setCurrentSpotAndCurrencies(): Model only deals with the case when\n"
+				   << "the stock currency (" << m_stockData->getCurrency() 
+				   << ") is the same as the payout currency (" << m_RA_terms->m_accCcy
+				   << ")"); // could extend to deal with quanto.
+
+		m_spotPrices   = m_marketCaches->getStockPricesCache()->get(m_RA_terms->m_underlyingID, 
+			                                                        m_RA_terms->m_underlyingIDType);
+		m_currentSpot  = m_spotPrices->getCurrentPrice();
+		writeDiagnostics("\nWith stock: " + m_RA_terms->m_underlyingID 
+			             + "\nhave spot price of " + toString(m_currentSpot),
+						 high, "RangeAccrualMCEngine::setCurrentSpotAndCurrencies");
+	}
 	else
-		QL_FAIL("RangeAccrualMCEngine::setCurrentSpot(): \ncurrently underlyingType must be 'fx', here it is: "
+		QL_FAIL("RangeAccrualMCEngine::setCurrentSpot(): \nunderlyingType must be 'fx' or 'equity', here it is: "
 	           << m_RA_terms->m_underlyingType );
 }
 
+boost::shared_ptr<GeneralizedBlackScholesProcess> RangeAccrualMCEngine::getProcess()
+{
+    Handle<Quote> underlyingH(boost::shared_ptr<Quote>(new SimpleQuote(m_currentSpot)));
+	Handle<YieldTermStructure> yieldTSAccCcy (m_marketCaches->getYieldTSCache()->
+		                  get( CONST_STR_risk_free_rate, m_RA_terms->m_accCcy));
+
+	if( !strcmp(m_RA_terms->m_underlyingType.c_str(), "fx"))
+	{
+		Handle<YieldTermStructure> yieldTSUndlCcy (m_marketCaches->getYieldTSCache()->
+			                  get( CONST_STR_risk_free_rate, m_RA_terms->m_undlCcy));
+
+		Handle<BlackVolTermStructure> fxVolTS(m_marketCaches->getFXVolCache()
+			                                  ->get(m_RA_terms->m_accCcy, m_RA_terms->m_undlCcy));
+
+		return boost::shared_ptr<GeneralizedBlackScholesProcess>(new BlackScholesMertonProcess
+			(underlyingH, yieldTSUndlCcy, yieldTSAccCcy, fxVolTS));
+	}
+	else // is equity, setCurrentSpotAndCurrencies() has already checked the underlying type.
+	{
+		Handle<YieldTermStructure> dividendYieldTS(boost::shared_ptr<YieldTermStructure>(
+			 new FlatForward(m_marketCaches->getEvalDate(), m_stockData->getDividendYield(), Actual365Fixed())));
+
+		Handle<BlackVolTermStructure> flatVolTS(boost::shared_ptr<BlackVolTermStructure>(
+			 new BlackConstantVol(m_marketCaches->getEvalDate(), *m_obsHolCal, m_stockData->getFlatVol(), 
+			                      Actual365Fixed())));
+
+		return boost::shared_ptr<GeneralizedBlackScholesProcess>(new BlackScholesMertonProcess
+			(underlyingH, dividendYieldTS, yieldTSAccCcy, flatVolTS));
+	}
+}
+
+std::string RangeAccrualMCEngine::getUnderlyingDescription() const
+{
+	if( !strcmp(m_RA_terms->m_underlyingType.c_str(), "fx"))
+		return m_RA_terms->m_accCcy + m_RA_terms->m_undlCcy;
+	else
+		return m_RA_terms->m_underlyingID;
+}
+
+// Under the BSM process a range accrual is a strip of discounted daily cash-or-nothing digitals.
+// The analytic engine sums those digitals over the observation dates, 
+// using the same time grid as the MC, i.e. one step of length dt per observation date,
+// and the period, barrier and coupon tables of the RangeAccrualMCEngine.
+class RangeAccrualAnalyticEngine
+{
+private:
+	const RangeAccrualMCEngine*                          m_MCEngine;
+	boost::shared_ptr<GeneralizedBlackScholesProcess>    m_process;
+	Time                                                 m_dt;
+	CumulativeNormalDistribution                         m_cumNormal;
+
+	RangeAccrualAnalyticEngine() { QL_FAIL("RangeAccrualAnalyticEngine(): Please don't use this constructor"); }
+public:
+	RangeAccrualAnalyticEngine(const RangeAccrualMCEngine*                        pMCEngine, 
+		                       boost::shared_ptr<GeneralizedBlackScholesProcess>  process,
+							   Time                                               dt);
+
+	// the probability that the spot at the given path index is on or above the barrier
+	Real getProbInRange(Size pathIndex, Real barrier) const; 
+	// the same, given the spot at an earlier path index
+	Real getProbInRange(Size fromPathIndex, Real fromSpot, Size pathIndex, Real barrier) const; 
+	Real getPresentValue() const;
+
+	// The value, discounted to today, of the coupons (and redemption) settling after the date, given the path
+	// up to the path index: the days up to it are known, the later ones are digitals on the spot at the path index.
+	Real getConditionalValue(const Path& path, Size pathIndex, const Date& date) const;
+};
+
+RangeAccrualAnalyticEngine::RangeAccrualAnalyticEngine(const RangeAccrualMCEngine*                        pMCEngine, 
+		                                               boost::shared_ptr<GeneralizedBlackScholesProcess>  process,
+													   Time                                               dt)
+{
+	QL_REQUIRE(dt > 0.0, "RangeAccrualAnalyticEngine: time step must be strictly positive, here it is: " << dt);
+	m_MCEngine = pMCEngine;
+	m_process  = process;
+	m_dt       = dt;
+}
+
+Real RangeAccrualAnalyticEngine::getProbInRange(Size pathIndex, Real barrier) const
+{
+	return getProbInRange(0, m_MCEngine->m_currentSpot, pathIndex, barrier);
+}
+
+Real RangeAccrualAnalyticEngine::getProbInRange(Size fromPathIndex, Real fromSpot, Size pathIndex, Real barrier) const
+{
+	Time fromT = m_dt * (Real) fromPathIndex;
+	Time t     = m_dt * (Real) pathIndex;
+	if( t <= fromT)
+		return (fromSpot >= barrier ? 1.0 : 0.0);
+
+	if( barrier <= 0.0)
+		return 1.0;
+
+	Real forward  = fromSpot * (m_process->dividendYield()->discount(t) / m_process->dividendYield()->discount(fromT))
+		                     / (m_process->riskFreeRate()->discount(t)  / m_process->riskFreeRate()->discount(fromT));
+	Real variance = m_process->blackVolatility()->blackVariance(t,     barrier) 
+		            - m_process->blackVolatility()->blackVariance(fromT, barrier);
+	Real stdDev   = std::sqrt(variance);
+
+	return m_cumNormal((std::log(forward / barrier) - 0.5 * variance) / stdDev);
+}
+
+Real RangeAccrualAnalyticEngine::getPresentValue() const
+{
+	const RangeAccrualMCEngine& mc = *m_MCEngine;
+
+	Real pv = mc.m_PVOfRedemption 
+		      + (Real) mc.m_obsAlreadyInRangeThisPeriod * mc.m_CPNxDCFxDFoverNumObs[mc.m_currentPeriod];
+
+	for(Size pathIndex = 0; pathIndex < mc.m_periodIndex.size(); pathIndex++)
+	{
+		Size period = mc.m_periodIndex[pathIndex];
+		pv += getProbInRange(pathIndex, mc.m_barriers[period]) * mc.m_CPNxDCFxDFoverNumObs[period];
+	}
+	return pv;
+}
+
+Real RangeAccrualAnalyticEngine::getConditionalValue(const Path& path, Size pathIndex, const Date& date) const
+{
+	const RangeAccrualMCEngine& mc = *m_MCEngine;
+
+	std::vector<Real> numDaysInRange(mc.m_numPeriods, 0.0); // expected number of days, so not an integer
+	numDaysInRange[mc.m_currentPeriod] = (Real) mc.m_obsAlreadyInRangeThisPeriod;
+	for(Size i = 0; i < mc.m_periodIndex.size(); i++)
+	{
+		Size period = mc.m_periodIndex[i];
+		if(i <= pathIndex)
+			numDaysInRange[period] += (path.value(i) >= mc.m_barriers[period] ? 1.0 : 0.0);
+		else
+			numDaysInRange[period] += getProbInRange(pathIndex, path.value(pathIndex), i, mc.m_barriers[period]);
+	}
+
+	Real value = 0.0;
+	for(Size period = mc.m_currentPeriod; period < mc.m_numPeriods; period++)
+		if(mc.m_periodSettleDates[period] > date)
+			value += numDaysInRange[period] * mc.m_CPNxDCFxDFoverNumObs[period];
+
+	// the redemption is paid with the last coupon
+	if(mc.m_periodSettleDates[mc.m_numPeriods - 1] > date)
+		value += mc.m_PVOfRedemption;
+	return value;
+}
+
+Real RangeAccrualMCEngine::getConditionalValue(const Path& path, Size pathIndex, const Date& date) const
+{
+	QL_REQUIRE(m_conditionalEngine, "RangeAccrualMCEngine::getConditionalValue(..): The conditional engine "
+		       "hasn't been set.");
+	return m_conditionalEngine->getConditionalValue(path, pathIndex, date);
+}
+
 RangeAccrualCalculator::RangeAccrualCalculator(RangeAccrualContract*   pRA_terms, 
 											   MarketCaches*           pMarketCaches,
 		                                       ResultSet*              pResultSet)
@@ -255,55 +570,71 @@ RangeAccrualCalculator::RangeAccrualCalculator(RangeAccrualContract*   pRA_terms
 	boost::shared_ptr<RangeAccrualMCEngine> RA_MCEngine = (boost::shared_ptr<RangeAccrualMCEngine>)
 		  new RangeAccrualMCEngine(pRA_terms, pMarketCaches);
 
-    Handle<Quote> underlyingH(boost::shared_ptr<Quote>(new SimpleQuote(RA_MCEngine->m_currentSpot)));
-	Handle<YieldTermStructure> yieldTSAccCcy (pMarketCaches->getYieldTSCache()->
-		                  get( CONST_STR_risk_free_rate, pRA_terms->m_accCcy));
-	Handle<YieldTermStructure> yieldTSUndlCcy (pMarketCaches->getYieldTSCache()->
-		                  get( CONST_STR_risk_free_rate, pRA_terms->m_undlCcy));
-
 	Date finalAccrualDate = RA_MCEngine->m_periodEndDates[RA_MCEngine->m_numPeriods-1];
 
-	Handle<BlackVolTermStructure> fxVolTS(pMarketCaches->getFXVolCache()
-		                                  ->get(pRA_terms->m_accCcy, pRA_terms->m_undlCcy));
-
-    boost::shared_ptr<StochasticProcess1D> stochasticPro(new BlackScholesMertonProcess
-		(underlyingH, yieldTSUndlCcy, yieldTSAccCcy, fxVolTS));
+    boost::shared_ptr<GeneralizedBlackScholesProcess> stochasticPro = RA_MCEngine->getProcess();
 
     Size nTimeSteps = RA_MCEngine->getNumMCTimeSteps(); 
-	PseudoRandom::rsg_type rsg = PseudoRandom::make_sequence_generator(
-		                           nTimeSteps, 
-				                   getConfig()->getRandomGeneratorSeed());
-
-    bool brownianBridge = false;
     Time years = (finalAccrualDate - pMarketCaches->getEvalDate())/ 365.0;
-    typedef SingleVariate<PseudoRandom>::path_generator_type generator_type;
-
-	boost::shared_ptr<generator_type> myPathGenerator(new
-        generator_type(stochasticPro, years, nTimeSteps, rsg, brownianBridge));
-
-    // a statistics accumulator for the path-dependant Profit&Loss values
-    Statistics statisticsAccumulator;
-    bool antithetic = true;
-    // The Monte Carlo model generates paths using myPathGenerator
-    // each path is priced using myPathPricer
-    // prices will be accumulated into statisticsAccumulator
-    MonteCarloModel<SingleVariate,PseudoRandom> MCSimulation(myPathGenerator, RA_MCEngine,
-                                                             statisticsAccumulator, antithetic );
-    Size numSamples = atoi(getConfig()->get("range_accrual_num_mc_samples").c_str());
-	writeDiagnostics("Number of MC samples being used is: " + toString(numSamples), 
-	                 mid, "RangeAccrualCalculator");
-    MCSimulation.addSamples(numSamples);
-    
-    Real pricePerUnitNotional = MCSimulation.sampleAccumulator().mean();
-	Real errorEstimate = MCSimulation.sampleAccumulator().errorEstimate(); 
-	writeDiagnostics("MC error estimate is " + toString(errorEstimate), mid, "RangeAccrualCalculator");
+
+	// The config can choose between the Monte Carlo engine ('mc'), the multilevel Monte Carlo ('mlmc') 
+	// and the analytic engine ('analytic').
+	// When the range_accrual_engine is not set in the config we use the Monte Carlo.
+	std::string engineType = "mc";
+	getConfig()->find("range_accrual_engine", engineType);
+	QL_REQUIRE((engineType == "mc") || !isExposureModeOn(), "RangeAccrualCalculator: The exposure profile is "
+		       "regressed on the MC paths, so exposure_mode 'on' needs the range_accrual_engine 'mc'.");
+
+	// When exposure_mode is 'on', it keeps the exposure data of the MC paths as they are priced.
+	boost::shared_ptr<ExposureCollector> exposureCollector;
+
+	Real pricePerUnitNotional;
+	if(engineType == "analytic")
+	{
+		RangeAccrualAnalyticEngine analyticEngine(&(*RA_MCEngine), stochasticPro, years / (Real) nTimeSteps);
+		pricePerUnitNotional = analyticEngine.getPresentValue();
+	}
+	else if(engineType == "mlmc")
+	{
+		RA_MCEngine->setVarianceOfOneDay(stochasticPro->blackVolatility()->blackVariance(years, 
+			                                       RA_MCEngine->m_currentSpot) / (Real) nTimeSteps);
+		pricePerUnitNotional = getMultilevelMCValue(RA_MCEngine, stochasticPro, years, nTimeSteps, 1.0, 
+			                                        pRA_terms->getID());
+	}
+	else if(engineType == "mc")
+	{
+		Size numSamples = atoi(getConfig()->get("range_accrual_num_mc_samples").c_str());
+		writeDiagnostics("Number of MC samples being used is: " + toString(numSamples), 
+		                 mid, "RangeAccrualCalculator");
+
+		// The path generator uses drift and diffusion tables precomputed for the time grid,
+		// rather than going through the term structures at each step, see FrozenGBMPathGenerator.
+		boost::shared_ptr<PathPricer<Path> > pathPricer = RA_MCEngine;
+		if(isExposureModeOn())
+		{   // for exposure_method 'exact'
+			RA_MCEngine->setConditionalEngine(boost::shared_ptr<RangeAccrualAnalyticEngine>(
+				new RangeAccrualAnalyticEngine(&(*RA_MCEngine), stochasticPro, years / (Real) nTimeSteps)));
+			exposureCollector.reset(new ExposureCollector(RA_MCEngine, RA_MCEngine, pMarketCaches->getEvalDate(), 
+				                                          nTimeSteps));
+			pathPricer = exposureCollector;
+		}
+		Statistics statistics = getMonteCarloStatistics(stochasticPro, TimeGrid(years, nTimeSteps), pathPricer,
+			                                            numSamples, pRA_terms->getID());
+	    
+		pricePerUnitNotional = statistics.mean();
+		Real errorEstimate   = statistics.errorEstimate(); 
+		writeDiagnostics("MC error estimate is " + toString(errorEstimate), mid, "RangeAccrualCalculator");
+	}
+	else
+		QL_FAIL("RangeAccrualCalculator: Unrecognised range_accrual_engine in the config: " << engineType
+		        << ".\nCould try 'mc', 'mlmc' or 'analytic'.");
     
 	/////////////////////////////////////////////////////////////////////////////
 	// populate results
 	boost::shared_ptr<Result> perUnitValRes = (boost::shared_ptr<Result>) new Result();
 	perUnitValRes->setAttribute        ( contract_category,       "range_accrual",    true);
 	perUnitValRes->setAttribute        ( contract_id,             pRA_terms->getID(), true);
-	perUnitValRes->setAttribute        ( underlying_id,           pRA_terms->m_accCcy + pRA_terms->m_undlCcy, true);
+	perUnitValRes->setAttribute        ( underlying_id,           RA_MCEngine->getUnderlyingDescription(), true);
 	perUnitValRes->setValueAndCategory ( price_per_unit_notional, pricePerUnitNotional);
 	pResultSet->addNewResult           ( perUnitValRes);
 
@@ -311,4 +642,9 @@ RangeAccrualCalculator::RangeAccrualCalculator(RangeAccrualContract*   pRA_terms
 	cashPriceRes->setValueAndCategory  ( cash_price, pricePerUnitNotional * pRA_terms->m_notional);
 	cashPriceRes->setAttribute         ( currency,   pRA_terms->m_accCcy);
 	pResultSet->addNewResult           ( cashPriceRes);
+
+	// When the exposure_mode is 'on' in the config, adds the exposure profile results.
+	if(exposureCollector)
+		exposureCollector->addExposureResults(stochasticPro, pRA_terms->m_notional, pRA_terms->getID(), 
+		                                      *cashPriceRes, pResultSet);
 }
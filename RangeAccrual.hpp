@@ -9,9 +9,11 @@
 class RangeAccrualContract : public Contract
 {
 public:
-	std::string               m_underlyingType;
+	std::string               m_underlyingType; // 'fx' or 'equity'
 	std::string               m_accCcy; // aka payout currency
-	std::string               m_undlCcy;
+	std::string               m_undlCcy;          // only used when the underlying type is 'fx'
+	std::string               m_underlyingID;     // only used when the underlying type is 'equity'
+	std::string               m_underlyingIDType; // only used when the underlying type is 'equity'
 	Date                      m_firstAccrualDate;
 	Date                      m_maturity;
 	Size                      m_monthsPerPeriod;
@@ -12,6 +12,13 @@ std::string toString(ResultCategory e)
 		 case delta_shares:              return "delta_shares";
          case gamma_1:                   return "gamma_1";
 		 case theta:                     return "theta";
+		 case vega_1:                    return "vega_1";
+		 case rho_1:                     return "rho_1";
+		 case dividend_rho_1:            return "dividend_rho_1";
+		 case credit_spread_1:           return "credit_spread_1";
+		 case expected_exposure:         return "expected_exposure";
+		 case potential_future_exposure: return "potential_future_exposure";
+		 case mc_error_estimate:         return "mc_error_estimate";
 
 		 default: QL_FAIL("toString(.): Unrecognised enum: " << e);
 	}
@@ -29,6 +36,13 @@ ResultCategory stringToResultCategory(const std::string& resCatAsStr)
 	else if( resCatAsStr == "case delta_shares"      )  cat = delta_shares;
 	else if( resCatAsStr == "gamma_1"                )  cat = gamma_1;
 	else if( resCatAsStr == "theta"                  )  cat = theta;
+	else if( resCatAsStr == "vega_1"                 )  cat = vega_1;
+	else if( resCatAsStr == "rho_1"                  )  cat = rho_1;
+	else if( resCatAsStr == "dividend_rho_1"         )  cat = dividend_rho_1;
+	else if( resCatAsStr == "credit_spread_1"        )  cat = credit_spread_1;
+	else if( resCatAsStr == "expected_exposure"      )  cat = expected_exposure;
+	else if( resCatAsStr == "potential_future_exposure") cat = potential_future_exposure;
+	else if( resCatAsStr == "mc_error_estimate"      )  cat = mc_error_estimate;
 	else    QL_FAIL("Unrecognized result category string: " << resCatAsStr);
 
 	return cat;
@@ -44,6 +58,8 @@ std::string toString(AttrEnum e)
 		 case currency:               return "currency";
 		 case eval_date:              return "eval_date";
 		 case underlying_id:          return "underlying";
+		 case exposure_date:          return "exposure_date";
+		 case time_steps:             return "time_steps";
 
 		 default: QL_FAIL("toString(.): Unrecognised enum: " << e);
 	}
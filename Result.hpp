@@ -16,8 +16,15 @@ enum ResultCategory
      delta_1                   = 11, // delta_1 = (dV/dS) * S / 100, i.e. the cash value of a 1% move in spot
 	                                 // quoted in the payoff currency ( so may need to multiply by FX )
 	 delta_shares              = 12, // the number of shares required to hedge the position
-	 gamma_1                   = 20,
-	 theta                     = 25
+	 gamma_1                   = 20, // gamma_1 = (d2V/dS2) * S^2 / 10000, i.e. the change in delta_1 for a 1% move in spot
+	 theta                     = 25, // (dV/dt) / 365, the cash value of one calendar day passing
+	 vega_1                    = 30, // (dV/dvol) / 100, the cash value of a 1% (absolute) move in the vol
+	 rho_1                     = 31, // (dV/dr) / 100, the cash value of a 1% move in the payoff currency's rate
+	 dividend_rho_1            = 32, // (dV/dq) / 100, for the dividend yield, or the underlying currency's rate for fx
+	 credit_spread_1           = 33, // (dV/dspread) / 100, the cash value of a 1% move in the issuer's credit spread
+	 expected_exposure         = 40, // the mean of the positive part of the value on the exposure_date
+	 potential_future_exposure = 41, // a high quantile of the positive part of the value on the exposure_date
+	 mc_error_estimate         = 50  // the standard error of the Monte Carlo's price_per_unit_notional
 	 // when you add a new enum here please also add one more in the toString(..) function
 };
 
@@ -30,7 +37,9 @@ enum AttrEnum // these are the attributes that can be associated with each resul
      contract_id        = 2,
 	 currency           = 3,
 	 eval_date          = 4,
-	 underlying_id      = 5
+	 underlying_id      = 5,
+	 exposure_date      = 6,
+	 time_steps         = 7  // the number of tree steps chosen by the adaptive step selection
      
 	 // When you add a new enum here please also add one more 'case' in the toString(..) function.
      // Please do NOT add AttrEnum's 'value' nor 'category'.
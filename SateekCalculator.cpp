@@ -7,6 +7,14 @@ Calculator::Calculator(const std::string& pathToXMLPortfolio, const std::string&
   m_marketCaches(pathToMarketData)
 {}
 
+// The config's eln_batch, 'off' when not set.
+bool useELNBatch()
+{
+	std::string elnBatch = "off";
+	getConfig()->find("eln_batch", elnBatch);
+	return elnBatch == "on";
+}
+
 Size           Calculator::getNumContracts()  { return m_portfolio.size(); }
 MarketCaches*  Calculator::getMarketCaches()  { return &m_marketCaches;    }
 Portfolio*     Calculator::getPortfolio()     { return &m_portfolio;       }
@@ -25,9 +33,14 @@ void Calculator::evaluateSingleContract(Size        contractNum,  // input
 	{   // be set to NULL and that will be checked for in the constructor for CalculatorBase
         // and a (nice) exception will be thrown. There'll be no nasty crash!
 		case equity_linked_note: 
-			EquityLinkedNoteCalculator(dynamic_cast<EquityLinkedNoteContract*>(pContract), 
-				                       &m_marketCaches,  
-				                       pResultSet);  // Results will be inserted into the result set. 
+			if(useELNBatch())  // a batch of one, so that the batch calculator can be tested against the other
+				EquityLinkedNoteBatchCalculator(std::vector<EquityLinkedNoteContract*>(1, dynamic_cast<EquityLinkedNoteContract*>(pContract)), 
+				                                &m_marketCaches,  
+				                                std::vector<ResultSet*>(1, pResultSet));
+			else
+				EquityLinkedNoteCalculator(dynamic_cast<EquityLinkedNoteContract*>(pContract), 
+				                           &m_marketCaches,  
+				                           pResultSet);  // Results will be inserted into the result set. 
 		break;
 			
 		case convertible_bond:
@@ -128,12 +141,97 @@ void Calculator::processResult(ResultSet* resultSet, Size contractNum)
 		                 low, "Calculator::processResults"); 
 }
 
+void Calculator::evaluateEquityLinkedNoteBatch(std::map<Size, ResultSet>& resultSets)  // output
+{
+	std::vector<EquityLinkedNoteContract*> pELNContracts;
+	std::vector<ResultSet*>                pResultSets;
+
+	for( Size i = 0;  i < getNumContracts(); i++)
+	{
+		if(m_portfolio.get(i)->getCategory() == equity_linked_note)
+		{
+			pELNContracts.push_back(dynamic_cast<EquityLinkedNoteContract*>(m_portfolio.get(i)));
+			pResultSets.push_back(&resultSets[i]); // std::map doesn't move its elements
+		}
+	}
+	EquityLinkedNoteBatchCalculator(pELNContracts, &m_marketCaches, pResultSets);
+}
+
+void Calculator::requestPortfolioPrices()
+{
+	for( Size i = 0;  i < getNumContracts(); i++)
+	{
+		Contract* pContract = m_portfolio.get(i);
+		switch (pContract->getCategory())
+		{
+			case equity_linked_note:
+			{
+				EquityLinkedNoteContract* pELN = dynamic_cast<EquityLinkedNoteContract*>(pContract);
+				if(pELN)
+					m_marketCaches.requestStockPrices(pELN->m_underlyingStockID, pELN->m_underlyingStockIDType);
+			}
+			break;
+
+			case convertible_bond:
+			{
+				ConvertibleBondContract* pCB = dynamic_cast<ConvertibleBondContract*>(pContract);
+				if(pCB)
+					m_marketCaches.requestStockPrices(pCB->m_underlyingStockID, pCB->m_stockIDType);
+			}
+			break;
+
+			case koda:
+			{
+				AccumulatorContract* pAccum = dynamic_cast<AccumulatorContract*>(pContract);
+				if(pAccum)
+					m_marketCaches.requestStockPrices(pAccum->m_underlyingID, pAccum->m_underlyingIDType);
+			}
+			break;
+
+			case range_accrual:
+			{
+				RangeAccrualContract* pRA = dynamic_cast<RangeAccrualContract*>(pContract);
+				if(pRA && !strcmp(pRA->m_underlyingType.c_str(), "fx"))
+					m_marketCaches.requestFXPrices(pRA->m_undlCcy, pRA->m_accCcy);
+				else if(pRA)
+					m_marketCaches.requestStockPrices(pRA->m_underlyingID, pRA->m_underlyingIDType);
+			}
+			break;
+
+			case call_spread_cpn_note:
+			{
+				CallSpreadCpnNoteContract* pCSCN = dynamic_cast<CallSpreadCpnNoteContract*>(pContract);
+				if(pCSCN)
+					m_marketCaches.requestFXPrices(pCSCN->m_undlCcy, pCSCN->m_accCcy);
+			}
+			break;
+
+			default: // evaluateSingleContract(..) will report the unknown category
+			break;
+		}
+	}
+}
+
 void Calculator::evaluateAndProcessAll()
 {
 	ResultSet resultSet;
 
+	requestPortfolioPrices(); 
+
+	// With eln_batch 'on' the equity linked notes are priced up front, together, 
+	// their results are processed in the loop below, in the portfolio's order.
+	std::map<Size, ResultSet> elnResultSets;
+	if(useELNBatch())
+		evaluateEquityLinkedNoteBatch(elnResultSets);
+
 	for( Size i = 0;  i < getNumContracts(); i++)
 	{
+		std::map<Size, ResultSet>::iterator elnIter = elnResultSets.find(i);
+		if(elnIter != elnResultSets.end())
+		{
+			processResult(&elnIter->second, i);
+			continue;
+		}
 		resultSet.clear();                     // clear the old results
 		evaluateSingleContract(i, &resultSet); // Do the calculation and populate the resultSet
 		processResult(&resultSet, i);          // write to file and / or send to std::cout 
@@ -150,6 +248,7 @@ std::string getHelpText(const std::string& exeName)
 		   << "   " << exeName << " -h                for help.\n"
 		   << "   " << exeName << " -v                for the version string.\n"
 	       << "   " << exeName << " <path_to_config>  to specify the path to the xml config file.\n"
+	       << "   " << exeName << " <path_to_config> snapshot  to write the market data snapshot.\n"
 		   << "   " << exeName << "                   to use the default config (" 
 		   << CONST_STR_config_xml << ")." << std::endl;
 
@@ -265,6 +364,14 @@ int main(int argc, char *argv[])
 	{
 		if((argc == 3) && (!strcmp(argv[2], "test")))
 			testRig(argc, argv);
+		else if((argc == 3) && (!strcmp(argv[2], "snapshot")))
+		{
+			if( processCommandLineArgs(2, argv)) // instantiates the Config from argv[1]
+			{
+				MarketCaches marketCaches;
+				writeMarketDataSnapshot(&marketCaches);
+			}
+		}
 		else if( processCommandLineArgs(argc, argv))  // This line will also instantiate the Config,   
 		{                                        // which can be retrieved by calling getConfig().
 			boost::timer timer;
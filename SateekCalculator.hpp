@@ -5,6 +5,7 @@
 #include "Result.hpp"
 #include "Portfolio.hpp"
 #include "MarketData.hpp"
+#include "MarketDataSnapshot.hpp"
 #include "EquityLinkedNote.hpp"
 #include "ConvertibleBond.hpp"
 #include "Accumulator.hpp"
@@ -28,6 +29,14 @@ public:
 	void evaluateSingleContract(Size        contractNum,  // input
 		                        ResultSet*  pResultSet);  // output, new Results are added to the ResultSet
 
+	// Prices all the equity linked notes in the portfolio with the EquityLinkedNoteBatchCalculator.
+	// resultSets will have one ResultSet for each, keyed by the contract number.
+	void evaluateEquityLinkedNoteBatch(std::map<Size, ResultSet>& resultSets);  // output
+
+	// Tells the market caches which prices the portfolio will need, so that a streaming 
+	// prices source can find them all with one pass through the prices file.
+	void requestPortfolioPrices();
+
 	void writeResultSetToFile(ResultSet* resultSet, const std::string& name, Size contractNum);
 
 	// Outputing the result-set as requested in the config
@@ -35,6 +44,9 @@ public:
 	void evaluateAndProcessAll();
 };
 
+// The config's eln_batch, 'off' when not set.
+bool useELNBatch();
+
 std::string getHelpText(const std::string& exeName);
 
 void writeToFile(const std::string& filename, const std::string& content);
@@ -13,6 +13,7 @@ private:
 	Size                            m_currentFileNum;
 	std::string                     m_currentTestID;
 	std::string                     m_outputDirectory;
+	std::string                     m_discrepancyReport; // left and right values, for tests with report_discrepancies
 public:
 	Tester(const std::string& pathToTestSpecification);
 	void runAllTests();
@@ -24,10 +25,17 @@ public:
 	Size compareResults(const ResultSet& leftResultSet, const ResultSet& rightResultSet,
 		                const boost::property_tree::ptree& pt); // will throw on failure
 
-	void runOneLegOfTest(const std::string&  pathToConfig, 
-	                 	 const std::string&  pathToMarketData, 
-		                 const std::string&  pathToContract,
-		                 ResultSet*          resultSet);          // output
+	// The leg may have a config_overrides node, whose children over-write the config's keys for that leg only.
+	// It prices the portfolio's contract_number (counting from 1, default 1) with evaluateSingleContract(..),
+	// or with evaluate 'portfolio' as evaluateAndProcessAll() would, i.e. with eln_batch 'on' all the
+	// equity linked notes of the portfolio are priced in one batch.
+	void runOneLegOfTest(const boost::property_tree::ptree& legPTree,
+		                 ResultSet*                         resultSet);          // output
+
+	// Runs the leg on the market data bumped up and down, returns the central difference of the
+	// bump_and_revalue's category, times its scale, e.g. to check a vega against bump-and-revalue.
+	Real bumpAndRevalue(const boost::property_tree::ptree& legPTree,
+		                const boost::property_tree::ptree& bumpPTree);
 };
 
 // A tolerance (tol) of zero is allowed
@@ -110,6 +118,10 @@ Size Tester::compareResults(const ResultSet& leftResultSet, const ResultSet& rig
 					 + "and property tree:\n"                   + toString(pt),
 					 high, "Tester::compareResults");
 
+	// When the test has report_discrepancies 'on', the left and right values of the comparisons between
+	// the two legs are written to the summary file, e.g. to track the bias of a fast engine against MC.
+	bool reportDiscrepancies = (pt_get_optional<std::string>(pt, "report_discrepancies", "off") == "on");
+
 	boost::property_tree::ptree::const_iterator iter = pt.begin();
     while(iter != pt.end())
     {  
@@ -128,10 +140,25 @@ Size Tester::compareResults(const ResultSet& leftResultSet, const ResultSet& rig
 				rightVal = rightResultSet.getValue(category);
 			else if( rightSource == "constant")
 				rightVal = pt_get<Real>(iter->second, "constant");
-			else QL_FAIL("'right_source' must be either 'right_leg' or 'constant'. Here it is: " 
+			else if( rightSource == "bump_and_revalue")
+				rightVal = bumpAndRevalue(pt.get_child("left_leg"), iter->second.get_child("bump_and_revalue"));
+			else QL_FAIL("'right_source' must be either 'right_leg', 'constant' or 'bump_and_revalue'. Here it is: " 
 				         << rightSource);
 
 			std::string msg = m_currentTestID + "\ncategory:   " + categoryStr; // used when exception is thrown
+
+			// We report the discrepancy before doing the comparison, so that it is still reported
+			// when the comparison fails.
+			if(reportDiscrepancies && (rightSource != "constant"))
+			{
+				std::ostringstream stream;
+				stream << "    " << m_currentTestID << ", " << categoryStr << std::setprecision(10)
+					   << ": left: " << leftVal << ", right: " << rightVal 
+					   << ", discrepancy: " << leftVal - rightVal << "\n";
+				m_discrepancyReport += stream.str();
+				writeDiagnostics(stream.str(), mid, "Tester::compareResults");
+			}
+
 			doComparison(leftVal, rightVal, comparison, tol, msg); // throws on failure
 			comparisonsDone++;
 		}
@@ -148,27 +175,87 @@ Size Tester::compareResults(const ResultSet& leftResultSet, const ResultSet& rig
 	return comparisonsDone;
 }
 
-void Tester::runOneLegOfTest(const std::string&  pathToConfig, 
-	                 	     const std::string&  pathToMarketData, 
-		                     const std::string&  pathToContract,
-		                     ResultSet*          resultSet)          // output
+void Tester::runOneLegOfTest(const boost::property_tree::ptree& legPTree,
+		                     ResultSet*                         resultSet)          // output
 {
+	std::string pathToConfig     = pt_get<std::string>(legPTree, "path_to_config");
+	std::string pathToMarketData = pt_get<std::string>(legPTree, "path_to_market_data");
+	std::string pathToContract   = pt_get<std::string>(legPTree, "path_to_contract");
+	boost::optional<const boost::property_tree::ptree&> configOverrides = legPTree.get_child_optional("config_overrides");
+
 	writeDiagnostics("test id: " + m_currentTestID 
 		             + "\npath to config: "     + pathToConfig
            		     + "\npath to marketData: " + pathToMarketData
 		             + "\npath to contract: "   + pathToContract,
 					 high, "Tester::runOneLegOfTest");
 
-	if(pathToConfig != m_pathToConfig) // we have a new config
+	if((pathToConfig != m_pathToConfig) || configOverrides) // we have a new config
 	{
-		m_pathToConfig = pathToConfig;
-		boost::shared_ptr<Config> config = (boost::shared_ptr<Config>) new Config(m_pathToConfig);
+		boost::shared_ptr<Config> config = (boost::shared_ptr<Config>) new Config(pathToConfig);
+		if(configOverrides)
+		{
+			BOOST_FOREACH(const boost::property_tree::ptree::value_type& v, *configOverrides)
+			{
+				if(v.first.data() != CONST_STR_xmlcomment)
+				{
+					config->set(v.first.data(), v.second.data());
+					writeDiagnostics("Config override: " + v.first + " = " + v.second.data(), 
+						             high, "Tester::runOneLegOfTest");
+				}
+			}
+		}
+		// A config with overrides isn't kept, so that the next leg will read its config again.
+		m_pathToConfig = (configOverrides ? std::string() : pathToConfig);
 		setGetConfig(config);
 	}
 	// else use existing config
 
 	Calculator calculator(pathToContract, pathToMarketData);
-	calculator.evaluateSingleContract(0, resultSet);	
+	Size        contractNumber = pt_get_optional<Size>       (legPTree, "contract_number", 1);
+	std::string evaluate       = pt_get_optional<std::string>(legPTree, "evaluate", "single_contract");
+	QL_REQUIRE((contractNumber >= 1) && (contractNumber <= calculator.getNumContracts()),
+		       "Tester::runOneLegOfTest(..): contract_number must be from 1 to " << calculator.getNumContracts()
+			   << ", here it is: " << contractNumber);
+	QL_REQUIRE((evaluate == "single_contract") || (evaluate == "portfolio"),
+		       "Tester::runOneLegOfTest(..): Unrecognised evaluate: " << evaluate 
+			   << ".\nCould try 'single_contract' or 'portfolio'.");
+	Size contractNum = contractNumber - 1;
+
+	if((evaluate == "portfolio") && useELNBatch() 
+		&& (calculator.getPortfolio()->get(contractNum)->getCategory() == equity_linked_note))
+	{
+		std::map<Size, ResultSet> elnResultSets;
+		calculator.evaluateEquityLinkedNoteBatch(elnResultSets);
+		ResultSet& elnResultSet = elnResultSets[contractNum];
+		for(Size i = 0; i < elnResultSet.getCount(); i++)
+			resultSet->addNewResult(elnResultSet.getResult(i));
+	}
+	else
+		calculator.evaluateSingleContract(contractNum, resultSet);	
+}
+
+Real Tester::bumpAndRevalue(const boost::property_tree::ptree& legPTree,
+		                    const boost::property_tree::ptree& bumpPTree)
+{
+	std::string categoryStr = pt_get<std::string>(bumpPTree, "category");
+	ResultCategory category = stringToResultCategory(categoryStr);
+	Real bumpSize           = pt_get<Real>(bumpPTree, "bump_size");
+	Real scale              = pt_get_optional<Real>(bumpPTree, "scale", 1.0);
+	QL_REQUIRE(bumpSize > 0, "Tester::bumpAndRevalue(..): the bump_size must be positive, here it is: " << bumpSize);
+
+	boost::property_tree::ptree bumpedLegPTree(legPTree);
+	ResultSet upResultSet, downResultSet;
+	bumpedLegPTree.put("path_to_market_data", pt_get<std::string>(bumpPTree, "path_to_market_data_up"));
+	runOneLegOfTest(bumpedLegPTree, &upResultSet);
+	bumpedLegPTree.put("path_to_market_data", pt_get<std::string>(bumpPTree, "path_to_market_data_down"));
+	runOneLegOfTest(bumpedLegPTree, &downResultSet);
+
+	Real upVal   = upResultSet.getValue(category);
+	Real downVal = downResultSet.getValue(category);
+	writeDiagnostics("For test: " + m_currentTestID + ", " + categoryStr + " bumped up: " + toString(upVal)
+		             + ", bumped down: " + toString(downVal), high, "Tester::bumpAndRevalue");
+
+	return scale * (upVal - downVal) / (2.0 * bumpSize);
 }
 
 // returns the number of comparisons completed, throws on failure.
@@ -178,24 +265,16 @@ Size Tester::runTwoLeggedTest(const boost::property_tree::ptree& testPTree)
 	writeDiagnostics("About to start test ID: " + m_currentTestID, mid, "Tester::runTwoLeggedTest");
 
 	ResultSet leftResultSet, rightResultSet;
-	std::string leftConfig     = pt_get<std::string>(testPTree, "left_leg.path_to_config");
-	std::string leftMarketData = pt_get<std::string>(testPTree, "left_leg.path_to_market_data");
-	std::string leftContract   = pt_get<std::string>(testPTree, "left_leg.path_to_contract");
-
-	runOneLegOfTest(leftConfig, leftMarketData, leftContract, // inputs
-		             &leftResultSet);                          // output
+	runOneLegOfTest(testPTree.get_child("left_leg"), // input
+		            &leftResultSet);                 // output
 
 	std::string rightConfig = pt_get_optional<std::string>(testPTree, "right_leg.path_to_config", "");
-	std::string rightMarketData, rightContract;
 
 	bool hasRightLeg;
 	if(hasRightLeg = (rightConfig.length() > 0))
 	{
-		rightMarketData = pt_get<std::string>(testPTree, "right_leg.path_to_market_data");
-		rightContract   = pt_get<std::string>(testPTree, "right_leg.path_to_contract");
-
-	    runOneLegOfTest(rightConfig, rightMarketData, rightContract, // inputs
-		                 &rightResultSet);                           // output
+	    runOneLegOfTest(testPTree.get_child("right_leg"), // input
+		                &rightResultSet);                 // output
 	}
 	else 
 		writeDiagnostics("For test ID: " + m_currentTestID + " found no right leg.", 
@@ -257,7 +336,9 @@ void Tester::runAllTests()
 	    }    
 	}
 	std::string outputPath = m_outputDirectory + "/" + getResultFilename();
-	writeToFile(outputPath, "Successfully completed all " + toString(numberOfTests) + " tests:\n" + testSummary);
+	writeToFile(outputPath, "Successfully completed all " + toString(numberOfTests) + " tests:\n" + testSummary
+		                    + (m_discrepancyReport.length() ? "\nDiscrepancies (left minus right):\n" + m_discrepancyReport
+							                                : std::string()));
 	writeDiagnostics("Wrote test summary to file: " + outputPath, mid, "Tester::runAllTests"); 
 	writeDiagnostics("Successfully completed all " + toString(numberOfTests) + " test.", low, "Tester::runAllTests"); 
 	writeDiagnostics("Had a total of " + toString(numberOfComparisons) + " comparisons.", mid, "Tester::runAllTests");
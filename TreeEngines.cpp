@@ -0,0 +1,193 @@
+#include "TreeEngines.hpp"
+
+std::string toString(TreeType e)
+{
+	switch(e)
+	{
+	case jarrow_rudd:         return "jarrow_rudd";
+	case cox_ross_rubinstein: return "cox_ross_rubinstein";
+	case additive_eqp:        return "additive_eqp";
+	case trigeorgis:          return "trigeorgis";
+	case tian:                return "tian";
+	case leisen_reimer:       return "leisen_reimer";
+	case joshi4:              return "joshi4";
+	default:
+		QL_FAIL("toString(TreeType): unknown tree type " << (Integer) e);
+	}
+}
+
+TreeType stringToTreeType(const std::string& str)
+{
+	     if(str == "jarrow_rudd"        ) return jarrow_rudd;
+	else if(str == "cox_ross_rubinstein") return cox_ross_rubinstein;
+	else if(str == "additive_eqp"       ) return additive_eqp;
+	else if(str == "trigeorgis"         ) return trigeorgis;
+	else if(str == "tian"               ) return tian;
+	else if(str == "leisen_reimer"      ) return leisen_reimer;
+	else if(str == "joshi4"             ) return joshi4;
+	else   
+	{
+		QL_FAIL("stringToTreeType(..): Unrecognised tree type " << str 
+			    << ".\nCould try 'jarrow_rudd', 'cox_ross_rubinstein', 'additive_eqp', 'trigeorgis',"
+				<< " 'tian', 'leisen_reimer' or 'joshi4'.");
+	}
+}
+
+TreeType getConfigTreeType(const std::string& configKey)
+{
+	std::string treeTypeAsStr = "jarrow_rudd";
+	getConfig()->find(configKey, treeTypeAsStr);
+	return stringToTreeType(treeTypeAsStr);
+}
+
+Size getTreeTimeSteps(TreeType treeType, Size requestedSteps)
+{
+	if(treeType == leisen_reimer || treeType == joshi4)
+		return (requestedSteps % 2 ? requestedSteps : requestedSteps + 1);
+	return requestedSteps;
+}
+
+Size getTreeConvergenceOrder(TreeType treeType)
+{
+	return (treeType == leisen_reimer || treeType == joshi4) ? 2 : 1;
+}
+
+Real richardsonExtrapolate(Real valueN1, Size N1, Real valueN2, Size N2, Size order)
+{
+	QL_REQUIRE(N1 != N2, "richardsonExtrapolate(..): need two different numbers of steps, have " << N1);
+	Real weight1 = std::pow((Real) N1, (Real) order);
+	Real weight2 = std::pow((Real) N2, (Real) order);
+	return (weight2 * valueN2 - weight1 * valueN1) / (weight2 - weight1);
+}
+
+namespace
+{
+	// Null<Real>() unless both values are set
+	Real extrapolateIfSet(Real valueN1, Size N1, Real valueN2, Size N2, Size order)
+	{
+		if(valueN1 == Null<Real>() || valueN2 == Null<Real>())
+			return Null<Real>();
+		return richardsonExtrapolate(valueN1, N1, valueN2, N2, order);
+	}
+}
+
+TreeValuation richardsonExtrapolate(const TreeValuation& valuationN1, Size N1, 
+									const TreeValuation& valuationN2, Size N2, Size order)
+{
+	TreeValuation extrapolated(richardsonExtrapolate(valuationN1.value, N1, valuationN2.value, N2, order));
+	extrapolated.delta           = extrapolateIfSet(valuationN1.delta,           N1, valuationN2.delta,           N2, order);
+	extrapolated.gamma           = extrapolateIfSet(valuationN1.gamma,           N1, valuationN2.gamma,           N2, order);
+	extrapolated.vega            = extrapolateIfSet(valuationN1.vega,            N1, valuationN2.vega,            N2, order);
+	extrapolated.rho             = extrapolateIfSet(valuationN1.rho,             N1, valuationN2.rho,             N2, order);
+	extrapolated.dividendRho     = extrapolateIfSet(valuationN1.dividendRho,     N1, valuationN2.dividendRho,     N2, order);
+	extrapolated.creditSpreadRho = extrapolateIfSet(valuationN1.creditSpreadRho, N1, valuationN2.creditSpreadRho, N2, order);
+	return extrapolated;
+}
+
+TreeValuation getValuationFromNodes(const Array& nodeSpots, const Array& nodeValues, Real spot)
+{
+	QL_REQUIRE(nodeSpots.size() == 3 && nodeValues.size() == 3,
+		       "getValuationFromNodes(...): need three nodes, have " << nodeSpots.size() 
+			   << " spots and " << nodeValues.size() << " values.");
+
+	// Newton's divided differences, V(S) = V0 + d01 (S - S0) + d012 (S - S0)(S - S1)
+	Real s0 = nodeSpots[0], s1 = nodeSpots[1], s2 = nodeSpots[2];
+	QL_REQUIRE(s0 < s1 && s1 < s2, "getValuationFromNodes(...): the node spots must be increasing: " 
+		       << s0 << ", " << s1 << ", " << s2);
+
+	Real d01  = (nodeValues[1] - nodeValues[0]) / (s1 - s0);
+	Real d12  = (nodeValues[2] - nodeValues[1]) / (s2 - s1);
+	Real d012 = (d12 - d01) / (s2 - s0);
+
+	return TreeValuation(nodeValues[0] + d01 * (spot - s0) + d012 * (spot - s0) * (spot - s1),
+		                 d01 + d012 * (2.0 * spot - s0 - s1),
+						 2.0 * d012);
+}
+
+Real getValueTangentFromNodes(const Array& nodeSpots,    const Array& nodeValues, 
+							  const Array& spotTangents, const Array& valueTangents, Real spot)
+{   // differentiating the divided differences in getValuationFromNodes(..)
+	QL_REQUIRE(nodeSpots.size() == 3 && nodeValues.size() == 3 && spotTangents.size() == 3 && valueTangents.size() == 3,
+		       "getValueTangentFromNodes(...): need three nodes.");
+
+	Real s0 = nodeSpots[0], s1 = nodeSpots[1], s2 = nodeSpots[2];
+	Real ds0 = spotTangents[0], ds1 = spotTangents[1], ds2 = spotTangents[2];
+
+	Real d01   = (nodeValues[1] - nodeValues[0]) / (s1 - s0);
+	Real d12   = (nodeValues[2] - nodeValues[1]) / (s2 - s1);
+	Real d012  = (d12 - d01) / (s2 - s0);
+
+	Real dd01  = ((valueTangents[1] - valueTangents[0]) - d01 * (ds1 - ds0)) / (s1 - s0);
+	Real dd12  = ((valueTangents[2] - valueTangents[1]) - d12 * (ds2 - ds1)) / (s2 - s1);
+	Real dd012 = ((dd12 - dd01) - d012 * (ds2 - ds0)) / (s2 - s0);
+
+	return valueTangents[0] + dd01 * (spot - s0) - d01 * ds0 
+		   + dd012 * (spot - s0) * (spot - s1) - d012 * (ds0 * (spot - s1) + (spot - s0) * ds1);
+}
+
+boost::shared_ptr<GeneralizedBlackScholesProcess> makeFlatBlackScholesProcess(Real       spot, 
+																			  Rate       riskFreeRate, 
+																			  Rate       dividendRate,
+																			  Volatility vol,
+																			  const Date& referenceDate)
+{
+	DayCounter dayCounter = Actual365Fixed();
+	Handle<Quote> spotH(boost::shared_ptr<Quote>(new SimpleQuote(spot)));
+	Handle<YieldTermStructure> riskFreeTS(boost::shared_ptr<YieldTermStructure>(
+		                                  new FlatForward(referenceDate, riskFreeRate, dayCounter)));
+	Handle<YieldTermStructure> dividendTS(boost::shared_ptr<YieldTermStructure>(
+		                                  new FlatForward(referenceDate, dividendRate, dayCounter)));
+	Handle<BlackVolTermStructure> volTS(boost::shared_ptr<BlackVolTermStructure>(
+		                                new BlackConstantVol(referenceDate, TARGET(), vol, dayCounter)));
+
+	return boost::shared_ptr<GeneralizedBlackScholesProcess>(
+		       new GeneralizedBlackScholesProcess(spotH, dividendTS, riskFreeTS, volTS));
+}
+
+AdaptiveTreeSettings getConfigAdaptiveTreeSettings()
+{
+	std::string minSteps = "25", maxSteps = "3200", tolerance = "0.0001";
+	getConfig()->find("tree_adaptive_min_steps", minSteps);
+	getConfig()->find("tree_adaptive_max_steps", maxSteps);
+	getConfig()->find("tree_adaptive_tolerance", tolerance);
+
+	AdaptiveTreeSettings settings;
+	settings.minSteps  = atoi(minSteps.c_str());
+	settings.maxSteps  = atoi(maxSteps.c_str());
+	settings.tolerance = atof(tolerance.c_str());
+	return settings;
+}
+
+Size getRollbackParallelThreshold()
+{
+	std::string parallelThreshold = "500";
+	getConfig()->find("tree_rollback_parallel_threshold", parallelThreshold);
+	return atoi(parallelThreshold.c_str());
+}
+
+// The loops use a signed index, as OpenMP 2.0 (Visual Studio) requires. 
+// Without OpenMP the pragmas are ignored and the loops run serially.
+void stepBackLevel(const Real* values, Real* newValues, Size size, 
+				   Real pd, Real pu, DiscountFactor discount, Size parallelThreshold)
+{
+	Integer n = (Integer) size;
+	#pragma omp parallel for if(size >= parallelThreshold)
+	for(Integer j = 0; j < n; j++)
+		newValues[j] = (pd * values[j] + pu * values[j+1]) * discount;
+}
+
+void stepBackConvertibleLevel(const Real* values,    const Real* conversionProbability,    const Real* spreadAdjustedRate,
+							  Real*       newValues, Real*       newConversionProbability, Real*       newSpreadAdjustedRate,
+							  Size size, Real pd, Real pu, Time dt, Rate riskFreeRate, Spread creditSpread, 
+							  Size parallelThreshold)
+{
+	Integer n = (Integer) size;
+	#pragma omp parallel for if(size >= parallelThreshold)
+	for(Integer j = 0; j < n; j++)
+	{
+		newConversionProbability[j] = pd * conversionProbability[j] + pu * conversionProbability[j+1];
+		newSpreadAdjustedRate[j]    = riskFreeRate + (1.0 - newConversionProbability[j]) * creditSpread;
+		newValues[j]                = pd * values[j]   / (1.0 + spreadAdjustedRate[j]   * dt)
+			                        + pu * values[j+1] / (1.0 + spreadAdjustedRate[j+1] * dt);
+	}
+}
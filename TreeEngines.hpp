@@ -0,0 +1,250 @@
+#ifndef treeengines_hpp
+#define treeengines_hpp
+
+#include "Utilities.hpp"
+
+// The binomial trees from QuantLib that the tree priced products can use,
+// chosen in the config with e.g. convertible_bond_tree_type.
+enum TreeType
+{
+	jarrow_rudd,
+	cox_ross_rubinstein,
+	additive_eqp,
+	trigeorgis,
+	tian,
+	leisen_reimer,
+	joshi4
+};
+
+std::string toString(TreeType e);
+TreeType    stringToTreeType(const std::string& treeTypeAsStr);
+
+// Reads the tree type from the config, jarrow_rudd when the key is not set.
+TreeType    getConfigTreeType(const std::string& configKey);
+
+// Leisen-Reimer and Joshi trees need an odd number of steps, QuantLib adds one to an even number.
+// We do the same up front, so that the tree and the lattice's time grid agree.
+Size        getTreeTimeSteps(TreeType treeType, Size requestedSteps);
+
+// The order p of the leading error term, c / N^p, of a tree with N steps.
+Size        getTreeConvergenceOrder(TreeType treeType);
+
+// Two point Richardson extrapolation, removing the c / N^p error term from values with N1 and N2 steps.
+// The first order trees oscillate around their limit, so the extrapolation helps them less than 
+// the smooth, second order, Leisen-Reimer and Joshi trees.
+Real        richardsonExtrapolate(Real valueN1, Size N1, Real valueN2, Size N2, Size order);
+
+// The value from a tree, with the spot delta and gamma read from the lattice nodes and 
+// the sensitivities to the vol, rates and credit spread from a tangent rollback
+// (Null<Real>() when the tree pricer doesn't provide them).
+struct TreeValuation
+{
+	Real value;
+	Real delta;
+	Real gamma;
+	Real vega;
+	Real rho;               // to the payoff currency's risk free rate
+	Real dividendRho;       // to the dividend yield, or the underlying currency's rate for fx
+	Real creditSpreadRho;   // to the issuer's credit spread
+
+	TreeValuation(Real value_ = Null<Real>(), Real delta_ = Null<Real>(), Real gamma_ = Null<Real>())
+		: value(value_), delta(delta_), gamma(gamma_), 
+		  vega(Null<Real>()), rho(Null<Real>()), dividendRho(Null<Real>()), creditSpreadRho(Null<Real>()) {}
+};
+
+// Fits a quadratic through three lattice nodes and returns its value, slope and curvature at the spot.
+// The nodes don't need to be equally spaced.
+TreeValuation getValuationFromNodes(const Array& nodeSpots, const Array& nodeValues, Real spot);
+
+// The tangent (directional derivative) of the value from getValuationFromNodes(..), for a fixed spot,
+// when the node spots and node values move with the given tangents.
+Real getValueTangentFromNodes(const Array& nodeSpots,    const Array& nodeValues, 
+							  const Array& spotTangents, const Array& valueTangents, Real spot);
+
+// The parameters of QuantLib's binomial trees, all of which have a node j at step i of
+//     spot * exp( i * driftPerStep + (2j - i) * dx)
+// and constant up probability pu (driftPerStep is zero for the 'equal jumps' trees).
+struct BinomialTreeParameters
+{
+	Real driftPerStep;
+	Real dx;
+	Real pu;
+};
+
+template <class T>
+BinomialTreeParameters getBinomialTreeParameters(const T& tree, Real spot)
+{
+	Real logUp   = std::log(tree.underlying(1, 1) / spot);
+	Real logDown = std::log(tree.underlying(1, 0) / spot);
+	BinomialTreeParameters parameters;
+	parameters.driftPerStep = 0.5 * (logUp + logDown);
+	parameters.dx           = 0.5 * (logUp - logDown);
+	parameters.pu           = tree.probability(0, 0, 1);
+	return parameters;
+}
+
+// A Black-Scholes process with flat rates and vol, e.g. to bump when building trees.
+boost::shared_ptr<GeneralizedBlackScholesProcess> makeFlatBlackScholesProcess(Real       spot, 
+																			  Rate       riskFreeRate, 
+																			  Rate       dividendRate,
+																			  Volatility vol,
+																			  const Date& referenceDate);
+
+// Calls treePricer.price<Tree>(timeSteps) for the tree type chosen at run-time.
+// The TreePricer builds its tree and lattice (or pricing engine) for the given tree class
+// and returns a TreeValuation.
+template <class TreePricer>
+TreeValuation priceOnTree(TreeType treeType, const TreePricer& treePricer, Size timeSteps)
+{
+	Size steps = getTreeTimeSteps(treeType, timeSteps);
+	switch(treeType)
+	{
+	case jarrow_rudd:         return treePricer.template price<JarrowRudd>             (steps);
+	case cox_ross_rubinstein: return treePricer.template price<CoxRossRubinstein>      (steps);
+	case additive_eqp:        return treePricer.template price<AdditiveEQPBinomialTree>(steps);
+	case trigeorgis:          return treePricer.template price<Trigeorgis>             (steps);
+	case tian:                return treePricer.template price<Tian>                   (steps);
+	case leisen_reimer:       return treePricer.template price<LeisenReimer>           (steps);
+	case joshi4:              return treePricer.template price<Joshi4>                 (steps);
+	default:
+		QL_FAIL("priceOnTree(...): unknown tree type " << (Integer) treeType);
+	}
+}
+
+// Extrapolates the value, and the Greeks when both valuations have them.
+TreeValuation richardsonExtrapolate(const TreeValuation& valuationN1, Size N1, 
+									const TreeValuation& valuationN2, Size N2, Size order);
+
+// As above, but when richardson is true we also price with twice the steps and extrapolate.
+template <class TreePricer>
+TreeValuation priceOnTree(TreeType treeType, const TreePricer& treePricer, Size timeSteps, bool richardson)
+{
+	TreeValuation valuation = priceOnTree(treeType, treePricer, timeSteps);
+	if(!richardson)
+		return valuation;
+
+	TreeValuation valuationDoubleSteps = priceOnTree(treeType, treePricer, 2 * timeSteps);
+	TreeValuation extrapolated = richardsonExtrapolate(valuation,            getTreeTimeSteps(treeType,     timeSteps),
+		                                               valuationDoubleSteps, getTreeTimeSteps(treeType, 2 * timeSteps),
+										               getTreeConvergenceOrder(treeType));
+	writeDiagnostics("Richardson extrapolation on a " + toString(treeType) + " tree from " 
+		             + toString(valuation.value) + " and " + toString(valuationDoubleSteps.value) 
+					 + " to " + toString(extrapolated.value),
+					 high, "priceOnTree");
+	return extrapolated;
+}
+
+// Adaptive step selection. Rather than one number of steps for all trades, the trade is priced with
+// minSteps, then with twice as many steps, and so on until two successive estimates agree to within
+// tolerance * |estimate|, or maxSteps is reached. With richardson the estimates are the extrapolations 
+// of successive pairs of valuations.
+struct AdaptiveTreeSettings
+{
+	Size minSteps;
+	Size maxSteps;
+	Real tolerance;
+};
+
+// From the config's tree_adaptive_min_steps, tree_adaptive_max_steps and tree_adaptive_tolerance,
+// 25, 3200 and 0.0001 when not set.
+AdaptiveTreeSettings getConfigAdaptiveTreeSettings();
+
+// stepsUsed is set to the number of steps of the last (largest) tree priced.
+template <class TreePricer>
+TreeValuation priceOnTreeAdaptive(TreeType                    treeType, 
+								  const TreePricer&           treePricer, 
+								  const AdaptiveTreeSettings& settings, 
+								  bool                        richardson,
+								  Size&                       stepsUsed)
+{
+	QL_REQUIRE(settings.minSteps > 2 && settings.minSteps <= settings.maxSteps, 
+		       "priceOnTreeAdaptive(..): need 2 < min steps <= max steps, have " 
+			   << settings.minSteps << " and " << settings.maxSteps);
+
+	Size          steps        = settings.minSteps;
+	TreeValuation valuation    = priceOnTree(treeType, treePricer, steps);
+	TreeValuation estimate     = valuation;
+	bool          haveEstimate = !richardson; // the first extrapolation needs two valuations
+	bool          converged    = false;
+
+	while(!converged && 2 * steps <= settings.maxSteps)
+	{
+		Size          nextSteps     = 2 * steps;
+		TreeValuation nextValuation = priceOnTree(treeType, treePricer, nextSteps);
+		TreeValuation nextEstimate  = nextValuation;
+		if(richardson)
+			nextEstimate = richardsonExtrapolate(valuation,     getTreeTimeSteps(treeType, steps), 
+			                                     nextValuation, getTreeTimeSteps(treeType, nextSteps),
+												 getTreeConvergenceOrder(treeType));
+
+		converged = haveEstimate 
+			        && std::fabs(nextEstimate.value - estimate.value) <= settings.tolerance * std::fabs(nextEstimate.value);
+
+		steps        = nextSteps;
+		valuation    = nextValuation;
+		estimate     = nextEstimate;
+		haveEstimate = true;
+	}
+	stepsUsed = getTreeTimeSteps(treeType, steps);
+
+	if(converged)
+		writeDiagnostics("Adaptive steps on a " + toString(treeType) + " tree converged with " 
+		                 + toString(stepsUsed) + " steps to " + toString(estimate.value), high, "priceOnTreeAdaptive");
+	else
+		writeDiagnostics("Adaptive steps on a " + toString(treeType) + " tree did not converge to within " 
+		                 + toString(settings.tolerance) + " by the maximum of " + toString(stepsUsed) 
+						 + " steps, using " + toString(estimate.value), low, "priceOnTreeAdaptive");
+	return estimate;
+}
+
+// Rollback kernels for the tree priced products. They do the same as QuantLib's TreeLattice::rollback(..),
+// but each level's nodes are updated in one flat loop over the arrays, which the compiler can vectorise.
+// Levels with at least tree_rollback_parallel_threshold nodes are shared between threads (OpenMP).
+
+// The config's tree_rollback_parallel_threshold, 500 when not set.
+Size getRollbackParallelThreshold();
+
+// A level of a BlackScholesLattice: newValues[j] = (pd values[j] + pu values[j+1]) discount, for j < size.
+void stepBackLevel(const Real* values, Real* newValues, Size size, 
+				   Real pd, Real pu, DiscountFactor discount, Size parallelThreshold);
+
+// A level of a TsiveriotisFernandesLattice, the conversion probability is rolled back with the values
+// and gives the blend of the risk free rate and the credit spread used to discount them.
+void stepBackConvertibleLevel(const Real* values,    const Real* conversionProbability,    const Real* spreadAdjustedRate,
+							  Real*       newValues, Real*       newConversionProbability, Real*       newSpreadAdjustedRate,
+							  Size size, Real pd, Real pu, Time dt, Rate riskFreeRate, Spread creditSpread, 
+							  Size parallelThreshold);
+
+// Replaces asset.rollback(to) when the asset was initialized on this lattice.
+template <class T>
+void rollbackOnLattice(DiscretizedAsset& asset, const BlackScholesLattice<T>& lattice, Time to)
+{
+	Time from = asset.time();
+	if(!close(from, to))
+	{
+		QL_REQUIRE(from > to, "rollbackOnLattice(..): cannot roll the asset back to " << to 
+			       << " (it is already at t = " << from << ")");
+
+		const TimeGrid& timeGrid  = lattice.timeGrid();
+		Integer iFrom             = (Integer) timeGrid.index(from);
+		Integer iTo               = (Integer) timeGrid.index(to);
+		Real pd                   = lattice.tree()->probability(0, 0, 0);
+		Real pu                   = lattice.tree()->probability(0, 0, 1);
+		DiscountFactor discount   = lattice.discount(0, 0);
+		Size parallelThreshold    = getRollbackParallelThreshold();
+
+		for(Integer i = iFrom - 1; i >= iTo; i--)
+		{
+			Array newValues(lattice.size(i));
+			stepBackLevel(asset.values().begin(), newValues.begin(), newValues.size(), 
+				          pd, pu, discount, parallelThreshold);
+			asset.time() = timeGrid[i];
+			asset.values().swap(newValues);
+			if(i != iTo)             // the adjustment at 'to' is done below
+				asset.adjustValues();
+		}
+	}
+	asset.adjustValues();
+}
+
+#endif // #ifndef treeengines_hpp
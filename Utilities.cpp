@@ -177,6 +177,15 @@ std::string Config::get(const std::string& key) const
 	return str;
 }
 
+void Config::set(const std::string& key, const std::string& str)
+{
+	addKeyAndString(key, str);
+	if(key == "random_generator_seed")
+		m_randomGeneratorSeedIsInitialized = false;
+	else if(key == "date_format")
+		m_dateFormat = "";
+}
+
 std::string Config::getDateFormat()        // throws on failure.
 {
 	if(!m_dateFormat.length())             // m_dateFormat hasn't yet been initialized.
@@ -23,6 +23,7 @@
 
 
 #include <boost/timer.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <iostream>
 #include <iomanip>
 
@@ -38,8 +39,10 @@ namespace QuantLib {
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 #include <boost/optional.hpp>
+#include <boost/unordered_map.hpp>
 #include <string>
 #include <set>
 #include <exception>
@@ -61,10 +64,12 @@ const std::string CONST_STR_fx_vol                      = "fx_vol";
 const std::string CONST_STR_item                        = "item";
 const std::string CONST_STR_market_data_source_default  = "market_data_source_default";
 const std::string CONST_STR_risk_free_rate              = "risk_free_rate";
+const std::string CONST_STR_snapshot                    = "snapshot";
 const std::string CONST_STR_stock                       = "stock";
 const std::string CONST_STR_version                     = "Sateek Calculator version 0.01";
 const std::string CONST_STR_xmlcomment                  = "<xmlcomment>";
 const std::string CONST_STR_xmlfile                     = "xmlfile";
+const std::string CONST_STR_xmlstream                   = "xmlstream";
 
 const BigNatural CONST_defaultRandomGeneratorSeed       = 0;
 
@@ -151,6 +156,9 @@ public:
 	// get(..) will throw an error if key is not found in the map
 	std::string get(const std::string& key) const;
 
+	// set(..) adds the key, or over-writes it when it's already in the map, e.g. for the test rig's config_overrides.
+	void set(const std::string& key, const std::string& str);
+
     BigNatural getRandomGeneratorSeed();
 
 	std::string getDateFormat(); // throws on failure.